@@ -0,0 +1,60 @@
+/**
+ * \file
+ * Converts binary log files written by PENTrack into the text layout.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+
+#include "logfile.h"
+
+using namespace std;
+
+/**
+ * Convert binary log file into text file.
+ *
+ * @param argc Number of parameters passed via the command line
+ * @param argv Array of parameters passed via the command line (./bin2txt binaryfile [textfile])
+ * @return Return 0 on success, value !=0 on failure
+ */
+int main(int argc, char **argv){
+	if (argc < 2 || argc > 3){
+		cout << "Usage:\nbin2txt path/to/file.bin [path/to/file.out]\nIf no text file is given, output is written to stdout." << endl;
+		return 1;
+	}
+
+	TLogFileReader reader(argv[1]);
+	ofstream outfile;
+	if (argc > 2){
+		outfile.open(argv[2]);
+		if (!outfile.is_open()){
+			cout << "Could not create " << argv[2] << endl;
+			return 1;
+		}
+	}
+	ostream &out = (argc > 2) ? outfile : cout;
+
+	for (unsigned int i = 0; i < reader.columns.size(); i++)
+		out << (i > 0 ? " " : "") << reader.columns[i];
+	out << '\n';
+
+	vector<double> rows;
+	unsigned int ncols = reader.columns.size();
+	while (unsigned long long nrows = reader.ReadBlock(rows)){
+		for (unsigned long long i = 0; i < nrows; i++){
+			for (unsigned int j = 0; j < ncols; j++){
+				if (j > 0)
+					out << ' ';
+				if (LogIntegerType(reader.types[j]))
+					out << (long long)rows[i*ncols + j];
+				else{
+					out.precision(reader.types[j] == 'f' ? 7 : 10); // do not print digits float32 does not store
+					out << rows[i*ncols + j];
+				}
+			}
+			out << '\n';
+		}
+	}
+	return 0;
+}
@@ -1,9 +1,9 @@
 #include "bruteforce.h"
 #include "globals.h"
 
-TBFIntegrator::TBFIntegrator(double agamma, std::string aparticlename, std::map<std::string, std::string> &conf, std::ofstream &spinout)
+TBFIntegrator::TBFIntegrator(double agamma, std::string aparticlename, std::map<std::string, std::string> &conf, TLogFile &spinout)
 				: gamma(agamma), particlename(aparticlename), Bmax(0), BFBminmem(std::numeric_limits<double>::infinity()),
-				  spinlog(false), spinloginterval(5e-7), intsteps(0), fspinout(spinout), starttime(0), t1(0), t2(0){
+				  spinlog(false), spinloginterval(5e-7), intsteps(0), totalintsteps(0), fspinout(spinout), starttime(0), t1(0), t2(0){
 	std::istringstream(conf["BFmaxB"]) >> Bmax;
 	std::istringstream BFtimess(conf["BFtimes"]);
 	do{
@@ -36,16 +36,8 @@ void TBFIntegrator::operator()(const state_type &y, value_type x){
 		return;
 	if (!fspinout.is_open()){
 		std::ostringstream BFoutfile1;
-		BFoutfile1 << outpath << "/" << std::setw(12) << std::setfill('0') << jobnumber << std::setw(0) << particlename << "spin.out ";
-		std::cout << "Creating " << BFoutfile1.str() << '\n';
-		fspinout.open(BFoutfile1.str().c_str());
-		if(!fspinout.is_open())
-		{
-			std::cout << "Could not open " << BFoutfile1.str() << '\n';
-			exit(-1);
-		}
-		fspinout.precision(10);
-		fspinout << "t Babs Polar logPolar Ix Iy Iz Bx By Bz\n";
+		BFoutfile1 << outpath << "/" << std::setw(12) << std::setfill('0') << jobnumber << std::setw(0) << particlename << "spin.out";
+		fspinout.Open(BFoutfile1.str(), "t Babs Polar logPolar Ix Iy Iz Bx By Bz");
 	}
 
 	value_type B[3];
@@ -57,9 +49,10 @@ void TBFIntegrator::operator()(const state_type &y, value_type x){
 		BFlogpol = log10(0.5-BFpol);
 	else if (BFpol==0.5)
 		BFlogpol = 0.0;
-	fspinout << x << " " << BFBws << " " << BFpol << " " << BFlogpol << " "
-			<< 2*y[0] << " " << 2*y[1] << " " << 2*y[2] << " "
-			<< B[0]/BFBws << " " << B[1]/BFBws << " " << B[2]/BFBws << '\n';
+	fspinout << x << BFBws << BFpol << BFlogpol
+			<< 2*y[0] << 2*y[1] << 2*y[2]
+			<< B[0]/BFBws << B[1]/BFBws << B[2]/BFBws;
+	fspinout.WriteRow();
 }
 
 long double TBFIntegrator::Integrate(double x1, double y1[6], double B1[4][4],
@@ -87,7 +80,8 @@ long double TBFIntegrator::Integrate(double x1, double y1[6], double B1[4][4],
 				else
 					I_n[2] = 0.5;
 				starttime = x1;
-				std::cout << "\nBF starttime, " << x1 << " ";
+				if (VERBOSE(VERBOSITY_STEP))
+					std::cout << "\nBF starttime, " << x1 << " ";
 //					stepper = boost::numeric::odeint::make_dense_output((value_type)1e-12, (value_type)1e-12, stepper_type());
 //					stepper = boost::numeric::odeint::make_controlled(static_cast<value_type>(1e-12), static_cast<value_type>(1e-12), stepper_type());
 //					stepper = stepper_type(static_cast<value_type>(1e-12), static_cast<value_type>(1e-12));
@@ -126,9 +120,11 @@ long double TBFIntegrator::Integrate(double x1, double y1[6], double B1[4][4],
 			times.push_back(x2);
 			dense_stepper_type stepper = boost::numeric::odeint::make_controlled(static_cast<value_type>(1e-12), static_cast<value_type>(1e-12), stepper_type());
 			// integrate(stepper, ODEsystem functor, initial state, start time, end time, initial time step, observer functor)
-			intsteps += boost::numeric::odeint::integrate_times(
+			long int steps = boost::numeric::odeint::integrate_times(
 					stepper, boost::ref(*this), I_n, times.begin(),
 					times.end(), static_cast<value_type>(1e-9), boost::ref(*this));
+			intsteps += steps;
+			totalintsteps += steps;
 
 			if (B2[3][0] > Bmax || !BruteForce2){
 				// output of polarisation after BF int completed
@@ -137,7 +133,8 @@ long double TBFIntegrator::Integrate(double x1, double y1[6], double B1[4][4],
 									 + I_n[1]*B2[1][0]
 									 + I_n[2]*B2[2][0])/B2[3][0];
 
-				std::cout << "BF dt " << x2 - starttime << ", BFflipprop " << 1 - (BFpol + 0.5) << ", intsteps taken " << intsteps << ", Bmin " << BFBminmem << " ";
+				if (VERBOSE(VERBOSITY_STEP))
+					std::cout << "BF dt " << x2 - starttime << ", BFflipprop " << 1 - (BFpol + 0.5) << ", intsteps taken " << intsteps << ", Bmin " << BFBminmem << " ";
 
 				BFBminmem = std::numeric_limits<double>::infinity(); // reset values when done
 				intsteps = 0;
@@ -13,6 +13,8 @@
 
 #include <boost/numeric/odeint.hpp>
 
+#include "logfile.h"
+
 /**
  * Bloch equation integrator.
  *
@@ -37,7 +39,8 @@ private:
 	bool spinlog; ///< Should the tracking be logged to file?
 	double spinloginterval; ///< Time interval between log file entries.
 	long int intsteps; ///< Count integrator steps during spin tracking for information.
-	std::ofstream &fspinout; ///< file to log into
+	long int totalintsteps; ///< Count all integrator steps since construction.
+	TLogFile &fspinout; ///< file to log into
 	double starttime; ///< time of last integration start
 
 	value_type t1; ///< field interpolation start time
@@ -55,9 +58,9 @@ public:
 	 * @param agamma Gyromagnetic ration of particle whose spin is to be tracked.
 	 * @param aparticlename Particle name.
 	 * @param conf Option map containing particle specific spin tracking options.
-	 * @param spinout Stream to which spin track is written
+	 * @param spinout Log file to which spin track is written
 	 */
-	TBFIntegrator(double agamma, std::string aparticlename, std::map<std::string, std::string> &conf, std::ofstream &spinout);
+	TBFIntegrator(double agamma, std::string aparticlename, std::map<std::string, std::string> &conf, TLogFile &spinout);
 private:
 	/**
 	 * Do cubic spline interpolation of magnetic field components with coefficients determined in TBFderivs::TBFderivs
@@ -104,6 +107,16 @@ public:
 	long double Integrate(double x1, double y1[6], double B1[4][4],
 						double x2, double y2[6], double B2[4][4]);
 
+
+	/**
+	 * Get number of spin integration steps.
+	 *
+	 * @return Returns number of integrator steps taken since construction.
+	 */
+	long int GetTotalIntSteps(){
+		return totalintsteps;
+	}
+
 };
 
 #endif // BRUTEFORCE_H_
@@ -30,8 +30,9 @@ struct TConductorField: public TField{
 	 * @param z Cartesian z coordinate
 	 * @param t Time
 	 * @param B Magnetic field components
+	 * @param request Combination of BFIELD_VALUE and BFIELD_DERIVATIVES, derivatives are only added if BFIELD_DERIVATIVES is set
 	 */
-	virtual void BField(double x, double y, double z, double t, double B[4][4]) = 0;
+	virtual void BField(double x, double y, double z, double t, double B[4][4], int request) = 0;
 
 	/**
 	 * Adds no electric field.
@@ -63,7 +64,7 @@ struct TFiniteWire: public TConductorField{
 	 */
 	TFiniteWire(double SW1xx, double SW1yy, double SW1zz, double SW2xx, double SW2yy, double SW2zz, double aI);
 
-	void BField(const double x, const double y, const double z, double t, double B[4][4]);
+	void BField(const double x, const double y, const double z, double t, double B[4][4], int request);
 };
 
 /**
@@ -80,7 +81,7 @@ struct TFiniteWireX: public TConductorField{
 	 */
 	TFiniteWireX(double SW1xx, double SW2xx, double SWzz, double aI);
 
-	void BField(const double x, const double y, const double z, double t, double B[4][4]);
+	void BField(const double x, const double y, const double z, double t, double B[4][4], int request);
 };
 
 /**
@@ -97,7 +98,7 @@ struct TFiniteWireY: public TConductorField{
 	 */
 	TFiniteWireY(double SW1yy, double SW2yy, double SWzz, double aI);
 
-	void BField(const double x, const double y, const double z, double t, double B[4][4]);
+	void BField(const double x, const double y, const double z, double t, double B[4][4], int request);
 };
 
 
@@ -115,7 +116,7 @@ struct TFiniteWireZ: public TConductorField{
 	 */
 	TFiniteWireZ(double SWxx, double SWyy, double SW1zz, double SW2zz, double aI);
 
-	void BField(const double x, const double y, const double z, double t, double B[4][4]);
+	void BField(const double x, const double y, const double z, double t, double B[4][4], int request);
 };
 
 
@@ -131,7 +132,7 @@ struct TFiniteWireZCenter: public TConductorField{
 	 */
 	TFiniteWireZCenter(double SW1zz, double SW2zz, double aI);
 
-	void BField(const double x, const double y, const double z, double t, double B[4][4]);
+	void BField(const double x, const double y, const double z, double t, double B[4][4], int request);
 };
 
 
@@ -151,7 +152,7 @@ struct TFullRacetrack: public TConductorField{
 	 */
 	TFullRacetrack(double SW1zz, double SW2zz, double SWrr, double aI);
 
-	void BField(double x, double y, double z, double t, double B[4][4]);
+	void BField(double x, double y, double z, double t, double B[4][4], int request);
 };
 
 
@@ -167,7 +168,7 @@ struct TInfiniteWireZ: public TConductorField{
 	 */
 	TInfiniteWireZ(double lxx, double lyy, double aI);
 
-	void BField(double x,double y,double z, double t, double B[4][4]);
+	void BField(double x,double y,double z, double t, double B[4][4], int request);
 };
 
 
@@ -180,7 +181,7 @@ struct TInfiniteWireZCenter: public TConductorField{
 	 */
 	TInfiniteWireZCenter(double aI);
 
-	void BField(const double x, const double y, const double z, double t, double B[4][4]);
+	void BField(const double x, const double y, const double z, double t, double B[4][4], int request);
 };
 
 #endif /*RACETRACK_H_*/
@@ -8,11 +8,11 @@
 
 const char* NAME_ELECTRON = "electron";
 
-ofstream TElectron::endout; ///< endlog file stream
-ofstream TElectron::snapshotout; ///< snapshot file stream
-ofstream TElectron::trackout; ///< tracklog file stream
-ofstream TElectron::hitout; ///< hitlog file stream
-ofstream TElectron::spinout; ///< spinlog file stream
+TLogFile TElectron::endout; ///< endlog file
+TLogFile TElectron::snapshotout; ///< snapshot file
+TLogFile TElectron::trackout; ///< tracklog file
+TLogFile TElectron::hitout; ///< hitlog file
+TLogFile TElectron::spinout; ///< spinlog file
 
 
 TElectron::TElectron(int number, double t, double x, double y, double z, double E, double phi, double theta, TMCGenerator &amc, TGeometry &geometry, TFieldManager *afield)
@@ -34,7 +34,8 @@ bool TElectron::OnStep(value_type x1, state_type y1, value_type &x2, state_type
 		for (int i = 0; i < 6; i++)
 			y2[i] = y1[i];
 		StopIntegration(ID_ABSORBED_IN_MATERIAL, x2, y2, polarisation, currentsolid);
-		printf("Absorption!\n");
+		if (VERBOSE(VERBOSITY_STEP))
+			printf("Absorption!\n");
 		return true;
 	}
 /*		else{
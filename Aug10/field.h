@@ -7,6 +7,10 @@
 #ifndef FIELD_H_
 #define FIELD_H_
 
+static const int BFIELD_VALUE = 1; ///< request magnetic field vector B[0..2][0] and absolute value B[3][0]
+static const int BFIELD_DERIVATIVES = 2; ///< request derivatives B[0..2][1..3] and gradient of absolute value B[3][1..3]
+static const int BFIELD_ALL = BFIELD_VALUE | BFIELD_DERIVATIVES; ///< request complete magnetic field matrix
+
 /**
  * Virtual base class for all field calculation methods
  */
@@ -20,6 +24,7 @@ public:
 	 *	By,		dBydx,	dBydy,	dBydz;
 	 *	Bz,		dBzdx,	dBzdy,	dBzdz;
 	 *	Babs,	dBdx,	dBdy,	dBdz;
+	 * Only the entries selected by request have to be added, derived classes may skip the expensive derivatives if they are not requested.
 	 * Has to be implemented by all derived field calculation classes.
 	 *
 	 * @param x Cartesian x coordinate
@@ -27,8 +32,9 @@ public:
 	 * @param z Cartesian z coordinate
 	 * @param t Time
 	 * @param B Magnetic field component matrix to which the values are added
+	 * @param request Combination of BFIELD_VALUE and BFIELD_DERIVATIVES
 	 */
-	virtual void BField (double x, double y, double z, double t, double B[4][4]) = 0;
+	virtual void BField (double x, double y, double z, double t, double B[4][4], int request) = 0;
 
 	/**
 	 * Add electric field and potential at a given position.
@@ -44,6 +50,14 @@ public:
 	 */
 	virtual void EField (double x, double y, double z, double t, double &V, double Ei[3]) = 0;
 
+	/**
+	 * Copy field data into newly allocated memory.
+	 *
+	 * The new memory is placed according to the current memory policy, e.g. on the NUMA node the process is bound to.
+	 * Fields without large data do nothing.
+	 */
+	virtual void Replicate(){ };
+
 	/**
 	 * Virtual destructor
 	 */
@@ -272,15 +272,28 @@ TabField::~TabField(){
 }
 
 
-void TabField::BField(double x, double y, double z, double t, double B[4][4]){
+void TabField::BField(double x, double y, double z, double t, double B[4][4], int request){
 	double r = sqrt(x*x+y*y);
 	double Bscale = BFieldScale(t);
 	if (Bscale != 0 && r >= rind[0] && r <= rind[m-1] && z >= zind[0] && z <= zind[n-1]){
-		// bicubic interpolation
 		double Br = 0, dBrdr = 0, dBrdz = 0, Bphi = 0, dBphidr = 0, dBphidz = 0, dBzdr = 0;
 		double Bx = 0, By = 0, Bz = 0, dBxdz = 0, dBydz = 0, dBzdz = 0;
 		double dummy;
 		double phi = atan2(y,x);
+		if (!(request & BFIELD_DERIVATIVES)){ // bicubic interpolation without derivatives
+			if (BrTab.length() > 0)
+				Br = alglib::spline2dcalc(Brc, r, z);
+			if (BphiTab.length() > 0)
+				Bphi = alglib::spline2dcalc(Bphic, r, z);
+			if (BzTab.length() > 0)
+				Bz = alglib::spline2dcalc(Bzc, r, z);
+			CylToCart(Br,Bphi,phi,Bx,By);
+			B[0][0] += Bx*Bscale;
+			B[1][0] += By*Bscale;
+			B[2][0] += Bz*Bscale;
+			return;
+		}
+		// bicubic interpolation
 		if (BrTab.length() > 0){
 			alglib::spline2ddiff(Brc, r, z, Br, dBrdr, dBrdz, dummy);
 		}
@@ -343,3 +356,12 @@ void TabField::EField(double x, double y, double z, double t, double &V, double
 		}
 	}
 }
+
+
+void TabField::Replicate(){
+	alglib::spline2dinterpolant *interpolants[7] = {&Brc, &Bphic, &Bzc, &Erc, &Ephic, &Ezc, &Vc};
+	for (int i = 0; i < 7; i++){
+		alglib::spline2dinterpolant copy(*interpolants[i]);
+		*interpolants[i] = copy; // assignment allocates new memory
+	}
+}
@@ -106,8 +106,9 @@ class TabField: public TField{
 		 * @param z Z coordinate where the field shall be evaluated
 		 * @param t Time
 		 * @param B Adds magnetic field components B[0..2][0], their derivatives B[0..2][1..3], the absolute value B[3][0] and its derivatives B[3][1..3]
+		 * @param request Combination of BFIELD_VALUE and BFIELD_DERIVATIVES, derivatives of the splines are only evaluated if requested
 		 */
-		void BField(double x, double y, double z, double t, double B[4][4]);
+		void BField(double x, double y, double z, double t, double B[4][4], int request);
 
 
 		/**
@@ -126,6 +127,12 @@ class TabField: public TField{
 		 * @return Returns true if electric field could be evaluated at this point
 		 */
 		void EField(double x, double y, double z, double t, double &V, double Ei[3]);
+
+
+		/**
+		 * Copy interpolants into newly allocated memory, see TField::Replicate.
+		 */
+		void Replicate();
 };
 
 
@@ -6,6 +6,9 @@
 #include <fstream>
 #include <iostream>
 #include <cmath>
+#include <cstdlib>
+#include <cctype>
+#include <algorithm>
 
 #include "interpolation.h"
 
@@ -292,53 +295,237 @@ void TabField3::CalcDerivs(vector<double> &Tab, vector<double> &Tab1, vector<dou
 };
 
 
+void TabField3::CalcDerivs(vector<double> &Tab, vector<vector<double> > &Tabs){
+	Tabs.resize(8);
+	Tabs[0].swap(Tab);
+	for (int i = 1; i < 8; i++)
+		Tabs[i].resize(xl*yl*zl);
+	CalcDerivs(Tabs[0],Tabs[1],Tabs[2],Tabs[3],Tabs[4],Tabs[5],Tabs[6],Tabs[7]);
+}
+
+
+void TabField3::CalcCellCoeff(double coeff[64], const vector<vector<double> > &Tabs, int indx, int indy, int indz){
+	double yyy[8], yyy1[8], yyy2[8], yyy3[8], yyy12[8], yyy13[8], yyy23[8], yyy123[8]; //rectangle with values at the 4 corners for interpolation
+
+	// fill cube with values and derivatives
+	// order: see Lekien, Marsden: "Tricubic interpolation in three dimensions"
+	int i3[8] ={INDEX_3D(indx  , indy  , indz  , xl, yl, zl),
+				INDEX_3D(indx+1, indy  , indz  , xl, yl, zl),
+				INDEX_3D(indx  , indy+1, indz  , xl, yl, zl),
+				INDEX_3D(indx+1, indy+1, indz  , xl, yl, zl),
+				INDEX_3D(indx  , indy  , indz+1, xl, yl, zl),
+				INDEX_3D(indx+1, indy  , indz+1, xl, yl, zl),
+				INDEX_3D(indx  , indy+1, indz+1, xl, yl, zl),
+				INDEX_3D(indx+1, indy+1, indz+1, xl, yl, zl)};
+
+	for (int i = 0; i < 8; i++){
+		yyy[i]    = Tabs[0][i3[i]];
+		yyy1[i]   = Tabs[1][i3[i]]*xdist;
+		yyy2[i]   = Tabs[2][i3[i]]*ydist;
+		yyy3[i]   = Tabs[3][i3[i]]*zdist;
+		yyy12[i]  = Tabs[4][i3[i]]*xdist*ydist;
+		yyy13[i]  = Tabs[5][i3[i]]*xdist*zdist;
+		yyy23[i]  = Tabs[6][i3[i]]*ydist*zdist;
+		yyy123[i] = Tabs[7][i3[i]]*xdist*ydist*zdist;
+	}
+
+	// determine coefficients of interpolation
+	tricubic_get_coeff(coeff, yyy, yyy1, yyy2, yyy3, yyy12, yyy13, yyy23, yyy123);
+}
+
+
 void TabField3::PreInterpol(vector<vector<double> > &coeff, vector<double> &Tab){
-	vector<double> Tab1(xl*yl*zl), Tab2(xl*yl*zl), Tab3(xl*yl*zl);
-	vector<double> Tab12(xl*yl*zl), Tab13(xl*yl*zl), Tab23(xl*yl*zl), Tab123(xl*yl*zl);
-	CalcDerivs(Tab,Tab1,Tab2,Tab3,Tab12,Tab13,Tab23,Tab123);
+	vector<vector<double> > Tabs;
+	CalcDerivs(Tab,Tabs);
 
 	// allocating space for the preinterpolation
 	// The B*c are 5D arrays with xl x yl x zl x 4 x 4 fields
 	coeff.resize((xl-1)*(yl-1)*(zl-1));
 
-	int indx, indy, indz;
-	double yyy[8], yyy1[8], yyy2[8], yyy3[8], yyy12[8], yyy13[8], yyy23[8], yyy123[8]; //rectangle with values at the 4 corners for interpolation
-
-	for (indx=0; indx < xl-1; indx++){
-		for (indy=0; indy < yl-1; indy++){
-			for (indz=0; indz < zl-1; indz++){
-				// fill cube with values and derivatives
-				// order: see Lekien, Marsden: "Tricubic interpolation in three dimensions"
-				int i3[8] ={INDEX_3D(indx  , indy  , indz  , xl, yl, zl),
-							INDEX_3D(indx+1, indy  , indz  , xl, yl, zl),
-							INDEX_3D(indx  , indy+1, indz  , xl, yl, zl),
-							INDEX_3D(indx+1, indy+1, indz  , xl, yl, zl),
-							INDEX_3D(indx  , indy  , indz+1, xl, yl, zl),
-							INDEX_3D(indx+1, indy  , indz+1, xl, yl, zl),
-							INDEX_3D(indx  , indy+1, indz+1, xl, yl, zl),
-							INDEX_3D(indx+1, indy+1, indz+1, xl, yl, zl)};
-
-				for (int i = 0; i < 8; i++){
-					yyy[i]    = Tab[i3[i]];
-					yyy1[i]   = Tab1[i3[i]]*xdist;
-					yyy2[i]   = Tab2[i3[i]]*ydist;
-					yyy3[i]   = Tab3[i3[i]]*zdist;
-					yyy12[i]  = Tab12[i3[i]]*xdist*ydist;
-					yyy13[i]  = Tab13[i3[i]]*xdist*zdist;
-					yyy23[i]  = Tab23[i3[i]]*ydist*zdist;
-					yyy123[i] = Tab123[i3[i]]*xdist*ydist*zdist;
-				}
-
-				// determine coefficients of interpolation
+	for (int indx=0; indx < xl-1; indx++){
+		for (int indy=0; indy < yl-1; indy++){
+			for (int indz=0; indz < zl-1; indz++){
 				int ind3 = INDEX_3D(indx, indy, indz, xl-1, yl-1, zl-1);
 				coeff[ind3].resize(64);
-				tricubic_get_coeff(&coeff[ind3][0], yyy, yyy1, yyy2, yyy3, yyy12, yyy13, yyy23, yyy123);
+				CalcCellCoeff(&coeff[ind3][0], Tabs, indx, indy, indz);
 			}
 		}
 	}
 };
 
 
+bool TabField3::FindCell(double x, double y, double z, int &cell, double u[3], double h[3]){
+	// get coordinate index
+	int indx = (int)floor((x - x_mi)/xdist);
+	int indy = (int)floor((y - y_mi)/ydist);
+	int indz = (int)floor((z - z_mi)/zdist);
+	if (indx < 0 || indx >= xl - 1 || indy < 0 || indy >= yl - 1 || indz < 0 || indz >= zl - 1)
+		return false;
+	cell = INDEX_3D(indx, indy, indz, xl-1, yl-1, zl-1);
+	// scale coordinates to unit cube
+	u[0] = (x - x_mi - indx*xdist)/xdist;
+	u[1] = (y - y_mi - indy*ydist)/ydist;
+	u[2] = (z - z_mi - indz*zdist)/zdist;
+	h[0] = xdist;
+	h[1] = ydist;
+	h[2] = zdist;
+	return true;
+}
+
+
+void TabField3::InitCache(int items, int slots, int slotsize){
+	CacheItems = items;
+	CacheSlots = slots;
+	SlotSize = slotsize;
+	ItemCoeffs.assign(items, NULL);
+	ItemReferenced.assign(items, 0);
+	ItemSlot.assign(items, -1);
+	ClockHand = 0;
+	pthread_key_create(&CacheKey, &ReleaseThreadCache);
+	pthread_mutex_init(&CacheMutex, NULL);
+}
+
+
+TabField3::TCacheThread& TabField3::ThreadCache(){
+	TCacheThread *thread = (TCacheThread*)pthread_getspecific(CacheKey);
+	if (!thread){
+		thread = new TCacheThread;
+		thread->Item = -1;
+		thread->Coeffs = NULL;
+		thread->LastItem = -1;
+		thread->Field = this;
+		pthread_mutex_lock(&CacheMutex);
+		CacheThreads.push_back(thread);
+		pthread_mutex_unlock(&CacheMutex);
+		pthread_setspecific(CacheKey, thread);
+	}
+	return *thread;
+}
+
+
+void TabField3::ReleaseThreadCache(void *thread){
+	TCacheThread *t = (TCacheThread*)thread;
+	TabField3 *f = t->Field;
+	__atomic_store_n(&t->Item, -1, __ATOMIC_SEQ_CST); // withdraw announced item, like a thread moving to another one
+	pthread_mutex_lock(&f->CacheMutex);
+	f->CacheThreads.erase(find(f->CacheThreads.begin(), f->CacheThreads.end(), t));
+	pthread_mutex_unlock(&f->CacheMutex);
+	delete t;
+}
+
+
+double* TabField3::CachedItem(int item){
+	TCacheThread &thread = ThreadCache();
+	if (item == thread.Item) // item was used last and cannot have been dropped
+		return thread.Coeffs;
+
+	// announce item before looking it up, so AcquireSlot does not drop it after it was found (or sees it and keeps it)
+	__atomic_store_n(&thread.Item, item, __ATOMIC_SEQ_CST);
+	double *coeffs = __atomic_load_n(&ItemCoeffs[item], __ATOMIC_SEQ_CST);
+	if (!coeffs){ // item is not cached or is being dropped
+		pthread_mutex_lock(&CacheMutex);
+		int slot = ItemSlot[item];
+		if (slot < 0){ // load item into a slot without holding the lock
+			slot = AcquireSlot();
+			coeffs = SlotCoeffs[slot];
+			pthread_mutex_unlock(&CacheMutex);
+			LoadItem(item, coeffs);
+			pthread_mutex_lock(&CacheMutex);
+			if (ItemSlot[item] >= 0){ // another thread loaded the same item in the meantime
+				FreeSlots.push_back(slot);
+				slot = ItemSlot[item];
+			}
+			else{
+				ItemSlot[item] = slot;
+				SlotItem[slot] = item;
+				__atomic_store_n(&ItemCoeffs[item], coeffs, __ATOMIC_SEQ_CST);
+			}
+		}
+		coeffs = SlotCoeffs[slot];
+		pthread_mutex_unlock(&CacheMutex);
+	}
+	if (!__atomic_load_n(&ItemReferenced[item], __ATOMIC_RELAXED)) // avoid writing to cache lines shared with other threads if mark is already set
+		__atomic_store_n(&ItemReferenced[item], 1, __ATOMIC_RELAXED);
+	thread.Coeffs = coeffs;
+	return coeffs;
+}
+
+
+int TabField3::AcquireSlot(){
+	if (!FreeSlots.empty()){
+		int slot = FreeSlots.back();
+		FreeSlots.pop_back();
+		return slot;
+	}
+
+	int slots = SlotCoeffs.size();
+	for (int n = 0; slots >= CacheSlots && n < 2*slots; n++){ // drop item not referenced since last pass of clock hand, which no thread is evaluating
+		int slot = ClockHand;
+		ClockHand = (ClockHand + 1) % slots;
+		int item = SlotItem[slot];
+		if (item < 0) // slot is being loaded
+			continue;
+		if (__atomic_load_n(&ItemReferenced[item], __ATOMIC_RELAXED)){ // give item a second chance
+			__atomic_store_n(&ItemReferenced[item], 0, __ATOMIC_RELAXED);
+			continue;
+		}
+		__atomic_store_n(&ItemCoeffs[item], (double*)NULL, __ATOMIC_SEQ_CST); // withdraw item before checking threads
+		bool used = false;
+		for (vector<TCacheThread*>::iterator i = CacheThreads.begin(); i != CacheThreads.end(); i++)
+			used |= __atomic_load_n(&(*i)->Item, __ATOMIC_SEQ_CST) == item;
+		if (used){ // another thread may have found the item, keep it
+			__atomic_store_n(&ItemCoeffs[item], SlotCoeffs[slot], __ATOMIC_SEQ_CST);
+			continue;
+		}
+		ItemSlot[item] = -1;
+		SlotItem[slot] = -1;
+		return slot;
+	}
+
+	// use new slot while cache is not full (or if all items are being evaluated by other threads)
+	SlotCoeffs.push_back(new double[SlotSize]);
+	SlotItem.push_back(-1);
+	return SlotCoeffs.size() - 1;
+}
+
+
+void TabField3::LoadItem(int item, double *coeffs){
+	int indx = item % (xl-1), indy = item/(xl-1) % (yl-1), indz = item/(xl-1)/(yl-1);
+	for (int i = 0; i < 4; i++){
+		if (ColumnOffset[i] >= 0)
+			CalcCellCoeff(&coeffs[ColumnOffset[i]], Tabs[i], indx, indy, indz);
+	}
+}
+
+
+void TabField3::ClearCache(){
+	for (vector<double*>::iterator i = SlotCoeffs.begin(); i != SlotCoeffs.end(); i++)
+		delete[] *i;
+	SlotCoeffs.clear();
+	SlotItem.clear();
+	FreeSlots.clear();
+	ClockHand = 0;
+	vector<double*>(CacheItems, NULL).swap(ItemCoeffs);
+	vector<char>(CacheItems, 0).swap(ItemReferenced);
+	vector<int>(CacheItems, -1).swap(ItemSlot);
+	for (vector<TCacheThread*>::iterator i = CacheThreads.begin(); i != CacheThreads.end(); i++){
+		(*i)->Item = (*i)->LastItem = -1;
+		(*i)->Coeffs = NULL;
+	}
+}
+
+
+double* TabField3::Coefficients(int column, int i3){
+	if (CacheSlots == 0){ // all coefficients were precalculated
+		vector<vector<double> > *coeffs[4] = {&Bxc, &Byc, &Bzc, &Vc};
+		return coeffs[column]->size() > 0 ? &(*coeffs[column])[i3][0] : NULL;
+	}
+	if (ColumnOffset[column] < 0)
+		return NULL;
+	return CachedItem(i3) + ColumnOffset[column];
+}
+
+
 double TabField3::BFieldScale(double t){
 	if (t < NullFieldTime || t >= NullFieldTime + RampUpTime + FullFieldTime + RampDownTime)
 		return 0;
@@ -362,19 +549,93 @@ double TabField3::BFieldScale(double t){
 }
 
 
+TabField3::TabField3(double aNullFieldTime, double aRampUpTime, double aFullFieldTime, double aRampDownTime, double aBoundaryWidth){
+	NullFieldTime = aNullFieldTime;
+	RampUpTime = aRampUpTime;
+	FullFieldTime = aFullFieldTime;
+	RampDownTime = aRampDownTime;
+	BoundaryWidth = aBoundaryWidth;
+	for (int i = 0; i < 4; i++)
+		ColumnOffset[i] = -1;
+	CellSize = 0;
+	CacheSlots = 0;
+	CacheItems = 0;
+	SlotSize = 0;
+	Mirror[0] = Mirror[1] = Mirror[2] = false;
+	AxialMirror[0] = AxialMirror[1] = AxialMirror[2] = false;
+	RotationFold = 1;
+	SymmetryPlaneFace[0] = SymmetryPlaneFace[1] = SymmetryPlaneFace[2] = false;
+}
+
+
 TabField3::TabField3(const char *tabfile, double Bscale, double Escale,
-		double aNullFieldTime, double aRampUpTime, double aFullFieldTime, double aRampDownTime, double aBoundaryWidth){
+		double aNullFieldTime, double aRampUpTime, double aFullFieldTime, double aRampDownTime, double aBoundaryWidth,
+		double CacheSize, const char *Symmetry){
 	NullFieldTime = aNullFieldTime;
 	RampUpTime = aRampUpTime;
 	FullFieldTime = aFullFieldTime;
 	RampDownTime = aRampDownTime;
 	BoundaryWidth = aBoundaryWidth;
+	CellSize = 0;
+	CacheSlots = 0;
+	CacheItems = 0;
+	SlotSize = 0;
+	Mirror[0] = Mirror[1] = Mirror[2] = false;
+	AxialMirror[0] = AxialMirror[1] = AxialMirror[2] = false;
+	RotationFold = 1;
+	for (const char *c = Symmetry; *c; ){
+		if (*c >= 'x' && *c <= 'z')
+			Mirror[*(c++) - 'x'] = true;
+		else if (*c >= 'X' && *c <= 'Z'){
+			Mirror[*c - 'X'] = true;
+			AxialMirror[*(c++) - 'X'] = true;
+		}
+		else if (*c == 'r' && isdigit(c[1])){
+			char *end;
+			RotationFold = strtol(c + 1, &end, 10);
+			c = end;
+		}
+		else{
+			printf("Unknown symmetry %s for %s! Exiting...\n", Symmetry, tabfile);
+			exit(-1);
+		}
+	}
 
 	vector<double> BxTab, ByTab, BzTab;	// Bx/By/Bz values
 	vector<double> VTab; // potential values
 	ReadTabFile(tabfile,Bscale,Escale,BxTab,ByTab,BzTab,VTab); // open tabfile and read values into arrays
 
 	CheckTab(BxTab,ByTab,BzTab,VTab); // print some info
+	if (RotationFold > 1)
+		printf("Field has %i-fold rotational symmetry around z axis\n", RotationFold);
+	for (int i = 0; i < 3; i++)
+		if (Mirror[i])
+			printf("Field is mirror symmetric in %c (magnetic field %s)\n", 'x' + i, AxialMirror[i] ? "axial" : "polar");
+	// symmetrized points have positive x/y/z when mirrored and positive y (and x for sectors up to 90 degrees) when rotated
+	bool positive[3] = {Mirror[0] || RotationFold >= 4, Mirror[1] || RotationFold > 1, Mirror[2]};
+	double lower[3] = {x_mi, y_mi, z_mi};
+	for (int i = 0; i < 3; i++)
+		SymmetryPlaneFace[i] = positive[i] && lower[i] <= 0;
+
+	if (CacheSize > 0){
+		printf("Calculating derivatives ... ");
+		vector<double> *columns[4] = {&BxTab, &ByTab, &BzTab, &VTab};
+		const char *names[4] = {"Bx", "By", "Bz", "V"};
+		for (int i = 0; i < 4; i++){
+			ColumnOffset[i] = -1;
+			if (columns[i]->size() > 0){
+				printf("%s ... ", names[i]);
+				fflush(stdout);
+				CalcDerivs(*columns[i], Tabs[i]); // coefficients of each cell are calculated from these in TabField3::Coefficients
+				ColumnOffset[i] = CellSize;
+				CellSize += 64;
+			}
+		}
+		if (CellSize > 0)
+			InitCache((xl-1)*(yl-1)*(zl-1), max(1, (int)min(CacheSize*1024*1024/(CellSize*sizeof(double)), (double)(xl-1)*(yl-1)*(zl-1))), CellSize);
+		printf("Done (%.f MB, coefficients of %i cells are cached)\n", CellSize/64*8.0*xl*yl*zl*sizeof(double)/1024/1024, CacheSlots);
+		return;
+	}
 
 	printf("Starting Preinterpolation ... ");
 	float size = 0;
@@ -410,45 +671,78 @@ TabField3::TabField3(const char *tabfile, double Bscale, double Escale,
 }
 
 
-void TabField3::BField(double x, double y, double z, double t, double B[4][4]){
+TabField3::~TabField3(){
+	if (CacheSlots > 0){
+		ClearCache();
+		for (vector<TCacheThread*>::iterator i = CacheThreads.begin(); i != CacheThreads.end(); i++)
+			delete *i;
+		pthread_key_delete(CacheKey);
+		pthread_mutex_destroy(&CacheMutex);
+	}
+}
+
+
+void TabField3::BField(double x, double y, double z, double t, double B[4][4], int request){
 	double Bscale = BFieldScale(t);
-	// get coordinate index
-	int indx = (int)floor((x - x_mi)/xdist);
-	int indy = (int)floor((y - y_mi)/ydist);
-	int indz = (int)floor((z - z_mi)/zdist);
-	if (Bscale != 0 && indx >= 0 && indx < xl - 1 && indy >= 0 && indy < yl - 1 && indz >= 0 && indz < zl - 1){
-		// scale coordinates to unit cube
-		double xu = (x - x_mi - indx*xdist)/xdist;
-		double yu = (y - y_mi - indy*ydist)/ydist;
-		double zu = (z - z_mi - indz*zdist)/zdist;
-		int i3 = INDEX_3D(indx, indy, indz, xl-1, yl-1, zl-1);
-		double Bres[4][4];
+	double T[3][3], Bparity;
+	bool symmetric = Bscale != 0 && Symmetrize(x, y, z, T, Bparity);
+	int cell;
+	double u[3], h[3];
+	if (Bscale != 0 && FindCell(x, y, z, cell, u, h)){
+		double xu = u[0], yu = u[1], zu = u[2];
+		double *coeff;
+		bool derivatives = (request & BFIELD_DERIVATIVES) != 0;
+		double Bres[4][4] = {{0,0,0,0},{0,0,0,0},{0,0,0,0},{0,0,0,0}};
 		// tricubic interpolation
-		if (Bxc.size() > 0){
-			Bres[0][0] = Bscale*tricubic_eval(&Bxc[i3][0], xu, yu, zu);
-			Bres[0][1] = Bscale*tricubic_eval(&Bxc[i3][0], xu, yu, zu, 1, 0, 0)/xdist;
-			Bres[0][2] = Bscale*tricubic_eval(&Bxc[i3][0], xu, yu, zu, 0, 1, 0)/ydist;
-			Bres[0][3] = Bscale*tricubic_eval(&Bxc[i3][0], xu, yu, zu, 0, 0, 1)/zdist;
+		if ((coeff = Coefficients(0, cell))){
+			Bres[0][0] = Bscale*tricubic_eval(coeff, xu, yu, zu);
+			if (derivatives){
+				Bres[0][1] = Bscale*tricubic_eval(coeff, xu, yu, zu, 1, 0, 0)/h[0];
+				Bres[0][2] = Bscale*tricubic_eval(coeff, xu, yu, zu, 0, 1, 0)/h[1];
+				Bres[0][3] = Bscale*tricubic_eval(coeff, xu, yu, zu, 0, 0, 1)/h[2];
+			}
 		}
-		if (Byc.size() > 0){
-			Bres[1][0] = Bscale*tricubic_eval(&Byc[i3][0], xu, yu, zu);
-			Bres[1][1] = Bscale*tricubic_eval(&Byc[i3][0], xu, yu, zu, 1, 0, 0)/xdist;
-			Bres[1][2] = Bscale*tricubic_eval(&Byc[i3][0], xu, yu, zu, 0, 1, 0)/ydist;
-			Bres[1][3] = Bscale*tricubic_eval(&Byc[i3][0], xu, yu, zu, 0, 0, 1)/zdist;
+		if ((coeff = Coefficients(1, cell))){
+			Bres[1][0] = Bscale*tricubic_eval(coeff, xu, yu, zu);
+			if (derivatives){
+				Bres[1][1] = Bscale*tricubic_eval(coeff, xu, yu, zu, 1, 0, 0)/h[0];
+				Bres[1][2] = Bscale*tricubic_eval(coeff, xu, yu, zu, 0, 1, 0)/h[1];
+				Bres[1][3] = Bscale*tricubic_eval(coeff, xu, yu, zu, 0, 0, 1)/h[2];
+			}
 		}
-		if (Bzc.size() > 0){
-			Bres[2][0] = Bscale*tricubic_eval(&Bzc[i3][0], xu, yu, zu);
-			Bres[2][1] = Bscale*tricubic_eval(&Bzc[i3][0], xu, yu, zu, 1, 0, 0)/xdist;
-			Bres[2][2] = Bscale*tricubic_eval(&Bzc[i3][0], xu, yu, zu, 0, 1, 0)/ydist;
-			Bres[2][3] = Bscale*tricubic_eval(&Bzc[i3][0], xu, yu, zu, 0, 0, 1)/zdist;
+		if ((coeff = Coefficients(2, cell))){
+			Bres[2][0] = Bscale*tricubic_eval(coeff, xu, yu, zu);
+			if (derivatives){
+				Bres[2][1] = Bscale*tricubic_eval(coeff, xu, yu, zu, 1, 0, 0)/h[0];
+				Bres[2][2] = Bscale*tricubic_eval(coeff, xu, yu, zu, 0, 1, 0)/h[1];
+				Bres[2][3] = Bscale*tricubic_eval(coeff, xu, yu, zu, 0, 0, 1)/h[2];
+			}
 		}
 
 		for (int i = 0; i < 3; i++)
 			FieldSmthr(x, y, z, Bres[i][0], &Bres[i][1]); // apply field smoothing to each component
 
+		if (symmetric){ // transform field back to original point: B = Bparity T^T B(Tp), dB/dp = Bparity T^T dB/dp(Tp) T
+			double Bsym[3][4] = {{0,0,0,0},{0,0,0,0},{0,0,0,0}};
+			for (int i = 0; i < 3; i++){
+				for (int j = 0; j < 3; j++){
+					Bsym[i][0] += T[j][i]*Bres[j][0];
+					if (derivatives)
+						for (int k = 0; k < 3; k++)
+							for (int l = 0; l < 3; l++)
+								Bsym[i][k+1] += T[j][i]*Bres[j][l+1]*T[l][k];
+				}
+			}
+			for (int i = 0; i < 3; i++)
+				for (int j = 0; j < 4; j++)
+					Bres[i][j] = Bparity*Bsym[i][j];
+		}
+
 		for (int i = 0; i < 3; i++){
-			for (int j = 0; j < 4; j++)
-				B[i][j] += Bres[i][j];
+			B[i][0] += Bres[i][0];
+			if (derivatives)
+				for (int j = 1; j < 4; j++)
+					B[i][j] += Bres[i][j];
 		}
 	}
 }
@@ -481,15 +775,15 @@ void TabField3::FieldSmthr(double x, double y, double z, double &F, double dFdxi
 			dFadd[2] = -F*SmthrStpDer(dzhi)/BoundaryWidth/SmthrStp(dzhi);
 		}
 
-		if (dxlo < 1){ // if point in lower x boundary
+		if (dxlo < 1 && !SymmetryPlaneFace[0]){ // if point in lower x boundary, unless it lies on a symmetry plane
 			Fscale *= SmthrStp(dxlo);
 			dFadd[0] = F*SmthrStpDer(dxlo)/BoundaryWidth/SmthrStp(dxlo);
 		}
-		if (dylo < 1){ // if point in lower y boundary
+		if (dylo < 1 && !SymmetryPlaneFace[1]){ // if point in lower y boundary
 			Fscale *= SmthrStp(dylo);
 			dFadd[1] = F*SmthrStpDer(dylo)/BoundaryWidth/SmthrStp(dylo);
 		}
-		if (dzlo < 1){ // if point in lower z boundary
+		if (dzlo < 1 && !SymmetryPlaneFace[2]){ // if point in lower z boundary
 			Fscale *= SmthrStp(dzlo);
 			dFadd[2] = F*SmthrStpDer(dzlo)/BoundaryWidth/SmthrStp(dzlo);
 		}
@@ -512,24 +806,74 @@ double TabField3::SmthrStpDer(double x) {
 	return 30*pow(x, 4) - 60*pow(x, 3) + 30*pow(x,2);
 }
 
+bool TabField3::Symmetrize(double &x, double &y, double &z, double T[3][3], double &Bparity){
+	if (RotationFold <= 1 && !Mirror[0] && !Mirror[1] && !Mirror[2])
+		return false;
+	for (int i = 0; i < 3; i++)
+		for (int j = 0; j < 3; j++)
+			T[i][j] = (i == j);
+	Bparity = 1;
+
+	if (RotationFold > 1){
+		double alpha = 2*pi/RotationFold;
+		double k = floor(atan2(y, x)/alpha); // rotate point by -k*alpha into sector 0..alpha
+		if (k != 0){
+			double c = cos(k*alpha), s = sin(k*alpha);
+			double xr = c*x + s*y;
+			y = -s*x + c*y;
+			x = xr;
+			T[0][0] = c;	T[0][1] = s;
+			T[1][0] = -s;	T[1][1] = c;
+		}
+	}
+
+	double *p[3] = {&x, &y, &z};
+	for (int i = 0; i < 3; i++){
+		if (Mirror[i] && *p[i] < 0){ // mirror point to positive side
+			*p[i] = -*p[i];
+			for (int j = 0; j < 3; j++)
+				T[i][j] = -T[i][j];
+			if (AxialMirror[i])
+				Bparity = -Bparity;
+		}
+	}
+	return true;
+}
+
+
 void TabField3::EField(double x, double y, double z, double t, double &V, double Ei[3]){
-	if (Vc.size() > 0 &&
-		(x - x_mi)/xdist > 0 && (x - x_mi - xl*xdist)/xdist < 0 &&
-		(y - y_mi)/ydist > 0 && (y - y_mi - yl*ydist)/ydist < 0 &&
-		(z - z_mi)/zdist > 0 && (z - z_mi - zl*zdist)/zdist < 0){
-		// get coordinate index
-		int indx = (int)floor((x - x_mi)/xdist);
-		int indy = (int)floor((y - y_mi)/ydist);
-		int indz = (int)floor((z - z_mi)/zdist);
-		// scale coordinates to unit cube
-		x = (x - x_mi - indx*xdist)/xdist;
-		y = (y - y_mi - indy*ydist)/ydist;
-		z = (z - z_mi - indz*zdist)/zdist;
-		int i3 = INDEX_3D(indx, indy, indz, xl-1, yl-1, zl-1);
-		// tricubic interpolation
-		V += tricubic_eval(&Vc[i3][0], x, y, z);
-		Ei[0] += -tricubic_eval(&Vc[i3][0], x, y, z, 1, 0, 0)/xdist;
-		Ei[1] += -tricubic_eval(&Vc[i3][0], x, y, z, 0, 1, 0)/ydist;
-		Ei[2] += -tricubic_eval(&Vc[i3][0], x, y, z, 0, 0, 1)/zdist;
+	double T[3][3], Bparity;
+	bool symmetric = Symmetrize(x, y, z, T, Bparity);
+	int cell;
+	double u[3], h[3];
+	if (FindCell(x, y, z, cell, u, h)){
+		double *coeff = Coefficients(3, cell);
+		if (coeff){
+			// tricubic interpolation
+			V += tricubic_eval(coeff, u[0], u[1], u[2]);
+			double E[3] = {-tricubic_eval(coeff, u[0], u[1], u[2], 1, 0, 0)/h[0],
+							-tricubic_eval(coeff, u[0], u[1], u[2], 0, 1, 0)/h[1],
+							-tricubic_eval(coeff, u[0], u[1], u[2], 0, 0, 1)/h[2]};
+			for (int i = 0; i < 3; i++){
+				if (symmetric) // transform field back to original point: E = T^T E(Tp)
+					for (int j = 0; j < 3; j++)
+						Ei[i] += T[j][i]*E[j];
+				else
+					Ei[i] += E[i];
+			}
+		}
+	}
+}
+
+
+void TabField3::Replicate(){
+	std::vector<std::vector<double> > *coeffs[4] = {&Bxc, &Byc, &Bzc, &Vc};
+	for (int i = 0; i < 4; i++){
+		std::vector<std::vector<double> > copy(*coeffs[i]);
+		coeffs[i]->swap(copy); // old coefficients are freed when copy goes out of scope
+		std::vector<std::vector<double> > tabcopy(Tabs[i]);
+		Tabs[i].swap(tabcopy);
 	}
+	if (CacheSlots > 0)
+		ClearCache(); // coefficients are calculated again in new memory when needed
 }
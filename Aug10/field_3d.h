@@ -8,6 +8,8 @@
 
 #include <vector>
 
+#include <pthread.h>
+
 #include "field.h"
 
 /**
@@ -16,9 +18,16 @@
  * This class loads a special file format from "Vectorfields Opera" containing a regular, cuboid table of magnetic and electric fields and
  * calculates tricubic interpolation coefficients (4x4x4 = 64 for each grid point) to allow fast evaluation of the fields at arbitrary points.
  *
+ * If a cache size is given, only the table values and their derivatives are kept and the coefficients of a grid cell are calculated when a particle first enters it.
+ * The coefficients of at most the cache size worth of cells are kept, a cell that was not used recently is dropped when the cache is full (clock algorithm).
+ * The cache is shared by all threads evaluating the field, a cell stays cached while a thread is evaluating it.
+ * Cached cells are found without locking, only loading and dropping cells takes a mutex.
+ *
+ * If the field has mirror or rotational symmetries, the table only has to contain the part of space left after applying them.
+ * Evaluation points are mapped into this part and the field and its derivatives are transformed back.
  */
 class TabField3: public TField{
-	private:
+	protected:
 		int xl; ///< size of the table in x direction
 		int yl; ///< size of the table in y direction
 		int zl; ///< size of the table in z direction
@@ -32,11 +41,41 @@ class TabField3: public TField{
 		std::vector<std::vector<double> > Byc; ///< interpolation coefficients for magnetic y component
 		std::vector<std::vector<double> > Bzc; ///< interpolation coefficients for magnetic z component
 		std::vector<std::vector<double> > Vc; ///< interpolation coefficients for electric potential
+		std::vector<std::vector<double> > Tabs[4]; ///< if coefficients are calculated on demand: values and derivatives (see TabField3::CalcDerivs) of Bx, By, Bz and V at grid points
+		int ColumnOffset[4]; ///< offset of Bx, By, Bz and V coefficients in the coefficients of a cell calculated on demand, -1 if column does not exist
+		int CellSize; ///< number of coefficients calculated on demand for each cell (64 for each column)
+		int CacheSlots; ///< max. number of cells (or bricks of cells in derived classes) whose coefficients are kept in the cache shared by all threads, 0 if all coefficients are precalculated
+		int CacheItems; ///< number of cells (or bricks) which can be cached
+		int SlotSize; ///< number of coefficients stored for each cached cell (or brick), TabField3::CellSize or size of a brick
+
+		/**
+		 * State of one thread using the coefficient cache
+		 */
+		struct TCacheThread{
+			int Item; ///< cell (or brick) the thread is evaluating, it is not dropped from the cache until the thread moves to another one, -1 if none
+			double *Coeffs; ///< coefficients of TCacheThread::Item
+			int LastItem; ///< cell (or brick) evaluated last, maintained by derived classes which prefetch neighbouring items, -1 if none
+			TabField3 *Field; ///< field whose cache the thread uses, needed by TabField3::ReleaseThreadCache
+		};
+		std::vector<double*> ItemCoeffs; ///< coefficients of each cell (or brick), NULL if not cached, read by all threads without locking and only changed with TabField3::CacheMutex held
+		std::vector<char> ItemReferenced; ///< cell (or brick) was used since the clock hand last passed its slot, set by all threads without locking
+		std::vector<int> ItemSlot; ///< cache slot containing coefficients of each cell (or brick), -1 if they are not cached
+		std::vector<int> SlotItem; ///< cell (or brick) whose coefficients are stored in each cache slot, -1 if slot is being loaded or free
+		std::vector<double*> SlotCoeffs; ///< coefficients stored in each cache slot, allocated separately so pointers published in TabField3::ItemCoeffs stay valid
+		std::vector<int> FreeSlots; ///< allocated cache slots which are not used
+		int ClockHand; ///< next cache slot checked for an item to drop
+		pthread_key_t CacheKey; ///< TCacheThread of current thread
+		std::vector<TCacheThread*> CacheThreads; ///< states of all threads using the cache
+		pthread_mutex_t CacheMutex; ///< mutex protecting cache slots, TabField3::ItemSlot and TabField3::CacheThreads
 		double NullFieldTime; ///< Time before magnetic field is ramped (passed by constructor)
 		double RampUpTime; ///< field is ramped linearly from 0 to 100% in this time (passed by constructor)
 		double FullFieldTime; ///< Time the field stays at 100% (passed by constructor)
 		double RampDownTime; ///< field is ramped down linearly from 100% to 0 in this time (passed by constructor)
 		double BoundaryWidth; ///< if this is larger 0, the field will be smoothly reduced to 0 in this boundary around the tabulated field cuboid
+		bool Mirror[3]; ///< field is mirror symmetric to the yz-, xz- or xy-plane, table only contains positive x, y or z
+		bool AxialMirror[3]; ///< magnetic field transforms like an axial vector under TabField3::Mirror (B(p) = -T^-1 B(Tp), currents symmetric to the plane), otherwise like a polar vector (B(p) = T^-1 B(Tp), currents antisymmetric to the plane)
+		int RotationFold; ///< field has RotationFold-fold rotational symmetry around z axis, table only contains azimuths between 0 and 360/RotationFold degrees
+		bool SymmetryPlaneFace[3]; ///< lower x, y or z face of the table lies on or beyond a symmetry plane, which symmetrized points never cross, so the field is not smoothed there
 
 		/**
 		 * Reads an Opera table file.
@@ -83,10 +122,31 @@ class TabField3: public TField{
 						std::vector<double> &Tab12, std::vector<double> &Tab13, std::vector<double> &Tab23, std::vector<double> &Tab123);
 
 
+		/**
+		 * Calculate derivatives of a table column with TabField3::CalcDerivs
+		 *
+		 * @param Tab Table column, is moved into Tabs[0] and left empty
+		 * @param Tabs Returns table column and its seven derivatives in the order of TabField3::CalcDerivs
+		 */
+		void CalcDerivs(std::vector<double> &Tab, std::vector<std::vector<double> > &Tabs);
+
+
+		/**
+		 * Calculate tricubic interpolation coefficients of a single grid cell with ::tricubic_get_coeff
+		 *
+		 * @param coeff Returns 64 coefficients
+		 * @param Tabs Table column and its derivatives returned by TabField3::CalcDerivs
+		 * @param indx x index of cell
+		 * @param indy y index of cell
+		 * @param indz z index of cell
+		 */
+		void CalcCellCoeff(double coeff[64], const std::vector<std::vector<double> > &Tabs, int indx, int indy, int indz);
+
+
 		/**
 		 * Calculate tricubic interpolation coefficients for a table column
 		 *
-		 * Calls TabField3::CalcDerivs and determines the interpolation coefficients with ::tricubic_get_coeff
+		 * Calls TabField3::CalcDerivs and determines the interpolation coefficients of all cells with TabField3::CalcCellCoeff
 		 *
 		 * @param coeff Returns coefficients
 		 * @param Tab Table column
@@ -94,6 +154,102 @@ class TabField3: public TField{
 		void PreInterpol(std::vector<std::vector<double> > &coeff, std::vector<double> &Tab);
 
 
+		/**
+		 * Enable caching of coefficients calculated (or loaded) on demand.
+		 *
+		 * @param items Sets TabField3::CacheItems
+		 * @param slots Sets TabField3::CacheSlots
+		 * @param slotsize Sets TabField3::SlotSize
+		 */
+		void InitCache(int items, int slots, int slotsize);
+
+
+		/**
+		 * Get cache state of the calling thread, creates it if necessary
+		 *
+		 * @return Returns reference to cache state
+		 */
+		TCacheThread& ThreadCache();
+
+
+		/**
+		 * Remove cache state of a thread when it exits, so its last item can be dropped and it is no longer checked by TabField3::AcquireSlot
+		 *
+		 * Destructor of TabField3::CacheKey.
+		 *
+		 * @param thread TCacheThread of exiting thread
+		 */
+		static void ReleaseThreadCache(void *thread);
+
+
+		/**
+		 * Get coefficients of a cell (or brick) from the cache shared by all threads and mark it as referenced.
+		 *
+		 * If the item is cached, its coefficients are returned without locking.
+		 * Otherwise a free slot or the slot of an item, which was not referenced recently and which no other thread is evaluating, is filled by TabField3::LoadItem.
+		 * The item stays in the cache until the calling thread requests another one.
+		 * If all slots are used by other threads, a slot is added beyond TabField3::CacheSlots.
+		 *
+		 * @param item Index of cell (or brick)
+		 *
+		 * @return Returns pointer to TabField3::SlotSize coefficients
+		 */
+		double* CachedItem(int item);
+
+
+		/**
+		 * Get an unused cache slot, called with TabField3::CacheMutex held by TabField3::CachedItem
+		 *
+		 * Slots are checked in turn by the clock hand: the referenced mark of an item is cleared when the hand passes it, an item which is still unmarked on the next pass is dropped.
+		 *
+		 * @return Returns index of slot, which contains no item and is not in TabField3::FreeSlots
+		 */
+		int AcquireSlot();
+
+
+		/**
+		 * Calculate coefficients of a cell which is not cached.
+		 *
+		 * @param item Index of cell (or brick in derived classes)
+		 * @param coeffs Returns TabField3::SlotSize coefficients
+		 */
+		virtual void LoadItem(int item, double *coeffs);
+
+
+		/**
+		 * Drop all cached coefficients and reset the cache states of all threads
+		 */
+		void ClearCache();
+
+
+		/**
+		 * Find interpolation cell containing a point.
+		 *
+		 * @param x x coordinate
+		 * @param y y coordinate
+		 * @param z z coordinate
+		 * @param cell Returns index of cell
+		 * @param u Returns coordinates of point in the cell, scaled to unit cube
+		 * @param h Returns edge lengths of cell
+		 *
+		 * @return Returns false if point is outside of table
+		 */
+		virtual bool FindCell(double x, double y, double z, int &cell, double u[3], double h[3]);
+
+
+		/**
+		 * Get interpolation coefficients of a grid cell.
+		 *
+		 * If coefficients are calculated on demand, they are taken from the cache with TabField3::CachedItem.
+		 *
+		 * @param column Table column (0 = Bx, 1 = By, 2 = Bz, 3 = V)
+		 * @param cell Index of cell returned by TabField3::FindCell
+		 *
+		 * @return Returns pointer to 64 coefficients, NULL if table does not contain this column
+		 */
+		virtual double* Coefficients(int column, int cell);
+
+
 		/**
 		 * Get magnetic field scale factor for a specific time.
 		 *
@@ -111,6 +267,7 @@ class TabField3: public TField{
 		 *
 		 * If coordinates are within BoundaryWidth of the edges of the tabulated field,
 		 * the field and its derivatives are scaled by the SmthrStp and SmthrStpDer functions.
+		 * Edges in TabField3::SymmetryPlaneFace are skipped.
 		 *
 		 * @param x x coordinate
 		 * @param y y coordinate
@@ -137,11 +294,38 @@ class TabField3: public TField{
 		 * @return Returns derivative of SmthrStp at parameter x
 		 */
 		double SmthrStpDer(double x);
+
+		/**
+		 * Map a point into the part of space contained in the table using the symmetries TabField3::RotationFold and TabField3::Mirror.
+		 *
+		 * The field at the original point p is given by F(p) = T^-1 F(Tp) and its derivatives by dF/dp(p) = T^-1 dF/dp(Tp) T.
+		 * The magnetic field additionally has to be multiplied by Bparity.
+		 *
+		 * @param x x coordinate, returns mapped x coordinate
+		 * @param y y coordinate, returns mapped y coordinate
+		 * @param z z coordinate, returns mapped z coordinate
+		 * @param T Returns orthogonal transformation matrix which maps the point
+		 * @param Bparity Returns -1 if the point was mirrored an odd number of times at planes in TabField3::AxialMirror, 1 otherwise
+		 *
+		 * @return Returns false if table has no symmetries, T and Bparity are not set in this case
+		 */
+		bool Symmetrize(double &x, double &y, double &z, double T[3][3], double &Bparity);
+
+		/**
+		 * Constructor for derived classes, which read and interpolate the table themselves.
+		 *
+		 * @param aNullFieldTime Sets TabField3::NullFieldTime
+		 * @param aRampUpTime Sets TabField3::RampUpTime
+		 * @param aFullFieldTime Sets TabField3::FullFieldTime
+		 * @param aRampDownTime Sets TabField3::RampDownTime
+		 * @param aBoundaryWidth Sets TabField3::BoundaryWidth
+		 */
+		TabField3(double aNullFieldTime, double aRampUpTime, double aFullFieldTime, double aRampDownTime, double aBoundaryWidth);
 	public:
 		/**
 		 * Constructor.
 		 *
-		 * Calls TabField3::ReadTabFile, TabField3::CheckTab and for each column TabField3::PreInterpol
+		 * Calls TabField3::ReadTabFile, TabField3::CheckTab and for each column TabField3::PreInterpol (or TabField3::CalcDerivs if coefficients are calculated on demand)
 		 *
 		 * @param tabfile Path of table file
 		 * @param Bscale Magnetic field is always scaled by this factor
@@ -151,9 +335,18 @@ class TabField3: public TField{
 		 * @param aFullFieldTime Sets TabField3::FullFieldTime
 		 * @param aRampDownTime Sets TabField3::RampDownTime
 		 * @param aBoundaryWidth Sets TabField3::BoundaryWidth
+		 * @param CacheSize If larger than 0, coefficients are calculated on demand and at most CacheSize MB of them are cached
+		 * @param Symmetry Combination of x, y, z (mirror symmetry to yz-, xz-, xy-plane with B polar), X, Y, Z (same with B axial, see TabField3::AxialMirror) and rN (N-fold rotational symmetry around z axis), e.g. "xyZ" or "r4"
 		 */
 		TabField3(const char *tabfile, double Bscale, double Escale,
-				double aNullFieldTime, double aRampUpTime, double aFullFieldTime, double aRampDownTime, double aBoundaryWidth);
+				double aNullFieldTime, double aRampUpTime, double aFullFieldTime, double aRampDownTime, double aBoundaryWidth,
+				double CacheSize = 0, const char *Symmetry = "");
+
+
+		/**
+		 * Destructor, deletes cached coefficients and cache states of all threads
+		 */
+		~TabField3();
 
 
 		/**
@@ -167,8 +360,9 @@ class TabField3: public TField{
 		 * @param z Z coordinate where the field shall be evaluated
 		 * @param t Time
 		 * @param B Returns magnetic field components B[0..2][0], their derivatives B[0..2][1..3], the absolute value B[3][0] and its derivatives B[3][1..3]
+		 * @param request Combination of BFIELD_VALUE and BFIELD_DERIVATIVES, derivative polynoms are only evaluated if requested
 		 */
-		void BField(double x, double y, double z, double t, double B[4][4]);
+		void BField(double x, double y, double z, double t, double B[4][4], int request);
 
 
 		/**
@@ -185,6 +379,12 @@ class TabField3: public TField{
 		 * @param Ei Returns electric field (negative spatial derivatives of V)
 		 */
 		void EField(double x, double y, double z, double t, double &V, double Ei[3]);
+
+
+		/**
+		 * Copy interpolation coefficients and tables into newly allocated memory, see TField::Replicate.
+		 */
+		void Replicate();
 };
 
 #endif // FIELD_3D_H_
@@ -0,0 +1,225 @@
+/**
+ * \file
+ * Tricubic interpolation of 3D field tables on adaptively refined cells.
+ */
+
+#include <iostream>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+#include "field_octree.h"
+#include "tricubic.h"
+
+using namespace std;
+
+int INDEX_3D(int xi, int yi, int zi, int xsize, int ysize, int zsize); // defined in field_3d.cpp
+
+
+void TabField3Octree::LeafCoeff(double coeff[64], double data[8][8], int size){
+	double h[3] = {size*xdist, size*ydist, size*zdist};
+	double yyy[8], yyy1[8], yyy2[8], yyy3[8], yyy12[8], yyy13[8], yyy23[8], yyy123[8];
+	for (int i = 0; i < 8; i++){
+		yyy[i]    = data[i][0];
+		yyy1[i]   = data[i][1]*h[0];
+		yyy2[i]   = data[i][2]*h[1];
+		yyy3[i]   = data[i][3]*h[2];
+		yyy12[i]  = data[i][4]*h[0]*h[1];
+		yyy13[i]  = data[i][5]*h[0]*h[2];
+		yyy23[i]  = data[i][6]*h[1]*h[2];
+		yyy123[i] = data[i][7]*h[0]*h[1]*h[2];
+	}
+	tricubic_get_coeff(coeff, yyy, yyy1, yyy2, yyy3, yyy12, yyy13, yyy23, yyy123);
+}
+
+
+void TabField3Octree::NodeData(vector<vector<double> > &Tabs, int column, int x, int y, int z, int size, double data[8]){
+	int best = -1;
+	for (int i = 0; i < 8; i++){ // check the eight cells around the grid point
+		int cx = x - 1 + (i & 1), cy = y - 1 + ((i >> 1) & 1), cz = z - 1 + ((i >> 2) & 1);
+		if (cx < 0 || cx >= xl - 1 || cy < 0 || cy >= yl - 1 || cz < 0 || cz >= zl - 1)
+			continue;
+		int leaf = Locate(cx, cy, cz);
+		const TOctreeLeaf &L = Leaves[leaf];
+		if (L.size > size && ((x - L.x) % L.size != 0 || (y - L.y) % L.size != 0 || (z - L.z) % L.size != 0) // point lies on face or edge of larger cell
+				&& (best < 0 || L.size > Leaves[best].size))
+			best = leaf;
+	}
+
+	if (best < 0){ // point is corner of all neighbouring cells, use table values
+		int i3 = INDEX_3D(x, y, z, xl, yl, zl);
+		for (int k = 0; k < 8; k++)
+			data[k] = Tabs[k][i3];
+		return;
+	}
+
+	const TOctreeLeaf &L = Leaves[best];
+	double *coeff = &LeafCoeffs[best*CellSize + ColumnOffset[column]];
+	double u = double(x - L.x)/L.size, v = double(y - L.y)/L.size, w = double(z - L.z)/L.size;
+	double h[3] = {L.size*xdist, L.size*ydist, L.size*zdist};
+	data[0] = tricubic_eval(coeff, u, v, w);
+	data[1] = tricubic_eval(coeff, u, v, w, 1, 0, 0)/h[0];
+	data[2] = tricubic_eval(coeff, u, v, w, 0, 1, 0)/h[1];
+	data[3] = tricubic_eval(coeff, u, v, w, 0, 0, 1)/h[2];
+	data[4] = tricubic_eval(coeff, u, v, w, 1, 1, 0)/h[0]/h[1];
+	data[5] = tricubic_eval(coeff, u, v, w, 1, 0, 1)/h[0]/h[2];
+	data[6] = tricubic_eval(coeff, u, v, w, 0, 1, 1)/h[1]/h[2];
+	data[7] = tricubic_eval(coeff, u, v, w, 1, 1, 1)/h[0]/h[1]/h[2];
+}
+
+
+void TabField3Octree::Build(int node, int x, int y, int z, int size, vector<vector<double> > Tabs[4], double maxval[4]){
+	if (x >= xl - 1 || y >= yl - 1 || z >= zl - 1)
+		return; // node is completely outside of table
+	bool refine = x + size > xl - 1 || y + size > yl - 1 || z + size > zl - 1; // always refine nodes reaching beyond the table
+	for (int c = 0; c < 4 && !refine && size > 1; c++){
+		if (Tabs[c].empty())
+			continue;
+		// interpolate node from its corners and compare to all table values in it
+		double coeff[64], data[8][8];
+		for (int i = 0; i < 8; i++){
+			int i3 = INDEX_3D(x + (i & 1)*size, y + ((i >> 1) & 1)*size, z + ((i >> 2) & 1)*size, xl, yl, zl);
+			for (int k = 0; k < 8; k++)
+				data[i][k] = Tabs[c][k][i3];
+		}
+		LeafCoeff(coeff, data, size);
+		for (int i = 0; i <= size && !refine; i++){
+			for (int j = 0; j <= size && !refine; j++){
+				for (int k = 0; k <= size && !refine; k++){
+					double F = tricubic_eval(coeff, double(i)/size, double(j)/size, double(k)/size);
+					if (fabs(F - Tabs[c][0][INDEX_3D(x + i, y + j, z + k, xl, yl, zl)]) > Tolerance*maxval[c])
+						refine = true;
+				}
+			}
+		}
+	}
+
+	if (!refine || size == 1){
+		TOctreeLeaf leaf = {x, y, z, size};
+		Nodes[node] = -(int)Leaves.size() - 1;
+		Leaves.push_back(leaf);
+	}
+	else{
+		int children = Nodes.size();
+		Nodes.resize(children + 8, 0);
+		Nodes[node] = children;
+		size /= 2;
+		for (int i = 0; i < 8; i++) // children in Morton order
+			Build(children + i, x + (i & 1)*size, y + ((i >> 1) & 1)*size, z + ((i >> 2) & 1)*size, size, Tabs, maxval);
+	}
+}
+
+
+int TabField3Octree::Locate(int x, int y, int z){
+	int size = BlockSize;
+	int node = Nodes[INDEX_3D(x/size, y/size, z/size, xblocks, yblocks, zblocks)];
+	while (node > 0){
+		size /= 2;
+		node = Nodes[node + ((x/size) & 1) + 2*((y/size) & 1) + 4*((z/size) & 1)];
+	}
+	return -node - 1;
+}
+
+
+bool TabField3Octree::FindCell(double x, double y, double z, int &cell, double u[3], double h[3]){
+	// get coordinate index
+	int indx = (int)floor((x - x_mi)/xdist);
+	int indy = (int)floor((y - y_mi)/ydist);
+	int indz = (int)floor((z - z_mi)/zdist);
+	if (indx < 0 || indx >= xl - 1 || indy < 0 || indy >= yl - 1 || indz < 0 || indz >= zl - 1)
+		return false;
+	cell = Locate(indx, indy, indz);
+	const TOctreeLeaf &L = Leaves[cell];
+	// scale coordinates to unit cube
+	h[0] = L.size*xdist;
+	h[1] = L.size*ydist;
+	h[2] = L.size*zdist;
+	u[0] = (x - x_mi - L.x*xdist)/h[0];
+	u[1] = (y - y_mi - L.y*ydist)/h[1];
+	u[2] = (z - z_mi - L.z*zdist)/h[2];
+	return true;
+}
+
+
+double* TabField3Octree::Coefficients(int column, int cell){
+	if (ColumnOffset[column] < 0)
+		return NULL;
+	return &LeafCoeffs[cell*CellSize + ColumnOffset[column]];
+}
+
+
+TabField3Octree::TabField3Octree(const char *tabfile, double Bscale, double Escale,
+		double aNullFieldTime, double aRampUpTime, double aFullFieldTime, double aRampDownTime, double aBoundaryWidth,
+		double aTolerance, int Levels): TabField3(aNullFieldTime, aRampUpTime, aFullFieldTime, aRampDownTime, aBoundaryWidth){
+	Tolerance = aTolerance;
+	if (Levels < 0 || Levels > 16){
+		printf("Invalid number of octree levels %i for %s! Exiting...\n", Levels, tabfile);
+		exit(-1);
+	}
+
+	vector<double> BxTab, ByTab, BzTab;	// Bx/By/Bz values
+	vector<double> VTab; // potential values
+	ReadTabFile(tabfile,Bscale,Escale,BxTab,ByTab,BzTab,VTab); // open tabfile and read values into arrays
+
+	CheckTab(BxTab,ByTab,BzTab,VTab); // print some info
+
+	printf("Calculating derivatives ... ");
+	vector<double> *columns[4] = {&BxTab, &ByTab, &BzTab, &VTab};
+	const char *names[4] = {"Bx", "By", "Bz", "V"};
+	vector<vector<double> > Tabs[4];
+	double maxval[4] = {0, 0, 0, 0};
+	for (int i = 0; i < 4; i++){
+		if (columns[i]->size() > 0){
+			printf("%s ... ", names[i]);
+			fflush(stdout);
+			for (vector<double>::iterator v = columns[i]->begin(); v != columns[i]->end(); v++)
+				maxval[i] = max(maxval[i], fabs(*v));
+			CalcDerivs(*columns[i], Tabs[i]);
+			ColumnOffset[i] = CellSize;
+			CellSize += 64;
+		}
+	}
+
+	printf("Building octree ... ");
+	fflush(stdout);
+	BlockSize = 1 << Levels;
+	xblocks = (xl - 2)/BlockSize + 1;
+	yblocks = (yl - 2)/BlockSize + 1;
+	zblocks = (zl - 2)/BlockSize + 1;
+	Nodes.assign(xblocks*yblocks*zblocks, 0);
+	for (int bz = 0; bz < zblocks; bz++){
+		for (int by = 0; by < yblocks; by++){
+			for (int bx = 0; bx < xblocks; bx++)
+				Build(INDEX_3D(bx, by, bz, xblocks, yblocks, zblocks), bx*BlockSize, by*BlockSize, bz*BlockSize, BlockSize, Tabs, maxval);
+		}
+	}
+
+	// calculate coefficients of largest cells first, grid points on their faces and edges are then interpolated for smaller neighbouring cells
+	LeafCoeffs.resize(Leaves.size()*CellSize);
+	for (int size = BlockSize; size >= 1; size /= 2){
+		for (unsigned int l = 0; l < Leaves.size(); l++){
+			const TOctreeLeaf &L = Leaves[l];
+			if (L.size != size)
+				continue;
+			for (int c = 0; c < 4; c++){
+				if (ColumnOffset[c] < 0)
+					continue;
+				double data[8][8];
+				for (int i = 0; i < 8; i++)
+					NodeData(Tabs[c], c, L.x + (i & 1)*size, L.y + ((i >> 1) & 1)*size, L.z + ((i >> 2) & 1)*size, size, data[i]);
+				LeafCoeff(&LeafCoeffs[l*CellSize + ColumnOffset[c]], data, size);
+			}
+		}
+	}
+	printf("Done (%u cells instead of %i, %.f MB)\n", (unsigned int)Leaves.size(), (xl-1)*(yl-1)*(zl-1), LeafCoeffs.size()*sizeof(double)/1024./1024.);
+}
+
+
+void TabField3Octree::Replicate(){
+	vector<int> nodes(Nodes);
+	Nodes.swap(nodes);
+	vector<TOctreeLeaf> leaves(Leaves);
+	Leaves.swap(leaves);
+	vector<double> coeffs(LeafCoeffs);
+	LeafCoeffs.swap(coeffs); // old coefficients are freed when copy goes out of scope
+}
@@ -0,0 +1,123 @@
+/**
+ * \file
+ * Tricubic interpolation of 3D field tables on adaptively refined cells.
+ */
+
+#ifndef FIELD_OCTREE_H_
+#define FIELD_OCTREE_H_
+
+#include <vector>
+
+#include "field_3d.h"
+
+/**
+ * Class for tricubic field interpolation on an octree of cells with different sizes.
+ *
+ * Reads a fine table in the same format as TabField3 and divides it into cubic blocks of 2^Levels x 2^Levels x 2^Levels grid cells.
+ * Each block is recursively divided into eight octants until the tricubic interpolation of an octant reproduces all table values in it within a tolerance.
+ * Smooth regions are covered by few large cells, regions with steep gradients keep the resolution of the table.
+ *
+ * Values at grid points on the faces and edges of a larger neighbouring cell are replaced by the interpolation of that cell,
+ * so the interpolated field and its derivatives are continuous across boundaries between cells of different size.
+ */
+class TabField3Octree: public TabField3{
+	private:
+		/**
+		 * Octree leaf, cell with its own interpolation coefficients
+		 */
+		struct TOctreeLeaf{
+			int x; ///< x index of lower corner in table grid
+			int y; ///< y index of lower corner in table grid
+			int z; ///< z index of lower corner in table grid
+			int size; ///< edge length in table grid cells
+		};
+
+		int BlockSize; ///< edge length of top-level blocks in table grid cells
+		int xblocks; ///< number of top-level blocks in x direction
+		int yblocks; ///< number of top-level blocks in y direction
+		int zblocks; ///< number of top-level blocks in z direction
+		double Tolerance; ///< max. interpolation error of a cell, relative to largest absolute value in each table column
+		std::vector<int> Nodes; ///< octree nodes, starting with one root for each top-level block. >0: index of first of eight children in Morton order, <0: -(leaf index + 1), 0: outside of table
+		std::vector<TOctreeLeaf> Leaves; ///< cells with interpolation coefficients, in Morton order
+		std::vector<double> LeafCoeffs; ///< interpolation coefficients of leaves, TabField3::CellSize for each leaf
+
+		/**
+		 * Calculate tricubic interpolation coefficients of a cell from values and derivatives at its corners
+		 *
+		 * @param coeff Returns 64 coefficients
+		 * @param data Values and derivatives (same order as TabField3::CalcDerivs) at the eight corners (order of ::tricubic_get_coeff)
+		 * @param size Edge length of cell in table grid cells
+		 */
+		void LeafCoeff(double coeff[64], double data[8][8], int size);
+
+		/**
+		 * Get values and derivatives of a table column at a grid point.
+		 *
+		 * If the grid point is not a corner of all neighbouring cells, values are interpolated in the largest neighbouring cell.
+		 *
+		 * @param Tabs Table column and its derivatives returned by TabField3::CalcDerivs
+		 * @param column Table column (0 = Bx, 1 = By, 2 = Bz, 3 = V)
+		 * @param x x index of grid point
+		 * @param y y index of grid point
+		 * @param z z index of grid point
+		 * @param size Edge length of cell requesting the values, only larger cells are interpolated
+		 * @param data Returns value and derivatives in the order of TabField3::CalcDerivs
+		 */
+		void NodeData(std::vector<std::vector<double> > &Tabs, int column, int x, int y, int z, int size, double data[8]);
+
+		/**
+		 * Recursively create octree node and decide if it is refined.
+		 *
+		 * @param node Index of node in TabField3Octree::Nodes
+		 * @param x x index of lower corner in table grid
+		 * @param y y index of lower corner in table grid
+		 * @param z z index of lower corner in table grid
+		 * @param size Edge length of node in table grid cells
+		 * @param Tabs Table columns and their derivatives returned by TabField3::CalcDerivs
+		 * @param maxval Largest absolute value of each table column
+		 */
+		void Build(int node, int x, int y, int z, int size, std::vector<std::vector<double> > Tabs[4], double maxval[4]);
+
+		/**
+		 * Find leaf containing a table grid cell.
+		 *
+		 * @param x x index of grid cell
+		 * @param y y index of grid cell
+		 * @param z z index of grid cell
+		 *
+		 * @return Returns index of leaf in TabField3Octree::Leaves
+		 */
+		int Locate(int x, int y, int z);
+
+		bool FindCell(double x, double y, double z, int &cell, double u[3], double h[3]);
+
+		double* Coefficients(int column, int cell);
+	public:
+		/**
+		 * Constructor.
+		 *
+		 * Calls TabField3::ReadTabFile, TabField3::CheckTab, TabField3::CalcDerivs, builds octree with TabField3Octree::Build
+		 * and calculates interpolation coefficients of all leaves.
+		 *
+		 * @param tabfile Path of table file
+		 * @param Bscale Magnetic field is always scaled by this factor
+		 * @param Escale Electric field is always scaled by this factor
+		 * @param aNullFieldTime Sets TabField3::NullFieldTime
+		 * @param aRampUpTime Sets TabField3::RampUpTime
+		 * @param aFullFieldTime Sets TabField3::FullFieldTime
+		 * @param aRampDownTime Sets TabField3::RampDownTime
+		 * @param aBoundaryWidth Sets TabField3::BoundaryWidth
+		 * @param aTolerance Sets TabField3Octree::Tolerance
+		 * @param Levels Top-level blocks contain 2^Levels grid cells in each direction
+		 */
+		TabField3Octree(const char *tabfile, double Bscale, double Escale,
+				double aNullFieldTime, double aRampUpTime, double aFullFieldTime, double aRampDownTime, double aBoundaryWidth,
+				double aTolerance, int Levels);
+
+		/**
+		 * Copy interpolation coefficients into newly allocated memory, see TField::Replicate.
+		 */
+		void Replicate();
+};
+
+#endif // FIELD_OCTREE_H_
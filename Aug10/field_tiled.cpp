@@ -0,0 +1,254 @@
+/**
+ * \file
+ * Tricubic interpolation of 3D field tables stored on disk in bricks, which are loaded on demand.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "field_tiled.h"
+#include "globals.h"
+
+using namespace std;
+
+int INDEX_3D(int xi, int yi, int zi, int xsize, int ysize, int zsize); // defined in field_3d.cpp
+
+static const char BRICK_FILE_MAGIC[8] = {'P','E','N','T','R','K','B','R'}; ///< identifies brick files
+static const int BRICK_FILE_VERSION = 1; ///< version of brick file format
+static const int BRICK_SIZE = 8; ///< edge length of bricks written by TabField3Tiled::WriteBricks
+
+/**
+ * Header of brick file, followed by the bricks in the order of INDEX_3D.
+ *
+ * Each brick contains the coefficients of BrickSize^3 cells in the order of INDEX_3D, CellSize coefficients for each cell. Cells outside of the table are zero.
+ */
+struct TBrickFileHeader{
+	char magic[8]; ///< BRICK_FILE_MAGIC
+	int version; ///< BRICK_FILE_VERSION
+	int xl; ///< size of the table in x direction
+	int yl; ///< size of the table in y direction
+	int zl; ///< size of the table in z direction
+	int BrickSize; ///< edge length of bricks in grid cells
+	int CellSize; ///< number of coefficients of each cell
+	int ColumnOffset[4]; ///< offset of Bx, By, Bz and V coefficients in the coefficients of a cell, -1 if column does not exist
+	double xdist; ///< distance between grid points in x direction
+	double ydist; ///< distance between grid points in y direction
+	double zdist; ///< distance between grid points in z direction
+	double x_mi; ///< lower x coordinate of cuboid grid
+	double y_mi; ///< lower y coordinate of cuboid grid
+	double z_mi; ///< lower z coordinate of cuboid grid
+	double Bscale; ///< magnetic field scale factor the file was created with
+	double Escale; ///< electric field scale factor the file was created with
+};
+
+
+void TabField3Tiled::WriteBricks(const char *tabfile, const string &brickfile, double Bscale, double Escale){
+	vector<double> BxTab, ByTab, BzTab;	// Bx/By/Bz values
+	vector<double> VTab; // potential values
+	ReadTabFile(tabfile,Bscale,Escale,BxTab,ByTab,BzTab,VTab); // open tabfile and read values into arrays
+
+	CheckTab(BxTab,ByTab,BzTab,VTab); // print some info
+
+	printf("Calculating derivatives ... ");
+	vector<double> *columns[4] = {&BxTab, &ByTab, &BzTab, &VTab};
+	const char *names[4] = {"Bx", "By", "Bz", "V"};
+	vector<vector<double> > tabs[4];
+	TBrickFileHeader header;
+	memset(&header, 0, sizeof(header));
+	for (int i = 0; i < 4; i++){
+		header.ColumnOffset[i] = -1;
+		if (columns[i]->size() > 0){
+			printf("%s ... ", names[i]);
+			fflush(stdout);
+			CalcDerivs(*columns[i], tabs[i]);
+			header.ColumnOffset[i] = header.CellSize;
+			header.CellSize += 64;
+		}
+	}
+	printf("Done\n");
+
+	memcpy(header.magic, BRICK_FILE_MAGIC, sizeof(header.magic));
+	header.version = BRICK_FILE_VERSION;
+	header.xl = xl;
+	header.yl = yl;
+	header.zl = zl;
+	header.BrickSize = BRICK_SIZE;
+	header.xdist = xdist;
+	header.ydist = ydist;
+	header.zdist = zdist;
+	header.x_mi = x_mi;
+	header.y_mi = y_mi;
+	header.z_mi = z_mi;
+	header.Bscale = Bscale;
+	header.Escale = Escale;
+
+	// write to a unique temporary file next to the brick file and rename it, so an interrupted run does not leave an incomplete brick file
+	// and simultaneous runs (e.g. cluster jobs sharing the table directory) do not write into the same file
+	vector<char> tmpfile(brickfile.begin(), brickfile.end());
+	const char suffix[] = ".XXXXXX";
+	tmpfile.insert(tmpfile.end(), suffix, suffix + sizeof(suffix));
+	int fd = mkstemp(&tmpfile[0]);
+	FILE *f = fd >= 0 ? fdopen(fd, "wb") : NULL;
+	if (!f){
+		printf("Could not create %s! Exiting...\n", &tmpfile[0]);
+		exit(-1);
+	}
+	fchmod(fd, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH); // mkstemp only allows access by owner
+	fwrite(&header, sizeof(header), 1, f);
+
+	printf("Writing %s ", brickfile.c_str());
+	int nx = (xl - 2)/BRICK_SIZE + 1, ny = (yl - 2)/BRICK_SIZE + 1, nz = (zl - 2)/BRICK_SIZE + 1;
+	vector<double> brick(BRICK_SIZE*BRICK_SIZE*BRICK_SIZE*header.CellSize);
+	int perc = 0;
+	for (int bz = 0; bz < nz; bz++){
+		for (int by = 0; by < ny; by++){
+			for (int bx = 0; bx < nx; bx++){
+				fill(brick.begin(), brick.end(), 0);
+				for (int iz = 0; iz < BRICK_SIZE && bz*BRICK_SIZE + iz < zl - 1; iz++){
+					for (int iy = 0; iy < BRICK_SIZE && by*BRICK_SIZE + iy < yl - 1; iy++){
+						for (int ix = 0; ix < BRICK_SIZE && bx*BRICK_SIZE + ix < xl - 1; ix++){
+							int cell = INDEX_3D(ix, iy, iz, BRICK_SIZE, BRICK_SIZE, BRICK_SIZE);
+							for (int c = 0; c < 4; c++){
+								if (header.ColumnOffset[c] >= 0)
+									CalcCellCoeff(&brick[cell*header.CellSize + header.ColumnOffset[c]], tabs[c],
+													bx*BRICK_SIZE + ix, by*BRICK_SIZE + iy, bz*BRICK_SIZE + iz);
+							}
+						}
+					}
+				}
+				if (!brick.empty())
+					fwrite(&brick[0], sizeof(double), brick.size(), f);
+				PrintPercent((float)INDEX_3D(bx, by, bz, nx, ny, nz)/(nx*ny*nz), perc);
+			}
+		}
+	}
+	printf("\n");
+
+	bool failed = ferror(f) != 0;
+	if (fclose(f) != 0 || failed || rename(&tmpfile[0], brickfile.c_str()) != 0){
+		unlink(&tmpfile[0]);
+		printf("Could not write %s! Exiting...\n", brickfile.c_str());
+		exit(-1);
+	}
+}
+
+
+bool TabField3Tiled::OpenBricks(const char *tabfile, const string &brickfile, double Bscale, double Escale){
+	struct stat tabstat, brickstat;
+	if (stat(brickfile.c_str(), &brickstat) != 0)
+		return false;
+	if (stat(tabfile, &tabstat) == 0 && tabstat.st_mtime > brickstat.st_mtime) // table was changed after brick file was written
+		return false;
+
+	int fd = open(brickfile.c_str(), O_RDONLY);
+	TBrickFileHeader header;
+	if (fd < 0)
+		return false;
+	if (pread(fd, &header, sizeof(header), 0) != sizeof(header) || memcmp(header.magic, BRICK_FILE_MAGIC, sizeof(header.magic)) != 0 ||
+			header.version != BRICK_FILE_VERSION || header.Bscale != Bscale || header.Escale != Escale){
+		close(fd);
+		return false;
+	}
+
+	xl = header.xl;
+	yl = header.yl;
+	zl = header.zl;
+	xdist = header.xdist;
+	ydist = header.ydist;
+	zdist = header.zdist;
+	x_mi = header.x_mi;
+	y_mi = header.y_mi;
+	z_mi = header.z_mi;
+	CellSize = header.CellSize;
+	for (int i = 0; i < 4; i++)
+		ColumnOffset[i] = header.ColumnOffset[i];
+	BrickSize = header.BrickSize;
+	xbricks = (xl - 2)/BrickSize + 1;
+	ybricks = (yl - 2)/BrickSize + 1;
+	zbricks = (zl - 2)/BrickSize + 1;
+	BrickDoubles = BrickSize*BrickSize*BrickSize*CellSize;
+	if (brickstat.st_size != (off_t)(sizeof(header) + (off_t)xbricks*ybricks*zbricks*BrickDoubles*sizeof(double))){ // incomplete file
+		close(fd);
+		return false;
+	}
+	fFile = fd;
+	return true;
+}
+
+
+void TabField3Tiled::LoadItem(int brick, double *coeffs){
+	char *buf = (char*)coeffs;
+	size_t size = BrickDoubles*sizeof(double);
+	off_t offset = sizeof(TBrickFileHeader) + (off_t)brick*size;
+	while (size > 0){
+		ssize_t n = pread(fFile, buf, size, offset);
+		if (n <= 0){
+			printf("Could not read brick %i of field table! Exiting...\n", brick);
+			exit(-1);
+		}
+		buf += n;
+		size -= n;
+		offset += n;
+	}
+}
+
+
+double* TabField3Tiled::Coefficients(int column, int cell){
+	if (ColumnOffset[column] < 0)
+		return NULL;
+	int indx = cell % (xl-1), indy = cell/(xl-1) % (yl-1), indz = cell/(xl-1)/(yl-1);
+	int bx = indx/BrickSize, by = indy/BrickSize, bz = indz/BrickSize;
+	int brick = INDEX_3D(bx, by, bz, xbricks, ybricks, zbricks);
+
+	double *coeffs = CachedItem(brick); // reads brick from file if it is not cached
+	TCacheThread &thread = ThreadCache();
+	if (brick != thread.LastItem){ // particle entered new brick
+		if (thread.LastItem >= 0){
+			// ask kernel to read ahead the next brick in direction of flight
+			int lx = thread.LastItem % xbricks, ly = thread.LastItem/xbricks % ybricks, lz = thread.LastItem/xbricks/ybricks;
+			int nx = bx + (bx > lx) - (bx < lx), ny = by + (by > ly) - (by < ly), nz = bz + (bz > lz) - (bz < lz);
+			if (nx >= 0 && nx < xbricks && ny >= 0 && ny < ybricks && nz >= 0 && nz < zbricks){
+				int next = INDEX_3D(nx, ny, nz, xbricks, ybricks, zbricks);
+				if (!__atomic_load_n(&ItemCoeffs[next], __ATOMIC_RELAXED))
+					posix_fadvise(fFile, sizeof(TBrickFileHeader) + (off_t)next*BrickDoubles*sizeof(double), BrickDoubles*sizeof(double), POSIX_FADV_WILLNEED);
+			}
+		}
+		thread.LastItem = brick;
+	}
+
+	return &coeffs[INDEX_3D(indx % BrickSize, indy % BrickSize, indz % BrickSize, BrickSize, BrickSize, BrickSize)*CellSize + ColumnOffset[column]];
+}
+
+
+TabField3Tiled::TabField3Tiled(const char *tabfile, double Bscale, double Escale,
+		double aNullFieldTime, double aRampUpTime, double aFullFieldTime, double aRampDownTime, double aBoundaryWidth, double CacheSize)
+		: TabField3(aNullFieldTime, aRampUpTime, aFullFieldTime, aRampDownTime, aBoundaryWidth), fFile(-1){
+	string brickfile = string(tabfile) + ".bricks";
+	if (!OpenBricks(tabfile, brickfile, Bscale, Escale)){
+		WriteBricks(tabfile, brickfile, Bscale, Escale);
+		if (!OpenBricks(tabfile, brickfile, Bscale, Escale)){
+			printf("Could not open %s! Exiting...\n", brickfile.c_str());
+			exit(-1);
+		}
+	}
+
+	int bricks = xbricks*ybricks*zbricks;
+	int slots = bricks;
+	if (BrickDoubles > 0)
+		slots = max(1, (int)min(CacheSize*1024*1024/(BrickDoubles*sizeof(double)), (double)bricks));
+	InitCache(bricks, slots, BrickDoubles);
+	printf("\nUsing %s: %i by %i by %i grid, %i of %i bricks (%.f MB) are kept in memory\n",
+			brickfile.c_str(), xl, yl, zl, slots, bricks, slots*BrickDoubles*sizeof(double)/1024./1024.);
+}
+
+
+TabField3Tiled::~TabField3Tiled(){
+	if (fFile >= 0)
+		close(fFile);
+}
@@ -0,0 +1,100 @@
+/**
+ * \file
+ * Tricubic interpolation of 3D field tables stored on disk in bricks, which are loaded on demand.
+ */
+
+#ifndef FIELD_TILED_H_
+#define FIELD_TILED_H_
+
+#include <string>
+
+#include "field_3d.h"
+
+/**
+ * Class for tricubic field interpolation of tables too large to be kept in memory.
+ *
+ * The interpolation coefficients of the table are written once into a brick file (table file name + ".bricks"),
+ * in which the grid cells are grouped into cubic bricks stored one after another.
+ * The brick file is rebuilt if it is missing, older than the table or was created with different scale factors.
+ * It can be copied to machines without the table file, which do not need the memory required to build it.
+ *
+ * Bricks are read from the brick file when a particle first enters them and are kept in a cache of limited size,
+ * the least recently used brick is dropped when the cache is full. The cache is shared by all threads evaluating the field.
+ * When a particle enters a new brick, the kernel is asked to read ahead the next brick in its direction of flight.
+ */
+class TabField3Tiled: public TabField3{
+	private:
+		int BrickSize; ///< edge length of bricks in grid cells
+		int xbricks; ///< number of bricks in x direction
+		int ybricks; ///< number of bricks in y direction
+		int zbricks; ///< number of bricks in z direction
+		int BrickDoubles; ///< number of coefficients in each brick
+		int fFile; ///< file descriptor of brick file, only read with pread, so it can be shared by all threads
+
+		/**
+		 * Read table file and write interpolation coefficients into brick file.
+		 *
+		 * Calls TabField3::ReadTabFile, TabField3::CheckTab, TabField3::CalcDerivs and TabField3::CalcCellCoeff for each cell.
+		 *
+		 * @param tabfile Path of table file
+		 * @param brickfile Path of brick file
+		 * @param Bscale Magnetic field is always scaled by this factor
+		 * @param Escale Electric field is always scaled by this factor
+		 */
+		void WriteBricks(const char *tabfile, const std::string &brickfile, double Bscale, double Escale);
+
+		/**
+		 * Open brick file and read grid parameters from its header.
+		 *
+		 * @param tabfile Path of table file
+		 * @param brickfile Path of brick file
+		 * @param Bscale Magnetic field scale factor the brick file has to be created with
+		 * @param Escale Electric field scale factor the brick file has to be created with
+		 *
+		 * @return Returns false if brick file does not exist, is outdated or was created with different scale factors
+		 */
+		bool OpenBricks(const char *tabfile, const std::string &brickfile, double Bscale, double Escale);
+
+		/**
+		 * Read a brick from the brick file.
+		 *
+		 * @param brick Index of brick
+		 * @param coeffs Returns coefficients of all cells in brick
+		 */
+		void LoadItem(int brick, double *coeffs);
+
+		/**
+		 * Get interpolation coefficients of a grid cell, reads its brick from the brick file if it is not cached.
+		 *
+		 * @param column Table column (0 = Bx, 1 = By, 2 = Bz, 3 = V)
+		 * @param cell Index of cell returned by TabField3::FindCell
+		 *
+		 * @return Returns pointer to 64 coefficients, NULL if table does not contain this column
+		 */
+		double* Coefficients(int column, int cell);
+	public:
+		/**
+		 * Constructor.
+		 *
+		 * Opens brick file, creates it with TabField3Tiled::WriteBricks if necessary.
+		 *
+		 * @param tabfile Path of table file
+		 * @param Bscale Magnetic field is always scaled by this factor
+		 * @param Escale Electric field is always scaled by this factor
+		 * @param aNullFieldTime Sets TabField3::NullFieldTime
+		 * @param aRampUpTime Sets TabField3::RampUpTime
+		 * @param aFullFieldTime Sets TabField3::FullFieldTime
+		 * @param aRampDownTime Sets TabField3::RampDownTime
+		 * @param aBoundaryWidth Sets TabField3::BoundaryWidth
+		 * @param CacheSize At most CacheSize MB of bricks are kept in memory
+		 */
+		TabField3Tiled(const char *tabfile, double Bscale, double Escale,
+				double aNullFieldTime, double aRampUpTime, double aFullFieldTime, double aRampDownTime, double aBoundaryWidth, double CacheSize);
+
+		/**
+		 * Destructor, closes brick file.
+		 */
+		~TabField3Tiled();
+};
+
+#endif // FIELD_TILED_H_
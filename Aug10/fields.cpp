@@ -8,17 +8,23 @@
 #include <sstream>
 #include <iostream>
 #include <cmath>
+#include <algorithm>
 
 #include "fields.h"
 #include "field.h"
 #include "field_2d.h"
 #include "field_3d.h"
+#include "field_octree.h"
+#include "field_tiled.h"
 #include "conductor.h"
 
 using namespace std;
 
 TFieldManager::TFieldManager(TConfig &conf, int aFieldOscillation, double aOscillationFraction, double aOscillationFrequency):
 			FieldOscillation(aFieldOscillation), OscillationFraction(aOscillationFraction), OscillationFrequency(aOscillationFrequency){
+	RetiredEvaluations = 0;
+	pthread_key_create(&EvaluationsKey, &ReleaseThreadEvaluations);
+	pthread_mutex_init(&EvaluationsMutex, NULL);
 	for (map<string, string>::iterator i = conf["FIELDS"].begin(); i != conf["FIELDS"].end(); i++){
 		string type;
 		string ft;
@@ -33,10 +39,29 @@ TFieldManager::TFieldManager(TConfig &conf, int aFieldOscillation, double aOscil
 				f = new TabField(ft.c_str(), Bscale, Escale, NullFieldTime, RampUpTime, FullFieldTime, RampDownTime);
 		}
 		else if (i->first == "3Dtable"){
-			double BoundaryWidth;
+			double BoundaryWidth, CacheSize;
+			string symmetry;
 			ss >> ft >> Bscale >> Escale >> NullFieldTime >> RampUpTime >> FullFieldTime >> RampDownTime >> BoundaryWidth;
+			if (ss){
+				if (!(ss >> CacheSize)) // cache size and symmetry are optional
+					CacheSize = 0;
+				else if (!(ss >> symmetry) || symmetry == "none")
+					symmetry = "";
+				f = new TabField3(ft.c_str(), Bscale, Escale, NullFieldTime, RampUpTime, FullFieldTime, RampDownTime, BoundaryWidth, CacheSize, symmetry.c_str());
+			}
+		}
+		else if (i->first == "3Doctree"){
+			double BoundaryWidth, Tolerance;
+			int Levels;
+			ss >> ft >> Bscale >> Escale >> NullFieldTime >> RampUpTime >> FullFieldTime >> RampDownTime >> BoundaryWidth >> Tolerance >> Levels;
+			if (ss)
+				f = new TabField3Octree(ft.c_str(), Bscale, Escale, NullFieldTime, RampUpTime, FullFieldTime, RampDownTime, BoundaryWidth, Tolerance, Levels);
+		}
+		else if (i->first == "3Dtiled"){
+			double BoundaryWidth, CacheSize;
+			ss >> ft >> Bscale >> Escale >> NullFieldTime >> RampUpTime >> FullFieldTime >> RampDownTime >> BoundaryWidth >> CacheSize;
 			if (ss)
-				f = new TabField3(ft.c_str(), Bscale, Escale, NullFieldTime, RampUpTime, FullFieldTime, RampDownTime, BoundaryWidth);
+				f = new TabField3Tiled(ft.c_str(), Bscale, Escale, NullFieldTime, RampUpTime, FullFieldTime, RampDownTime, BoundaryWidth, CacheSize);
 		}
 		else if (i->first == "InfiniteWireZ"){
 			ss >> Ibar >> p1 >> p2;
@@ -79,8 +104,12 @@ TFieldManager::TFieldManager(TConfig &conf, int aFieldOscillation, double aOscil
 				f = new TFullRacetrack(p1, p2, p3, Ibar);
 		}
 
-		if (f)
+		if (f){
 			fields.push_back(f);
+			fieldnames.push_back(i->first);
+			Bscales.push_back(1);
+			Escales.push_back(1);
+		}
 		else{
 			cout << "\nCould not load field """ << i->first << """! Did you enter invalid parameters?\n";
 			exit(-1);
@@ -92,18 +121,62 @@ TFieldManager::TFieldManager(TConfig &conf, int aFieldOscillation, double aOscil
 TFieldManager::~TFieldManager(){
 	for (vector<TField*>::iterator i = fields.begin(); i != fields.end(); i++)
 		delete (*i);
+	for (vector<TThreadEvaluations*>::iterator i = AllEvaluations.begin(); i != AllEvaluations.end(); i++)
+		delete *i;
+	pthread_key_delete(EvaluationsKey);
+	pthread_mutex_destroy(&EvaluationsMutex);
+}
+
+
+unsigned long long& TFieldManager::ThreadEvaluations(){
+	TThreadEvaluations *n = (TThreadEvaluations*)pthread_getspecific(EvaluationsKey);
+	if (!n){
+		n = new TThreadEvaluations;
+		n->N = 0;
+		n->Manager = this;
+		pthread_mutex_lock(&EvaluationsMutex);
+		AllEvaluations.push_back(n);
+		pthread_mutex_unlock(&EvaluationsMutex);
+		pthread_setspecific(EvaluationsKey, n);
+	}
+	return n->N;
+}
+
+
+void TFieldManager::ReleaseThreadEvaluations(void *evaluations){
+	TThreadEvaluations *n = (TThreadEvaluations*)evaluations;
+	TFieldManager *m = n->Manager;
+	pthread_mutex_lock(&m->EvaluationsMutex);
+	m->RetiredEvaluations += n->N;
+	m->AllEvaluations.erase(find(m->AllEvaluations.begin(), m->AllEvaluations.end(), n));
+	pthread_mutex_unlock(&m->EvaluationsMutex);
+	delete n;
+}
+
+
+unsigned long long TFieldManager::Evaluations(){
+	return ThreadEvaluations();
 }
 
 
-void TFieldManager::BField (double x, double y, double z, double t, double B[4][4]){      //B-Feld am Ort des Teilchens berechnen
+void TFieldManager::BField (double x, double y, double z, double t, double B[4][4], int request){      //B-Feld am Ort des Teilchens berechnen
+	ThreadEvaluations()++;
 	for (int i = 0; i < 4; i++)
 		for (int j = 0; j < 4; j++)
 			B[i][j] = 0;
 
 	double BFeldSkal = BFieldScale(t);
 	if (BFeldSkal != 0){
-		for (vector<TField*>::iterator i = fields.begin(); i != fields.end(); i++){
-			(*i)->BField(x, y, z, t, B);
+		for (unsigned int i = 0; i < fields.size(); i++){
+			if (Bscales[i] == 1)
+				fields[i]->BField(x, y, z, t, B, request);
+			else if (Bscales[i] != 0){ // evaluate field separately and add scaled values
+				double Bf[4][4] = {{0,0,0,0},{0,0,0,0},{0,0,0,0},{0,0,0,0}};
+				fields[i]->BField(x, y, z, t, Bf, request);
+				for (int j = 0; j < 3; j++)
+					for (int k = 0; k < 4; k++)
+						B[j][k] += Bscales[i]*Bf[j][k];
+			}
 		}
 
 		if (BFeldSkal != 1)
@@ -112,7 +185,7 @@ void TFieldManager::BField (double x, double y, double z, double t, double B[4][
 					B[i][j] *= BFeldSkal;
 
 		B[3][0] = sqrt(B[0][0]*B[0][0] + B[1][0]*B[1][0] + B[2][0]*B[2][0]); // absolute value of B-Vector
-		if (B[3][0]>1e-31)
+		if (B[3][0]>1e-31 && (request & BFIELD_DERIVATIVES))
 		{
 			B[3][1] = (B[0][0]*B[0][1] + B[1][0]*B[1][1] + B[2][0]*B[2][1])/B[3][0]; // derivatives of absolute value
 			B[3][2] = (B[0][0]*B[0][2] + B[1][0]*B[1][2] + B[2][0]*B[2][2])/B[3][0];
@@ -123,15 +196,48 @@ void TFieldManager::BField (double x, double y, double z, double t, double B[4][
 
 
 void TFieldManager::EField(double x, double y, double z, double t, double &V, double Ei[3]){
+	ThreadEvaluations()++;
 	Ei[0] = Ei[1] = Ei[2] = V = 0;
-	for (vector<TField*>::iterator i = fields.begin(); i != fields.end(); i++){
-		(*i)->EField(x, y, z, t, V, Ei);
+	for (unsigned int i = 0; i < fields.size(); i++){
+		if (Escales[i] == 1)
+			fields[i]->EField(x, y, z, t, V, Ei);
+		else if (Escales[i] != 0){ // evaluate field separately and add scaled values
+			double Vf = 0, Ef[3] = {0, 0, 0};
+			fields[i]->EField(x, y, z, t, Vf, Ef);
+			V += Escales[i]*Vf;
+			for (int j = 0; j < 3; j++)
+				Ei[j] += Escales[i]*Ef[j];
+		}
 	}
 }
 
 
+bool TFieldManager::SetFieldScale(const string &name, double Bscale, double Escale){
+	for (unsigned int i = 0; i < fields.size(); i++){
+		if (fieldnames[i] == name){
+			Bscales[i] = Bscale;
+			Escales[i] = Escale;
+			return true;
+		}
+	}
+	return false;
+}
+
+
+void TFieldManager::ResetFieldScales(){
+	fill(Bscales.begin(), Bscales.end(), 1);
+	fill(Escales.begin(), Escales.end(), 1);
+}
+
+
 double TFieldManager::BFieldScale(double t){
 	if (FieldOscillation==1)
 		return 1 + OscillationFraction*sin(OscillationFrequency*2*pi*t);
 	return 1;
 }
+
+
+void TFieldManager::Replicate(){
+	for (vector<TField*>::iterator i = fields.begin(); i != fields.end(); i++)
+		(*i)->Replicate();
+}
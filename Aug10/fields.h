@@ -7,6 +7,9 @@
 #define FIELDS_H_
 
 #include <vector>
+#include <string>
+
+#include <pthread.h>
 
 #include "field.h"
 #include "field_2d.h"
@@ -20,6 +23,9 @@
 struct TFieldManager{
 	public:
 		std::vector<TField*> fields; ///< list of fields
+		std::vector<std::string> fieldnames; ///< field type given in [FIELDS] section for each field
+		std::vector<double> Bscales; ///< factor by which magnetic field of each field is scaled at evaluation time
+		std::vector<double> Escales; ///< factor by which electric field and potential of each field are scaled at evaluation time
 		int FieldOscillation; ///< If =1 field oscillation is turned on
 		double OscillationFraction; ///< Field oscillation amplitude
 		double OscillationFrequency; ///< Field oscillation frequency
@@ -43,6 +49,16 @@ struct TFieldManager{
 		~TFieldManager();
 
 
+		/**
+		 * Get number of calls to TFieldManager::BField and TFieldManager::EField.
+		 *
+		 * Each thread counts its own calls, so producer threads do not disturb the cost counters of tracked particles.
+		 *
+		 * @return Returns number of calls made by the calling thread
+		 */
+		unsigned long long Evaluations();
+
+
 		/**
 		 * Calculate magnetic field at a given position and time.
 		 *
@@ -58,8 +74,9 @@ struct TFieldManager{
 		 * @param z Cartesian z coordinate
 		 * @param t Time
 		 * @param B Returns magnetic field component matrix
+		 * @param request Combination of BFIELD_VALUE and BFIELD_DERIVATIVES, entries which were not requested may be left zero
 		 */
-		void BField (double x, double y, double z, double t, double B[4][4]);
+		void BField (double x, double y, double z, double t, double B[4][4], int request = BFIELD_ALL);
 
 		
 		/**
@@ -76,7 +93,61 @@ struct TFieldManager{
 		 */
 		void EField(double x, double y, double z, double t, double &V, double Ei[3]);
 
+
+		/**
+		 * Scale a field at evaluation time.
+		 *
+		 * The field is scaled linearly when it is evaluated, so field maps do not have to be reloaded or preinterpolated again.
+		 *
+		 * @param name Field type given in [FIELDS] section of geometry.in (e.g. 2Dtable or FiniteWireZCenter)
+		 * @param Bscale Factor for magnetic field
+		 * @param Escale Factor for electric field and potential
+		 *
+		 * @return Returns false if there is no field with this name
+		 */
+		bool SetFieldScale(const std::string &name, double Bscale, double Escale);
+
+
+		/**
+		 * Reset scale factors of all fields to 1.
+		 */
+		void ResetFieldScales();
+
+
+
+		/**
+		 * Copy data of all fields into newly allocated memory, see TField::Replicate.
+		 */
+		void Replicate();
+
 	private:
+		/**
+		 * Call counter of one thread
+		 */
+		struct TThreadEvaluations{
+			unsigned long long N; ///< number of calls to TFieldManager::BField and TFieldManager::EField
+			TFieldManager *Manager; ///< field manager counting the calls, needed by TFieldManager::ReleaseThreadEvaluations
+		};
+		pthread_key_t EvaluationsKey; ///< TThreadEvaluations of current thread
+		std::vector<TThreadEvaluations*> AllEvaluations; ///< call counters of all running threads
+		unsigned long long RetiredEvaluations; ///< calls made by threads which have exited
+		pthread_mutex_t EvaluationsMutex; ///< mutex protecting TFieldManager::AllEvaluations and TFieldManager::RetiredEvaluations
+
+		/**
+		 * Get call counter of current thread, creates it if necessary
+		 *
+		 * @return Returns reference to counter
+		 */
+		unsigned long long& ThreadEvaluations();
+
+		/**
+		 * Add call counter of an exiting thread to TFieldManager::RetiredEvaluations and free it
+		 *
+		 * Destructor of TFieldManager::EvaluationsKey.
+		 *
+		 * @param evaluations TThreadEvaluations of exiting thread
+		 */
+		static void ReleaseThreadEvaluations(void *evaluations);
 
 		/**
 		 * Scale magnetic field due to field oscillation.
@@ -1,5 +1,6 @@
 #include <iostream>
 #include <sstream>
+#include <algorithm>
 
 #include "globals.h"
 #include "geometry.h"
@@ -20,6 +21,27 @@ TGeometry::TGeometry(TConfig &geometryin){
 			cout << "Could not load material " << i->first << '\n';
 	}
 
+	for (map<string, string>::iterator i = geometryin["MATERIALSETS"].begin(); i != geometryin["MATERIALSETS"].end(); i++){
+		TMaterialSet set;
+		set.name = i->first;
+		istringstream ss(i->second);
+		ss >> set.mat.name >> set.mat.FermiReal >> set.mat.FermiImag >> set.mat.DiffProb >> set.mat.SpinflipProb >> set.mat.RMSRoughness >> set.mat.CorrelLength >> set.mat.UseMRModel;
+		bool found = false, trajectory = false;
+		for (unsigned j = 0; j < materials.size(); j++){
+			if (materials[j].name == set.mat.name){
+				found = true;
+				// reweighting only rescales hit and absorption probabilities, parameters changing trajectories or diffuse scattering angles cannot be reweighted
+				trajectory = set.mat.FermiReal != materials[j].FermiReal || set.mat.RMSRoughness != materials[j].RMSRoughness ||
+						set.mat.CorrelLength != materials[j].CorrelLength || set.mat.UseMRModel != materials[j].UseMRModel;
+			}
+		}
+		if (!ss || !found || trajectory){
+			cout << "Could not load material set " << i->first << "! Did you define invalid parameters or an unknown material?\n";
+			exit(-1);
+		}
+		materialsets.push_back(set);
+	}
+
 	string line;
 	string STLfile;
 	string matname;
@@ -88,6 +110,28 @@ TGeometry::TGeometry(TConfig &geometryin){
 	}
 	mesh.Init();
 	cout << '\n';
+
+	for (map<string, string>::iterator i = geometryin["IMPORTANCE"].begin(); i != geometryin["IMPORTANCE"].end(); i++){
+		TImportanceRegion region;
+		vector<double> params;
+		double param;
+		istringstream ss(i->second);
+		ss >> region.importance;
+		while (ss >> param)
+			params.push_back(param);
+		if (params.size() == 1)
+			region.solidID = (int)params[0];
+		else if (params.size() == 6){
+			region.solidID = -1;
+			for (int j = 0; j < 6; j++)
+				region.box[j] = params[j];
+		}
+		if (region.importance <= 0 || (params.size() != 1 && params.size() != 6)){
+			cout << "Invalid importance region " << i->first << " in geometry.in!\n";
+			exit(-1);
+		}
+		importanceregions.push_back(region);
+	}
 }
 
 
@@ -140,3 +184,23 @@ solid TGeometry::GetSolid(const double t, const double p[3], map<solid, bool> cu
 			return i->first;
 	return defaultsolid;
 }
+
+double TGeometry::GetImportance(const double p[3], const solid &sld){
+	double importance = 0;
+	bool found = false;
+	for (vector<TImportanceRegion>::iterator i = importanceregions.begin(); i != importanceregions.end(); i++){
+		if (i->solidID >= 0 ? i->solidID == (int)sld.ID :
+				p[0] >= i->box[0] && p[0] <= i->box[1] && p[1] >= i->box[2] && p[1] <= i->box[3] && p[2] >= i->box[4] && p[2] <= i->box[5]){
+			importance = max(importance, i->importance);
+			found = true;
+		}
+	}
+	return found ? importance : 1;
+}
+
+bool TGeometry::GetAlternativeSolid(unsigned int set, solid &sld){
+	if (materialsets[set].mat.name != sld.mat.name)
+		return false;
+	sld.mat = materialsets[set].mat;
+	return true;
+}
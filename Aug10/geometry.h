@@ -51,6 +51,21 @@ struct solid{
 };
 
 
+/// Struct to store alternative material parameters, for which particles are reweighted (read from geometry.in)
+struct TMaterialSet{
+	std::string name; ///< name of material set
+	material mat; ///< alternative parameters of the material with the same name
+};
+
+
+/// Struct to store importance regions for population splitting and Russian roulette (read from geometry.in)
+struct TImportanceRegion{
+	int solidID; ///< region is the inside of this solid (-1: region is a box)
+	double box[6]; ///< corners of box region (xmin xmax ymin ymax zmin zmax)
+	double importance; ///< importance of region
+};
+
+
 /**
  * Class to include experiment geometry.
  *
@@ -61,6 +76,8 @@ struct TGeometry{
 		TTriangleMesh mesh; ///< kd-tree structure containing triangle meshes from STL-files
 		vector<solid> solids; ///< solids list
 		solid defaultsolid; ///< "vacuum", this solid's properties are used when the particle is not inside any other solid
+		vector<TImportanceRegion> importanceregions; ///< importance regions list
+		vector<TMaterialSet> materialsets; ///< alternative material sets list
 		
 		/**
 		 * Constructor, reads geometry configuration file, loads triangle meshes.
@@ -121,6 +138,28 @@ struct TGeometry{
 		 */
 		solid GetSolid(const double t, const double p[3]);
 		solid GetSolid(const double t, const double p[3], map<solid, bool> currentsolids);
+
+
+		/**
+		 * Get importance at point p
+		 *
+		 * @param p Point to test
+		 * @param sld Solid in which the point lies
+		 *
+		 * @return Returns highest importance of all importance regions containing p (1 if there is none)
+		 */
+		double GetImportance(const double p[3], const solid &sld);
+
+
+		/**
+		 * Replace material of a solid by its parameters in an alternative material set
+		 *
+		 * @param set Index of material set in TGeometry::materialsets
+		 * @param sld Solid, whose material is replaced
+		 *
+		 * @return Returns true if the material set contains alternative parameters for the solid's material
+		 */
+		bool GetAlternativeSolid(unsigned int set, solid &sld);
 };
 
 #endif /*GEOMETRY_H_*/
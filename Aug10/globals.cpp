@@ -9,9 +9,12 @@
 long long int jobnumber = 0; ///< job number, read from command line paramters, used for parallel calculations
 std::string inpath = "."; ///< path to configuration files, read from command line paramters
 std::string outpath = "."; ///< path where the log file should be saved to, read from command line parameters
+int verbosity = VERBOSITY_PARTICLE; ///< amount of console output (VERBOSITY_*), read from config
 
 // print progress in percent
 void PrintPercent(double percentage, int &lastprint){
+	if (!VERBOSE(VERBOSITY_STEP))
+		return;
 	// write status to console
 	// one point per 2 percent of endtime
 	while (lastprint < percentage*100){
@@ -12,6 +12,7 @@
 #define ID_INITIAL_NOT_FOUND -5 ///< flag for particles which had a too low total energy to find a initial spot in the source volume
 #define ID_CGAL_ERROR -6 ///< flag for particles which produced an error during geometry collision checks
 #define ID_GEOMETRY_ERROR -7 ///< flag for particles which produced an error while tracking material boundaries along the trajectory
+#define ID_RUSSIAN_ROULETTE -8 ///< flag for particles which were stopped by Russian roulette when entering a region of lower importance
 #define ID_ABSORBED_IN_MATERIAL 1 ///< flag for particles that were absorbed inside a material
 #define ID_ABSORBED_ON_SURFACE 2 ///< flag for particles that were absorbed on a material surface
 
@@ -19,6 +20,26 @@
 #define BF_ONLY 3 ///< set particletype in configuration to this value to print out a ramp heating analysis
 #define BF_CUT 4 ///< set particletype in configuration to this value to print out a planar slice through electric/magnetic fields
 #define GEOMETRY 7 ///< set particletype in configuration to this value to print out a sampling of the geometry
+#define INITIAL_CONDITIONS 8 ///< set particletype in configuration to this value to write initial conditions of primary particles into a file
+
+#define VERBOSITY_QUIET 0 ///< console output: only errors and final summary
+#define VERBOSITY_SUMMARY 1 ///< console output: additionally setup messages and rate-limited progress of the whole run
+#define VERBOSITY_PARTICLE 2 ///< console output: additionally start and end of each particle
+#define VERBOSITY_STEP 3 ///< console output: additionally progress bar, track points, hits, absorptions, spin flips etc. during integration
+#define VERBOSITY_DEBUG 4 ///< console output: additionally debugging output
+
+#ifndef MAX_VERBOSITY
+#define MAX_VERBOSITY VERBOSITY_DEBUG ///< console output above this level is removed at compile time (e.g. compile with -DMAX_VERBOSITY=2)
+#endif
+
+/**
+ * Check if console output of a given level should be printed.
+ *
+ * Evaluates to a compile-time constant false for levels above ::MAX_VERBOSITY, so the output code is removed by the compiler.
+ *
+ * Usage: if (VERBOSE(VERBOSITY_STEP)) cout << ...;
+ */
+#define VERBOSE(level) ((level) <= MAX_VERBOSITY && (level) <= verbosity)
 
 // physical constants
 static const long double pi = 3.1415926535897932384626L; ///< Pi
@@ -41,11 +62,12 @@ static const long double Econv = 1e2; ///< electric field conversion factor cgs
 extern long long int jobnumber; ///< job number, read from command line paramters, used for parallel calculations
 extern std::string inpath; ///< path to configuration files, read from command line paramters
 extern std::string outpath; ///< path where the log file should be saved to, read from command line parameters
+extern int verbosity; ///< amount of console output (VERBOSITY_*), read from config
 
 /**
  * Print progress bar.
  *
- * Prints a point every 2% and a number every 10%
+ * Prints a point every 2% and a number every 10%, only if ::verbosity is at least VERBOSITY_STEP
  *
  * @param percentage Progress of current action (0..1)
  * @param lastprint Put in and return last printed percentage
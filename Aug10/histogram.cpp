@@ -0,0 +1,283 @@
+/**
+ * \file
+ * Histograms filled during particle tracking, configured in the [HISTOGRAMS] section of config.in.
+ */
+
+#include <iostream>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <stdint.h>
+
+#include "histogram.h"
+#include "globals.h"
+
+using namespace std;
+
+THistograms *histograms = NULL;
+
+static const char HIST_MAGIC[8] = {'P','E','N','T','R','K','H','S'}; ///< identifies histogram files
+static const uint32_t HIST_VERSION = 1; ///< version of histogram file format
+static const char *HIST_VARIABLES[] = {"x", "y", "z", "r", "phi", "t", "vx", "vy", "vz", "v", "E"}; ///< variables which can be histogrammed
+static const unsigned int HIST_NVARIABLES = sizeof(HIST_VARIABLES)/sizeof(HIST_VARIABLES[0]); ///< number of variables which can be histogrammed
+static const unsigned int HIST_PHI = 4; ///< index of azimuth in ::HIST_VARIABLES
+
+
+THistogram::THistogram(const string &aname, const string &definition): name(aname), solid(-1), fTotalBins(1){
+	istringstream def(definition);
+	def >> particlename >> fQuantityName;
+	string q = fQuantityName.substr(0, fQuantityName.find(':'));
+	if (q == "density")
+		quantity = DENSITY;
+	else if (q == "pathlength")
+		quantity = PATHLENGTH;
+	else if (q == "start")
+		quantity = START;
+	else if (q == "end")
+		quantity = END;
+	else if (q == "hits"){
+		quantity = HITS;
+		if (q.size() < fQuantityName.size())
+			istringstream(fQuantityName.substr(q.size() + 1)) >> solid;
+	}
+	else if (q == "spinflips")
+		quantity = SPINFLIPS;
+	else{
+		cout << "Unknown quantity '" << fQuantityName << "' in histogram " << name << "!\n";
+		exit(-1);
+	}
+
+	string axis;
+	while (def >> axis){
+		replace(axis.begin(), axis.end(), ':', ' ');
+		istringstream axisdef(axis);
+		string var;
+		double min, max;
+		unsigned int bins = 0;
+		axisdef >> var >> min >> max >> bins;
+		unsigned int v = find(HIST_VARIABLES, HIST_VARIABLES + HIST_NVARIABLES, var) - HIST_VARIABLES;
+		if (!axisdef || v >= HIST_NVARIABLES || bins == 0 || max <= min){
+			cout << "Invalid axis '" << axis << "' in histogram " << name << "!\n";
+			exit(-1);
+		}
+		fVariables.push_back(var);
+		fVarIndex.push_back(v);
+		fMin.push_back(min);
+		fMax.push_back(max);
+		fBins.push_back(bins);
+		fTotalBins *= bins;
+	}
+	if (fVariables.empty() || fVariables.size() > 3){
+		cout << "Histogram " << name << " needs one to three axes!\n";
+		exit(-1);
+	}
+	if (VERBOSE(VERBOSITY_SUMMARY))
+		cout << "Histogram " << name << ": " << fQuantityName << " (" << particlename << ") in " << fTotalBins << " bins\n";
+
+	pthread_key_create(&fThreadBins, NULL);
+	pthread_mutex_init(&fMutex, NULL);
+}
+
+
+THistogram::~THistogram(){
+	for (vector<vector<double>*>::iterator i = fAllBins.begin(); i != fAllBins.end(); i++)
+		delete *i;
+	pthread_key_delete(fThreadBins);
+	pthread_mutex_destroy(&fMutex);
+}
+
+
+double THistogram::Variable(unsigned int var, double t, const double y[6], double E){
+	switch (var){
+		case 0: return y[0];
+		case 1: return y[1];
+		case 2: return y[2];
+		case 3: return sqrt(y[0]*y[0] + y[1]*y[1]);
+		case 4: return atan2(y[1], y[0]);
+		case 5: return t;
+		case 6: return y[3];
+		case 7: return y[4];
+		case 8: return y[5];
+		case 9: return sqrt(y[3]*y[3] + y[4]*y[4] + y[5]*y[5]);
+		default: return E;
+	}
+}
+
+
+vector<double>& THistogram::ThreadBins(){
+	vector<double> *bins = (vector<double>*)pthread_getspecific(fThreadBins);
+	if (!bins){
+		bins = new vector<double>(2*fTotalBins, 0);
+		pthread_mutex_lock(&fMutex);
+		fAllBins.push_back(bins);
+		pthread_mutex_unlock(&fMutex);
+		pthread_setspecific(fThreadBins, bins);
+	}
+	return *bins;
+}
+
+
+void THistogram::AddToBin(vector<double> &bins, const double *values, double weight){
+	unsigned int index = 0;
+	for (unsigned int i = 0; i < fVariables.size(); i++){
+		if (values[i] < fMin[i] || values[i] >= fMax[i]) // ignore entries outside of histogram
+			return;
+		unsigned int bin = min(fBins[i] - 1, (unsigned int)((values[i] - fMin[i])/(fMax[i] - fMin[i])*fBins[i]));
+		index = index*fBins[i] + bin;
+	}
+	bins[index] += weight;
+	bins[fTotalBins + index] += weight*weight;
+}
+
+
+void THistogram::Fill(double t, const double y[6], double E, double weight){
+	double values[3];
+	for (unsigned int i = 0; i < fVariables.size(); i++)
+		values[i] = Variable(fVarIndex[i], t, y, E);
+	AddToBin(ThreadBins(), values, weight);
+}
+
+
+void THistogram::FillSegment(double t1, const double y1[6], double E1, double t2, const double y2[6], double E2, double weight){
+	double n = 1;
+	for (unsigned int i = 0; i < fVariables.size(); i++){ // find number of pieces, so each piece is shorter than half a bin
+		double d = Variable(fVarIndex[i], t2, y2, E2) - Variable(fVarIndex[i], t1, y1, E1);
+		if (fVarIndex[i] == HIST_PHI && abs(d) > pi) // azimuth wrapped around
+			d = 2*pi - abs(d);
+		n = max(n, ceil(2*abs(d)/(fMax[i] - fMin[i])*fBins[i]));
+	}
+	unsigned int pieces = (unsigned int)min(n, (double)MAX_HIST_SUBDIVISIONS);
+
+	if (quantity == DENSITY)
+		weight *= (t2 - t1)/pieces;
+	else
+		weight *= sqrt(pow(y2[0] - y1[0], 2) + pow(y2[1] - y1[1], 2) + pow(y2[2] - y1[2], 2))/pieces;
+
+	vector<double> &bins = ThreadBins();
+	double y[6], values[3];
+	for (unsigned int k = 0; k < pieces; k++){ // add center of each piece to histogram
+		double f = (k + 0.5)/pieces;
+		for (int j = 0; j < 6; j++)
+			y[j] = y1[j] + f*(y2[j] - y1[j]);
+		for (unsigned int i = 0; i < fVariables.size(); i++)
+			values[i] = Variable(fVarIndex[i], t1 + f*(t2 - t1), y, E1 + f*(E2 - E1));
+		AddToBin(bins, values, weight);
+	}
+}
+
+
+void THistogram::Write(const string &filename){
+	vector<double> sum(2*fTotalBins, 0);
+	pthread_mutex_lock(&fMutex);
+	for (vector<vector<double>*>::iterator i = fAllBins.begin(); i != fAllBins.end(); i++) // merge bins of all threads
+		for (unsigned int j = 0; j < sum.size(); j++)
+			sum[j] += (**i)[j];
+	pthread_mutex_unlock(&fMutex);
+
+	FILE *f = fopen(filename.c_str(), "wb");
+	if (!f){
+		cout << "Could not create " << filename << '\n';
+		exit(-1);
+	}
+	if (VERBOSE(VERBOSITY_SUMMARY))
+		cout << "Writing histogram " << filename << '\n';
+	uint32_t header[2] = {HIST_VERSION, (uint32_t)fVariables.size()};
+	fwrite(HIST_MAGIC, sizeof(HIST_MAGIC), 1, f);
+	fwrite(header, sizeof(header), 1, f);
+	const string *strings[2] = {&fQuantityName, &particlename};
+	for (int i = 0; i < 2; i++){
+		uint32_t len = strings[i]->size();
+		fwrite(&len, sizeof(len), 1, f);
+		fwrite(strings[i]->c_str(), 1, len, f);
+	}
+	for (unsigned int i = 0; i < fVariables.size(); i++){
+		uint32_t len = fVariables[i].size(), bins = fBins[i];
+		fwrite(&len, sizeof(len), 1, f);
+		fwrite(fVariables[i].c_str(), 1, len, f);
+		fwrite(&fMin[i], sizeof(double), 1, f);
+		fwrite(&fMax[i], sizeof(double), 1, f);
+		fwrite(&bins, sizeof(bins), 1, f);
+	}
+	fwrite(&sum[0], sizeof(double), sum.size(), f);
+	if (ferror(f) || fclose(f) != 0){
+		cout << "Could not write " << filename << '\n';
+		exit(-1);
+	}
+}
+
+
+bool THistogram::Add(const string &filename){
+	FILE *f = fopen(filename.c_str(), "rb");
+	if (!f)
+		return false;
+	char magic[8];
+	uint32_t header[2], len;
+	bool ok = fread(magic, sizeof(magic), 1, f) == 1 && memcmp(magic, HIST_MAGIC, sizeof(magic)) == 0 &&
+			fread(header, sizeof(header), 1, f) == 1 && header[0] == HIST_VERSION && header[1] == fVariables.size();
+	for (int i = 0; ok && i < 2; i++) // skip quantity and particle name
+		ok = fread(&len, sizeof(len), 1, f) == 1 && fseek(f, len, SEEK_CUR) == 0;
+	for (unsigned int i = 0; ok && i < fVariables.size(); i++){ // skip axis definitions, but check number of bins
+		uint32_t bins;
+		ok = fread(&len, sizeof(len), 1, f) == 1 && fseek(f, len + 2*sizeof(double), SEEK_CUR) == 0 &&
+				fread(&bins, sizeof(bins), 1, f) == 1 && bins == fBins[i];
+	}
+	vector<double> sum(2*fTotalBins);
+	ok = ok && fread(&sum[0], sizeof(double), sum.size(), f) == sum.size();
+	fclose(f);
+	if (!ok)
+		return false;
+	vector<double> &bins = ThreadBins();
+	for (unsigned int i = 0; i < sum.size(); i++)
+		bins[i] += sum[i];
+	return true;
+}
+
+
+THistograms::THistograms(map<string, string> &config){
+	for (map<string, string>::iterator i = config.begin(); i != config.end(); i++)
+		fHistograms.push_back(new THistogram(i->first, i->second));
+}
+
+
+THistograms::~THistograms(){
+	for (vector<THistogram*>::iterator i = fHistograms.begin(); i != fHistograms.end(); i++)
+		delete *i;
+}
+
+
+void THistograms::Fill(const char *particlename, THistogram::TQuantity quantity, double t, const double y[6], double E, double weight, int solid1, int solid2){
+	for (vector<THistogram*>::iterator i = fHistograms.begin(); i != fHistograms.end(); i++){
+		THistogram *h = *i;
+		if (h->quantity == quantity && (h->particlename == "all" || h->particlename == particlename)
+				&& (h->solid < 0 || h->solid == solid1 || h->solid == solid2))
+			h->Fill(t, y, E, weight);
+	}
+}
+
+
+void THistograms::FillSegment(const char *particlename, double t1, const double y1[6], double E1, double t2, const double y2[6], double E2, double weight){
+	for (vector<THistogram*>::iterator i = fHistograms.begin(); i != fHistograms.end(); i++){
+		THistogram *h = *i;
+		if ((h->quantity == THistogram::DENSITY || h->quantity == THistogram::PATHLENGTH) && (h->particlename == "all" || h->particlename == particlename))
+			h->FillSegment(t1, y1, E1, t2, y2, E2, weight);
+	}
+}
+
+
+void THistograms::Write(const string &fileprefix){
+	for (vector<THistogram*>::iterator i = fHistograms.begin(); i != fHistograms.end(); i++)
+		(*i)->Write(fileprefix + (*i)->name + ".hist");
+}
+
+
+void THistograms::Add(const string &fileprefix){
+	for (vector<THistogram*>::iterator i = fHistograms.begin(); i != fHistograms.end(); i++){
+		if (!(*i)->Add(fileprefix + (*i)->name + ".hist")){
+			cout << "Could not read " << fileprefix << (*i)->name << ".hist\n";
+			exit(-1);
+		}
+	}
+}
@@ -0,0 +1,217 @@
+/**
+ * \file
+ * Histograms filled during particle tracking, configured in the [HISTOGRAMS] section of config.in.
+ *
+ * Each histogram has one to three axes, each axis histograms one of the variables
+ * x, y, z [m], r [m], phi [rad] (cylindrical coordinates), t [s], vx, vy, vz, v [m/s] or E (kinetic energy) [eV].
+ *
+ * Histograms are written to binary files (*.hist) with the following layout:
+ *
+ * "PENTRKHS", uint32 version, uint32 number of axes, uint32 length + quantity, uint32 length + particle name,
+ * for each axis: uint32 length + variable name, float64 min, float64 max, uint32 number of bins,
+ * float64 sum of weights for each bin, float64 sum of squared weights for each bin (last axis running fastest)
+ */
+
+#ifndef HISTOGRAM_H_
+#define HISTOGRAM_H_
+
+#include <string>
+#include <vector>
+#include <map>
+
+#include <pthread.h>
+
+static const unsigned int MAX_HIST_SUBDIVISIONS = 1000; ///< max. number of pieces a track segment is divided into when filling a histogram
+
+
+/**
+ * Histogram with one to three axes.
+ *
+ * Each thread fills its own set of bins, which are summed up when the histogram is written.
+ */
+class THistogram{
+public:
+	/**
+	 * Events filling histograms
+	 */
+	enum TQuantity{
+		DENSITY, ///< track segments, weighted with time spent in each bin [s]
+		PATHLENGTH, ///< track segments, weighted with track length in each bin [m]
+		START, ///< start points of particles
+		END, ///< end points of particles
+		HITS, ///< material boundary hits
+		SPINFLIPS ///< spin flips
+	};
+
+	std::string name; ///< name of histogram, used in file name
+	std::string particlename; ///< only particles with this name fill the histogram ("all": all particles)
+	TQuantity quantity; ///< event type filling this histogram
+	int solid; ///< only hits on this solid fill the histogram (-1: all solids)
+
+private:
+	std::string fQuantityName; ///< quantity as given in config
+	std::vector<std::string> fVariables; ///< variable histogrammed on each axis
+	std::vector<unsigned int> fVarIndex; ///< index of variable histogrammed on each axis
+	std::vector<double> fMin; ///< lower edge of each axis
+	std::vector<double> fMax; ///< upper edge of each axis
+	std::vector<unsigned int> fBins; ///< number of bins of each axis
+	unsigned int fTotalBins; ///< total number of bins
+	pthread_key_t fThreadBins; ///< bins of current thread
+	std::vector<std::vector<double>*> fAllBins; ///< bins of all threads, sum of weights followed by sum of squared weights
+	pthread_mutex_t fMutex; ///< mutex protecting THistogram::fAllBins
+
+	/**
+	 * Calculate value of a variable
+	 *
+	 * @param var Index of variable
+	 * @param t Time
+	 * @param y State vector
+	 * @param E Kinetic energy
+	 *
+	 * @return Returns value of variable
+	 */
+	double Variable(unsigned int var, double t, const double y[6], double E);
+
+	/**
+	 * Get bins of current thread, creates them if necessary
+	 *
+	 * @return Returns reference to sums of weights followed by sums of squared weights
+	 */
+	std::vector<double>& ThreadBins();
+
+	/**
+	 * Add weight to bin
+	 *
+	 * @param bins Bins of current thread
+	 * @param values Values of all variables
+	 * @param weight Weight added to bin
+	 */
+	void AddToBin(std::vector<double> &bins, const double *values, double weight);
+
+public:
+	/**
+	 * Constructor, parses histogram definition.
+	 *
+	 * Exits program if definition is invalid.
+	 *
+	 * @param aname Name of histogram
+	 * @param definition Definition from config.in: particle name, quantity and one to three axes variable:min:max:bins
+	 */
+	THistogram(const std::string &aname, const std::string &definition);
+
+	/**
+	 * Destructor, deletes bins
+	 */
+	~THistogram();
+
+	/**
+	 * Add weight at a single point
+	 *
+	 * @param t Time
+	 * @param y State vector
+	 * @param E Kinetic energy
+	 * @param weight Weight added to bin
+	 */
+	void Fill(double t, const double y[6], double E, double weight = 1);
+
+	/**
+	 * Add track segment.
+	 *
+	 * The segment is divided into pieces shorter than half a bin in every variable (at most ::MAX_HIST_SUBDIVISIONS),
+	 * each piece adds its time or length, multiplied by weight, to the bin in which its center lies.
+	 *
+	 * @param t1 Start time of segment
+	 * @param y1 Start state vector of segment
+	 * @param E1 Start kinetic energy of segment
+	 * @param t2 End time of segment
+	 * @param y2 End state vector of segment
+	 * @param E2 End kinetic energy of segment
+	 * @param weight Statistical weight of particle
+	 */
+	void FillSegment(double t1, const double y1[6], double E1, double t2, const double y2[6], double E2, double weight = 1);
+
+	/**
+	 * Sum up bins of all threads and write them to binary file.
+	 *
+	 * @param filename Name of file
+	 */
+	void Write(const std::string &filename);
+
+	/**
+	 * Add bins of a histogram file written by THistogram::Write to the bins of the current thread.
+	 *
+	 * @param filename Name of file, it has to contain the same number of bins
+	 *
+	 * @return Returns false if file could not be read or has a different number of bins
+	 */
+	bool Add(const std::string &filename);
+};
+
+
+/**
+ * All histograms defined in config.in.
+ */
+class THistograms{
+private:
+	std::vector<THistogram*> fHistograms; ///< list of histograms
+public:
+	/**
+	 * Constructor, creates histograms from [HISTOGRAMS] section of config.in
+	 *
+	 * @param config Map of histogram names and definitions
+	 */
+	THistograms(std::map<std::string, std::string> &config);
+
+	/**
+	 * Destructor, deletes histograms
+	 */
+	~THistograms();
+
+	/**
+	 * Add weight at a single point to all histograms of a quantity
+	 *
+	 * @param particlename Name of particle
+	 * @param quantity Quantity
+	 * @param t Time
+	 * @param y State vector
+	 * @param E Kinetic energy
+	 * @param weight Statistical weight of particle
+	 * @param solid1 ID of first solid involved (only used for THistogram::HITS)
+	 * @param solid2 ID of second solid involved (only used for THistogram::HITS)
+	 */
+	void Fill(const char *particlename, THistogram::TQuantity quantity, double t, const double y[6], double E, double weight = 1, int solid1 = -1, int solid2 = -1);
+
+	/**
+	 * Add track segment to all density and path length histograms
+	 *
+	 * @param particlename Name of particle
+	 * @param t1 Start time of segment
+	 * @param y1 Start state vector of segment
+	 * @param E1 Start kinetic energy of segment
+	 * @param t2 End time of segment
+	 * @param y2 End state vector of segment
+	 * @param E2 End kinetic energy of segment
+	 * @param weight Statistical weight of particle
+	 */
+	void FillSegment(const char *particlename, double t1, const double y1[6], double E1, double t2, const double y2[6], double E2, double weight = 1);
+
+	/**
+	 * Write all histograms to binary files
+	 *
+	 * @param fileprefix Prefix of file names, histogram name and ".hist" are appended
+	 */
+	void Write(const std::string &fileprefix);
+
+	/**
+	 * Add bins of histogram files written by THistograms::Write, e.g. by other processes
+	 *
+	 * Exits program if a file cannot be read.
+	 *
+	 * @param fileprefix Prefix of file names, histogram name and ".hist" are appended
+	 */
+	void Add(const std::string &fileprefix);
+};
+
+extern THistograms *histograms; ///< histograms defined in config.in, NULL if there are none
+
+#endif /* HISTOGRAM_H_ */
@@ -0,0 +1,168 @@
+/**
+ * \file
+ * Producer of particle initial conditions.
+ * Initial conditions can be created just before tracking, ahead of time in separate threads or be read from a binary file.
+ */
+
+#include <cstring>
+#include <iostream>
+
+#include "icproducer.h"
+#include "globals.h"
+
+static const char IC_FILE_MAGIC[8] = {'P','E','N','T','R','K','I','C'}; ///< identifies initial-conditions files
+static const int IC_FILE_VERSION = 2; ///< version of initial-conditions file format
+static const unsigned int IC_FILE_BLOCK = 4096; ///< number of initial conditions read from file at once
+
+
+TInitialConditionProducer::TInitialConditionProducer(TSource &source, TGeometry &geometry, TFieldManager *field, TMCGenerator &mc, int count, int nthreads, int queuesize,
+		const string &icfile, int icfirst)
+		: fSource(source), fGeometry(geometry), fField(field), fMC(mc), fCount(count), fConsumed(0),
+		  fQueue(max(1, queuesize)), fFilled(max(1, queuesize), false), fNThreads(0), fStartedThreads(0), fStop(false), fICFile(NULL), fFileBufferPos(0){
+	pthread_mutex_init(&fMutex, NULL);
+	pthread_cond_init(&fNotEmpty, NULL);
+	pthread_cond_init(&fNotFull, NULL);
+
+	if (!icfile.empty()){
+		fICFile = fopen(icfile.c_str(), "rb");
+		char magic[8];
+		int header[2];
+		if (!fICFile || fread(magic, sizeof(magic), 1, fICFile) != 1 || fread(header, sizeof(header), 1, fICFile) != 1 ||
+				memcmp(magic, IC_FILE_MAGIC, sizeof(magic)) != 0 || header[0] != IC_FILE_VERSION || header[1] != (int)sizeof(TInitialCondition) ||
+				fseek(fICFile, (long)icfirst*sizeof(TInitialCondition), SEEK_CUR) != 0){
+			cout << "Could not read initial conditions from " << icfile << "!\n";
+			exit(-1);
+		}
+		cout << "Reading initial conditions from " << icfile << '\n';
+		return;
+	}
+
+	fNThreads = nthreads;
+	for (int i = 0; i < nthreads; i++)
+		fThreadMC.push_back(new TMCGenerator(mc, TMCGenerator::StreamSeed(mc.seed, i))); // independent random number streams for each thread
+	fThreads.reserve(nthreads);
+	for (int i = 0; i < nthreads; i++){
+		pthread_t thread;
+		if (pthread_create(&thread, NULL, &ProducerThread, this) != 0){
+			cout << "Could not start producer thread!\n";
+			exit(-1);
+		}
+		fThreads.push_back(thread);
+	}
+	if (nthreads > 0)
+		cout << "Started " << nthreads << " producer thread(s)\n";
+}
+
+
+TInitialConditionProducer::~TInitialConditionProducer(){
+	pthread_mutex_lock(&fMutex);
+	fStop = true;
+	pthread_cond_broadcast(&fNotFull);
+	pthread_mutex_unlock(&fMutex);
+	for (vector<pthread_t>::iterator i = fThreads.begin(); i != fThreads.end(); i++)
+		pthread_join(*i, NULL);
+	for (vector<TMCGenerator*>::iterator i = fThreadMC.begin(); i != fThreadMC.end(); i++)
+		delete *i;
+	if (fICFile)
+		fclose(fICFile);
+	pthread_cond_destroy(&fNotFull);
+	pthread_cond_destroy(&fNotEmpty);
+	pthread_mutex_destroy(&fMutex);
+}
+
+
+void* TInitialConditionProducer::ProducerThread(void *producer){
+	TInitialConditionProducer *p = (TInitialConditionProducer*)producer;
+	pthread_mutex_lock(&p->fMutex);
+	int stream = p->fStartedThreads++; // random number generator and initial conditions of a stream do not depend on the order in which threads start
+	pthread_mutex_unlock(&p->fMutex);
+	p->Produce(*p->fThreadMC[stream], stream);
+	return NULL;
+}
+
+
+void TInitialConditionProducer::Produce(TMCGenerator &mc, int stream){
+	for (int k = stream; k < fCount; k += fNThreads){
+		pthread_mutex_lock(&fMutex);
+		while (!fStop && k >= fConsumed + (int)fQueue.size()) // wait until slot of initial condition k is free
+			pthread_cond_wait(&fNotFull, &fMutex);
+		bool stop = fStop;
+		pthread_mutex_unlock(&fMutex);
+		if (stop)
+			return;
+
+		TInitialCondition ic;
+		fSource.source->RandomInitialCondition(mc, fGeometry, fField, ic);
+
+		pthread_mutex_lock(&fMutex);
+		fQueue[k % fQueue.size()] = ic;
+		fFilled[k % fQueue.size()] = true;
+		pthread_cond_signal(&fNotEmpty);
+		pthread_mutex_unlock(&fMutex);
+	}
+}
+
+
+bool TInitialConditionProducer::ReadNext(TInitialCondition &ic){
+	if (fFileBufferPos >= fFileBuffer.size()){
+		fFileBuffer.resize(IC_FILE_BLOCK);
+		fFileBuffer.resize(fread(&fFileBuffer[0], sizeof(TInitialCondition), IC_FILE_BLOCK, fICFile));
+		fFileBufferPos = 0;
+		if (fFileBuffer.empty())
+			return false;
+	}
+	ic = fFileBuffer[fFileBufferPos++];
+	return true;
+}
+
+
+bool TInitialConditionProducer::Next(TInitialCondition &ic){
+	if (fConsumed >= fCount)
+		return false;
+	if (fICFile){
+		if (!ReadNext(ic)){
+			cout << "Initial-conditions file contained only " << fConsumed << " particles!\n";
+			return false;
+		}
+	}
+	else if (fThreads.empty())
+		fSource.source->RandomInitialCondition(fMC, fGeometry, fField, ic);
+	else{
+		pthread_mutex_lock(&fMutex);
+		unsigned int slot = fConsumed % fQueue.size();
+		while (!fFilled[slot]) // return initial conditions in order of their index
+			pthread_cond_wait(&fNotEmpty, &fMutex);
+		ic = fQueue[slot];
+		fFilled[slot] = false;
+		fConsumed++;
+		pthread_cond_broadcast(&fNotFull); // threads wait for different slots
+		pthread_mutex_unlock(&fMutex);
+		return true;
+	}
+	fConsumed++;
+	return true;
+}
+
+
+void TInitialConditionProducer::WriteFile(const string &filename){
+	FILE *f = fopen(filename.c_str(), "wb");
+	if (!f){
+		cout << "Could not open " << filename << "!\n";
+		exit(-1);
+	}
+	cout << "Writing initial conditions to " << filename << '\n';
+	int header[2] = {IC_FILE_VERSION, (int)sizeof(TInitialCondition)};
+	fwrite(IC_FILE_MAGIC, sizeof(IC_FILE_MAGIC), 1, f);
+	fwrite(header, sizeof(header), 1, f);
+	int lastprint = 0, n = 0;
+	TInitialCondition ic;
+	while (Next(ic)){
+		if (fwrite(&ic, sizeof(ic), 1, f) != 1){
+			cout << "Could not write to " << filename << "!\n";
+			exit(-1);
+		}
+		PrintPercent(++n/(double)fCount, lastprint);
+	}
+	fclose(f);
+	cout << '\n' << n << " initial conditions written\n";
+}
@@ -0,0 +1,117 @@
+/**
+ * \file
+ * Producer of particle initial conditions.
+ * Initial conditions can be created just before tracking, ahead of time in separate threads or be read from a binary file.
+ */
+
+#ifndef ICPRODUCER_H_
+#define ICPRODUCER_H_
+
+#include <string>
+#include <vector>
+#include <cstdio>
+
+#include <pthread.h>
+
+#include "source.h"
+#include "mc.h"
+
+using namespace std;
+
+/**
+ * Creates initial conditions of primary particles for the main tracking loop.
+ *
+ * If nthreads is zero, initial conditions are created by the source in the calling thread when TInitialConditionProducer::Next is called.
+ * Otherwise, nthreads threads, each with its own random number generator, fill a bounded queue ahead of time.
+ * Producer thread i creates the initial conditions i, i + nthreads, i + 2*nthreads, ... with a random seed derived from seed and i by splitmix64 mixing,
+ * and they are returned in this order, so a run with the same seed and number of producer threads is reproducible.
+ * If an initial-conditions file is given, initial conditions are read from this file instead.
+ * Such files are created by TInitialConditionProducer::WriteFile.
+ */
+class TInitialConditionProducer{
+private:
+	TSource &fSource; ///< Source creating initial conditions
+	TGeometry &fGeometry; ///< Experiment geometry
+	TFieldManager *fField; ///< Optional fields (can be NULL)
+	TMCGenerator &fMC; ///< Random number generator used if no producer threads are running
+	int fCount; ///< Number of initial conditions which should be produced
+	int fConsumed; ///< Number of initial conditions returned by TInitialConditionProducer::Next
+	vector<TInitialCondition> fQueue; ///< Ring buffer of initial conditions created by producer threads, initial condition k is stored in slot k % fQueue.size()
+	vector<char> fFilled; ///< Marks slots of fQueue which contain an initial condition that was not returned yet
+	int fNThreads; ///< Number of producer threads
+	vector<pthread_t> fThreads; ///< Producer threads
+	vector<TMCGenerator*> fThreadMC; ///< Independent random number generators for each producer thread
+	unsigned int fStartedThreads; ///< Number of producer threads which already took their random number generator
+	bool fStop; ///< Tells producer threads to stop
+	pthread_mutex_t fMutex; ///< Mutex protecting queue and counters
+	pthread_cond_t fNotEmpty; ///< Signaled when an initial condition was added to the queue
+	pthread_cond_t fNotFull; ///< Signaled when an initial condition was taken from the queue
+	FILE *fICFile; ///< Binary file containing initial conditions, if they should be replayed
+	vector<TInitialCondition> fFileBuffer; ///< Block of initial conditions read from file
+	unsigned int fFileBufferPos; ///< Position of next initial condition in file buffer
+
+	/**
+	 * Thread routine, calls TInitialConditionProducer::Produce
+	 *
+	 * @param producer Pointer to TInitialConditionProducer
+	 * @return Returns NULL
+	 */
+	static void* ProducerThread(void *producer);
+
+	/**
+	 * Create initial conditions stream, stream + fNThreads, ... and add them to queue until TInitialConditionProducer::fCount is reached.
+	 *
+	 * @param mc Random number generator of this thread
+	 * @param stream Index of this thread
+	 */
+	void Produce(TMCGenerator &mc, int stream);
+
+	/**
+	 * Read next initial condition from initial-conditions file
+	 *
+	 * @param ic Returns initial condition
+	 *
+	 * @return Returns false if end of file was reached
+	 */
+	bool ReadNext(TInitialCondition &ic);
+public:
+	/**
+	 * Constructor, starts producer threads or opens initial-conditions file.
+	 *
+	 * @param source Source creating initial conditions
+	 * @param geometry Experiment geometry
+	 * @param field Optional fields (can be NULL)
+	 * @param mc Random number generator, its particle configurations are copied into the generators of the producer threads, whose seeds are derived from its seed
+	 * @param count Number of initial conditions to produce
+	 * @param nthreads Number of producer threads, if zero initial conditions are created on demand
+	 * @param queuesize Max. number of initial conditions stored in queue
+	 * @param icfile Initial conditions are read from this file, if it is not empty
+	 * @param icfirst Number of initial conditions skipped at the beginning of icfile
+	 */
+	TInitialConditionProducer(TSource &source, TGeometry &geometry, TFieldManager *field, TMCGenerator &mc, int count, int nthreads, int queuesize, const string &icfile, int icfirst = 0);
+
+	/**
+	 * Destructor, stops producer threads and closes initial-conditions file
+	 */
+	~TInitialConditionProducer();
+
+	/**
+	 * Get next initial condition.
+	 *
+	 * Blocks until a producer thread has created one, if necessary.
+	 *
+	 * @param ic Returns initial condition
+	 *
+	 * @return Returns false if all initial conditions have been returned already
+	 */
+	bool Next(TInitialCondition &ic);
+
+	/**
+	 * Write all remaining initial conditions into a binary file
+	 *
+	 * @param filename Name of initial-conditions file
+	 */
+	void WriteFile(const string &filename);
+};
+
+#endif /* ICPRODUCER_H_ */
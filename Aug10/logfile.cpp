@@ -0,0 +1,558 @@
+/**
+ * \file
+ * Log files with named columns, written as text or in a binary columnar format.
+ */
+
+#include <iostream>
+#include <sstream>
+#include <cstring>
+#include <cstdlib>
+#include <deque>
+#include <stdint.h>
+
+#include "logfile.h"
+
+using namespace std;
+
+bool binarylog = false;
+bool logthread = true;
+double logbuffer = 64;
+bool binaryfloat = false;
+
+static const char LOG_MAGIC[8] = {'P','E','N','T','R','K','B','C'}; ///< identifies binary log files
+static const char LOG_BLOCK_MAGIC[4] = {'B','L','C','K'}; ///< identifies blocks in binary log files
+static const char LOG_INDEX_MAGIC[4] = {'I','N','D','X'}; ///< identifies block index in binary log files
+static const uint32_t LOG_VERSION = 2; ///< version of binary log file format
+static const unsigned int LOG_BLOCK_SIZE = 1 << 20; ///< approximate size of binary blocks [bytes]
+static const unsigned int LOG_BUFFER_SIZE = 1 << 22; ///< size of write buffer of log files [bytes]
+static const unsigned int LOG_CHUNK_SIZE = 1 << 16; ///< approximate size of chunks handed to writer thread [bytes]
+
+
+/**
+ * Write one column of a block of rows to a binary file
+ *
+ * @param f Binary file
+ * @param rows Values of rows, row by row
+ * @param ncols Number of columns
+ * @param col Index of column
+ * @param nrows Number of rows
+ */
+template<typename T> static void WriteColumn(FILE *f, const vector<double> &rows, unsigned int ncols, unsigned int col, unsigned int nrows){
+	vector<T> column(nrows);
+	for (unsigned int i = 0; i < nrows; i++)
+		column[i] = (T)rows[i*ncols + col];
+	if (nrows > 0)
+		fwrite(&column[0], sizeof(T), nrows, f);
+}
+
+
+/**
+ * Read one column of a block of rows from a binary file
+ *
+ * @param f Binary file
+ * @param rows Values of rows, row by row, the column's values are stored in it
+ * @param ncols Number of columns
+ * @param col Index of column
+ * @param nrows Number of rows
+ *
+ * @return Returns false if column could not be read
+ */
+template<typename T> static bool ReadColumn(FILE *f, vector<double> &rows, unsigned int ncols, unsigned int col, unsigned int nrows){
+	vector<T> column(nrows);
+	if (nrows > 0 && fread(&column[0], sizeof(T), nrows, f) != nrows)
+		return false;
+	for (unsigned int i = 0; i < nrows; i++)
+		rows[i*ncols + col] = column[i];
+	return true;
+}
+
+
+/**
+ * Writer thread shared by all log files.
+ *
+ * Its state is allocated on first use and never destroyed, so static TLogFiles can still be closed during program exit.
+ */
+class TLogWriter{
+private:
+	/**
+	 * Chunk of rows handed to writer thread
+	 */
+	struct TChunk{
+		TLogFile *file; ///< file to write to
+		std::vector<double> rows; ///< values of rows, row by row
+		bool close; ///< close file after writing rows
+	};
+	static pthread_mutex_t fMutex; ///< mutex protecting queue, counters and TLogFile::fClosed/TLogFile::fError
+	static pthread_cond_t fNotEmpty; ///< signaled when a chunk was added to the queue
+	static pthread_cond_t fWritten; ///< signaled when a chunk was written
+	static std::deque<TChunk> *fQueue; ///< chunks waiting to be written
+	static unsigned long long fQueuedBytes; ///< amount of data in queue
+
+	/**
+	 * Thread routine, writes chunks in the order they were queued
+	 *
+	 * @return Returns NULL
+	 */
+	static void* WriterThread(void*){
+		for (;;){
+			pthread_mutex_lock(&fMutex);
+			while (fQueue->empty())
+				pthread_cond_wait(&fNotEmpty, &fMutex);
+			TChunk chunk;
+			std::swap(chunk, fQueue->front());
+			fQueue->pop_front();
+			pthread_mutex_unlock(&fMutex);
+
+			TLogFile *f = chunk.file;
+			pthread_mutex_lock(&fMutex);
+			bool ok = f->fError.empty();
+			pthread_mutex_unlock(&fMutex);
+			if (ok && (!chunk.rows.empty() || chunk.close)) // also create files which are closed without any rows
+				ok = f->WriteRows(chunk.rows.empty() ? NULL : &chunk.rows[0], chunk.rows.size());
+			bool created = f->fText.is_open() || f->fBinaryFile;
+			if (ok && chunk.close)
+				ok = f->CloseFile();
+
+			pthread_mutex_lock(&fMutex);
+			fQueuedBytes -= chunk.rows.size()*sizeof(double);
+			if (!ok && f->fError.empty())
+				f->fError = (created ? "Could not write to " : "Could not create ") + f->fFilename;
+			if (chunk.close)
+				f->fClosed = true;
+			pthread_cond_broadcast(&fWritten);
+			pthread_mutex_unlock(&fMutex);
+		}
+		return NULL;
+	}
+
+public:
+	/**
+	 * Hand rows to writer thread, starts the thread if necessary.
+	 *
+	 * Waits while more than ::logbuffer MB are queued.
+	 * Exits program if writer thread reported an error for this file.
+	 *
+	 * @param file File to write to
+	 * @param rows Values of rows, emptied by this function
+	 * @param close Close file after writing rows and wait until this has happened
+	 */
+	static void Submit(TLogFile *file, std::vector<double> &rows, bool close){
+		pthread_mutex_lock(&fMutex);
+		if (!fQueue){
+			fQueue = new std::deque<TChunk>;
+			pthread_t thread;
+			if (pthread_create(&thread, NULL, &WriterThread, NULL) != 0){
+				cout << "Could not start log writer thread!\n";
+				exit(-1);
+			}
+			pthread_detach(thread);
+		}
+		while (fQueuedBytes > 0 && fQueuedBytes + rows.size()*sizeof(double) > logbuffer*1024*1024 && file->fError.empty())
+			pthread_cond_wait(&fWritten, &fMutex); // backpressure: wait for writer thread to catch up
+		if (file->fError.empty()){
+			fQueue->push_back(TChunk());
+			fQueue->back().file = file;
+			fQueue->back().rows.swap(rows);
+			fQueue->back().close = close;
+			fQueuedBytes += fQueue->back().rows.size()*sizeof(double);
+			pthread_cond_signal(&fNotEmpty);
+			while (close && !file->fClosed && file->fError.empty())
+				pthread_cond_wait(&fWritten, &fMutex);
+		}
+		std::string error = file->fError;
+		pthread_mutex_unlock(&fMutex);
+		if (!error.empty()){
+			file->fOpened = false;
+			cout << error << '\n';
+			exit(-1);
+		}
+	}
+};
+
+pthread_mutex_t TLogWriter::fMutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t TLogWriter::fNotEmpty = PTHREAD_COND_INITIALIZER;
+pthread_cond_t TLogWriter::fWritten = PTHREAD_COND_INITIALIZER;
+std::deque<TLogWriter::TChunk> *TLogWriter::fQueue = NULL;
+unsigned long long TLogWriter::fQueuedBytes = 0;
+
+
+TLogFile::TLogFile(): fOpened(false), fAsync(false), fClosed(false), fBinary(false), fBinaryFile(NULL), fDeferred(false), fDeferredMax(0), fSpill(NULL){
+
+}
+
+
+TLogFile::~TLogFile(){
+	DiscardDeferred();
+	Close();
+}
+
+
+void TLogFile::Open(const string &filename, const string &columns, bool singleprecision){
+	fBinary = binarylog;
+	fAsync = logthread;
+	fFilename = filename;
+	if (fBinary && fFilename.size() >= 4 && fFilename.compare(fFilename.size() - 4, 4, ".out") == 0)
+		fFilename.replace(fFilename.size() - 4, 4, ".bin");
+	if (VERBOSE(VERBOSITY_SUMMARY))
+		cout << "Creating " << fFilename << '\n';
+
+	fNames.clear();
+	fTypes.clear();
+	istringstream cols(columns);
+	string name;
+	while (cols >> name){
+		char type = (singleprecision && binaryfloat) ? 'f' : 'd';
+		string::size_type suffix = name.find(':');
+		if (suffix != string::npos){ // explicit column type
+			type = (suffix + 1 < name.size()) ? name[suffix + 1] : ' ';
+			name.erase(suffix);
+			if (string("bdfiq").find(type) == string::npos){
+				cout << "Unknown type of column " << name << " in " << fFilename << "!\n";
+				exit(-1);
+			}
+		}
+		fNames.push_back(name);
+		fTypes.push_back(type);
+	}
+	fOpened = true;
+	fClosed = false;
+	if (!fAsync && !CreateFile()){
+		cout << "Could not create " << fFilename << '\n';
+		exit(-1);
+	}
+}
+
+
+bool TLogFile::CreateFile(){
+	if (fBinary){
+		fBinaryFile = fopen(fFilename.c_str(), "wb");
+		if (!fBinaryFile)
+			return false;
+		fBuffer.resize(LOG_BUFFER_SIZE);
+		setvbuf(fBinaryFile, &fBuffer[0], _IOFBF, fBuffer.size());
+		uint32_t header[2] = {LOG_VERSION, (uint32_t)fNames.size()};
+		fwrite(LOG_MAGIC, sizeof(LOG_MAGIC), 1, fBinaryFile);
+		fwrite(header, sizeof(header), 1, fBinaryFile);
+		for (unsigned int i = 0; i < fNames.size(); i++){
+			uint32_t len = fNames[i].size();
+			fwrite(&fTypes[i], 1, 1, fBinaryFile);
+			fwrite(&len, sizeof(len), 1, fBinaryFile);
+			fwrite(fNames[i].c_str(), 1, len, fBinaryFile);
+		}
+	}
+	else{
+		if (fAsync){ // writer thread can use a large buffer
+			fBuffer.resize(LOG_BUFFER_SIZE);
+			fText.rdbuf()->pubsetbuf(&fBuffer[0], fBuffer.size());
+		}
+		fText.clear(); // file may be reopened after TLogFile::Close
+		fText.open(fFilename.c_str());
+		if (!fText.is_open())
+			return false;
+		for (unsigned int i = 0; i < fNames.size(); i++)
+			fText << (i > 0 ? " " : "") << fNames[i];
+		fText << '\n';
+		fText.precision(10);
+	}
+	return true;
+}
+
+
+void TLogFile::Close(){
+	if (!fOpened)
+		return;
+	if (fAsync)
+		Submit(true);
+	else if (!CloseFile()){
+		cout << "Could not write to " << fFilename << '\n';
+		exit(-1);
+	}
+	fOpened = false;
+	fRow.clear();
+}
+
+
+bool TLogFile::CloseFile(){
+	bool ok = true;
+	if (fBinaryFile){
+		ok = WriteBlock();
+		unsigned long long footer = ftell(fBinaryFile);
+		uint32_t nblocks = fIndex.size();
+		fwrite(LOG_INDEX_MAGIC, sizeof(LOG_INDEX_MAGIC), 1, fBinaryFile);
+		fwrite(&nblocks, sizeof(nblocks), 1, fBinaryFile);
+		for (unsigned int i = 0; i < fIndex.size(); i++){
+			uint64_t entry[2] = {fIndex[i].first, fIndex[i].second};
+			fwrite(entry, sizeof(entry), 1, fBinaryFile);
+		}
+		uint64_t footeroffset = footer;
+		fwrite(&footeroffset, sizeof(footeroffset), 1, fBinaryFile);
+		fwrite(LOG_MAGIC, sizeof(LOG_MAGIC), 1, fBinaryFile);
+		ok &= (fclose(fBinaryFile) == 0);
+		fBinaryFile = NULL;
+		fIndex.clear();
+	}
+	if (fText.is_open()){
+		fText.close();
+		ok &= !fText.fail();
+	}
+	return ok;
+}
+
+
+void TLogFile::Submit(bool close){
+	TLogWriter::Submit(this, fChunk, close);
+	fChunk.clear();
+}
+
+
+void TLogFile::WriteRow(){
+	if (fRow.size() != fTypes.size()){
+		cout << "Wrong number of columns (" << fRow.size() << " instead of " << fTypes.size() << ") written to " << fFilename << "!\n";
+		exit(-1);
+	}
+	if (fDeferred){
+		fDeferredRows.insert(fDeferredRows.end(), fRow.begin(), fRow.end());
+		if (fDeferredRows.size() >= (unsigned long long)fDeferredMax*fTypes.size()){ // move rows into temporary file
+			if (!fSpill)
+				fSpill = tmpfile();
+			if (!fSpill || fwrite(&fDeferredRows[0], sizeof(double), fDeferredRows.size(), fSpill) != fDeferredRows.size()){
+				cout << "Could not write temporary file for " << fFilename << '\n';
+				exit(-1);
+			}
+			fDeferredRows.clear();
+		}
+	}
+	else
+		AppendRows(&fRow[0], fRow.size());
+	fRow.clear();
+}
+
+
+void TLogFile::AppendRows(const double *rows, unsigned int count){
+	if (fAsync){
+		fChunk.insert(fChunk.end(), rows, rows + count);
+		if (fChunk.size()*sizeof(double) >= LOG_CHUNK_SIZE)
+			Submit(false);
+	}
+	else if (!WriteRows(rows, count)){
+		cout << "Could not write to " << fFilename << '\n';
+		exit(-1);
+	}
+}
+
+
+void TLogFile::BeginDeferred(unsigned int maxrows){
+	DiscardDeferred();
+	fDeferred = true;
+	fDeferredMax = max(1u, maxrows);
+}
+
+
+void TLogFile::CommitDeferred(){
+	if (fSpill){
+		rewind(fSpill);
+		vector<double> rows(max((size_t)1, fTypes.size())*1024);
+		size_t count;
+		while ((count = fread(&rows[0], sizeof(double), rows.size(), fSpill)) > 0)
+			AppendRows(&rows[0], count);
+	}
+	if (!fDeferredRows.empty())
+		AppendRows(&fDeferredRows[0], fDeferredRows.size());
+	DiscardDeferred();
+}
+
+
+void TLogFile::DiscardDeferred(){
+	fDeferred = false;
+	fDeferredRows.clear();
+	if (fSpill){
+		fclose(fSpill);
+		fSpill = NULL;
+	}
+}
+
+
+bool TLogFile::WriteRows(const double *rows, unsigned int count){
+	if (!fText.is_open() && !fBinaryFile && !CreateFile())
+		return false;
+	unsigned int ncols = fTypes.size();
+	if (fBinary){
+		fBlock.insert(fBlock.end(), rows, rows + count);
+		if (fBlock.size()*sizeof(double) >= LOG_BLOCK_SIZE)
+			return WriteBlock();
+	}
+	else{
+		for (unsigned int i = 0; i < count; i++){
+			if (i % ncols > 0)
+				fText << ' ';
+			if (LogIntegerType(fTypes[i % ncols]))
+				fText << (long long)rows[i];
+			else
+				fText << rows[i];
+			if (i % ncols == ncols - 1)
+				fText << '\n';
+		}
+		return !fText.fail();
+	}
+	return true;
+}
+
+
+bool TLogFile::WriteBlock(){
+	unsigned int ncols = fTypes.size();
+	if (fBlock.empty() || ncols == 0)
+		return true;
+	uint32_t nrows = fBlock.size()/ncols;
+	fIndex.push_back(make_pair((unsigned long long)ftell(fBinaryFile), (unsigned long long)nrows));
+	fwrite(LOG_BLOCK_MAGIC, sizeof(LOG_BLOCK_MAGIC), 1, fBinaryFile);
+	fwrite(&nrows, sizeof(nrows), 1, fBinaryFile);
+	for (unsigned int j = 0; j < ncols; j++){ // transpose rows into columns
+		switch (fTypes[j]){
+			case 'b': WriteColumn<int8_t>(fBinaryFile, fBlock, ncols, j, nrows); break;
+			case 'i': WriteColumn<int32_t>(fBinaryFile, fBlock, ncols, j, nrows); break;
+			case 'q': WriteColumn<int64_t>(fBinaryFile, fBlock, ncols, j, nrows); break;
+			case 'f': WriteColumn<float>(fBinaryFile, fBlock, ncols, j, nrows); break;
+			default: WriteColumn<double>(fBinaryFile, fBlock, ncols, j, nrows); break;
+		}
+	}
+	fBlock.clear();
+	return !ferror(fBinaryFile);
+}
+
+
+TLogFileReader::TLogFileReader(const string &filename): fFile(NULL), fNextBlock(0), fNextOffset(0){
+	fFile = fopen(filename.c_str(), "rb");
+	char magic[8];
+	uint32_t header[2];
+	if (!fFile || fread(magic, sizeof(magic), 1, fFile) != 1 || memcmp(magic, LOG_MAGIC, sizeof(magic)) != 0 ||
+			fread(header, sizeof(header), 1, fFile) != 1 || header[0] < 1 || header[0] > LOG_VERSION){
+		cout << filename << " is not a binary log file!\n";
+		exit(-1);
+	}
+	for (uint32_t i = 0; i < header[1]; i++){
+		char type;
+		uint32_t len;
+		if (fread(&type, 1, 1, fFile) != 1 || fread(&len, sizeof(len), 1, fFile) != 1){
+			cout << "Could not read header of " << filename << "!\n";
+			exit(-1);
+		}
+		string name(len, ' ');
+		if (len > 0 && fread(&name[0], 1, len, fFile) != len){
+			cout << "Could not read header of " << filename << "!\n";
+			exit(-1);
+		}
+		if (header[0] == 1 && type == 'i') // integer columns of version 1 are int64
+			type = 'q';
+		if (string("bdfiq").find(type) == string::npos){
+			cout << "Unknown type of column " << name << " in " << filename << "!\n";
+			exit(-1);
+		}
+		columns.push_back(name);
+		types.push_back(type);
+	}
+	fNextOffset = ftell(fFile);
+
+	uint64_t footeroffset;
+	char nblocksmagic[4];
+	uint32_t nblocks;
+	if (fseek(fFile, -(long)(sizeof(footeroffset) + sizeof(magic)), SEEK_END) == 0 &&
+			fread(&footeroffset, sizeof(footeroffset), 1, fFile) == 1 && fread(magic, sizeof(magic), 1, fFile) == 1 && memcmp(magic, LOG_MAGIC, sizeof(magic)) == 0 &&
+			fseek(fFile, footeroffset, SEEK_SET) == 0 && fread(nblocksmagic, sizeof(nblocksmagic), 1, fFile) == 1 &&
+			memcmp(nblocksmagic, LOG_INDEX_MAGIC, sizeof(nblocksmagic)) == 0 && fread(&nblocks, sizeof(nblocks), 1, fFile) == 1){
+		for (uint32_t i = 0; i < nblocks; i++){
+			uint64_t entry[2];
+			if (fread(entry, sizeof(entry), 1, fFile) != 1)
+				break;
+			fIndex.push_back(make_pair(entry[0], entry[1]));
+		}
+	}
+	else
+		cerr << filename << " has no block index, reading blocks sequentially\n";
+}
+
+
+TLogFileReader::~TLogFileReader(){
+	if (fFile)
+		fclose(fFile);
+}
+
+
+unsigned long long TLogFileReader::ReadBlock(vector<double> &rows){
+	long offset = fNextOffset;
+	if (!fIndex.empty()){
+		if (fNextBlock >= fIndex.size())
+			return 0;
+		offset = fIndex[fNextBlock++].first;
+	}
+	char magic[4];
+	uint32_t nrows;
+	if (fseek(fFile, offset, SEEK_SET) != 0 || fread(magic, sizeof(magic), 1, fFile) != 1 ||
+			memcmp(magic, LOG_BLOCK_MAGIC, sizeof(magic)) != 0 || fread(&nrows, sizeof(nrows), 1, fFile) != 1)
+		return 0;
+	unsigned int ncols = columns.size();
+	rows.resize(nrows*ncols);
+	for (unsigned int j = 0; j < ncols; j++){
+		bool ok;
+		switch (types[j]){
+			case 'b': ok = ReadColumn<int8_t>(fFile, rows, ncols, j, nrows); break;
+			case 'i': ok = ReadColumn<int32_t>(fFile, rows, ncols, j, nrows); break;
+			case 'q': ok = ReadColumn<int64_t>(fFile, rows, ncols, j, nrows); break;
+			case 'f': ok = ReadColumn<float>(fFile, rows, ncols, j, nrows); break;
+			default: ok = ReadColumn<double>(fFile, rows, ncols, j, nrows); break;
+		}
+		if (!ok)
+			return 0;
+	}
+	fNextOffset = ftell(fFile);
+	return nrows;
+}
+
+
+void MergeLogFiles(const vector<string> &files, const string &filename){
+	if (files.empty())
+		return;
+	if (filename.size() >= 4 && filename.compare(filename.size() - 4, 4, ".bin") == 0){
+		string columns;
+		TLogFileReader first(files[0]);
+		for (unsigned int i = 0; i < first.columns.size(); i++)
+			columns += first.columns[i] + ':' + first.types[i] + ' '; // keep column types
+		TLogFile merged;
+		merged.Open(filename, columns);
+		vector<double> rows;
+		for (vector<string>::const_iterator f = files.begin(); f != files.end(); f++){
+			TLogFileReader reader(*f);
+			if (reader.columns != first.columns || reader.types != first.types){
+				cout << "Columns of " << *f << " do not match " << files[0] << '\n';
+				exit(-1);
+			}
+			while (reader.ReadBlock(rows)){
+				for (unsigned int i = 0; i < rows.size(); i++){
+					merged << rows[i];
+					if ((i + 1) % first.columns.size() == 0)
+						merged.WriteRow();
+				}
+			}
+		}
+		merged.Close();
+		return;
+	}
+
+	ofstream merged(filename.c_str());
+	for (vector<string>::const_iterator f = files.begin(); f != files.end(); f++){
+		ifstream in(f->c_str());
+		string header;
+		if (!getline(in, header)){
+			cout << "Could not read " << *f << '\n';
+			exit(-1);
+		}
+		if (f == files.begin())
+			merged << header << '\n';
+		if (in.peek() != EOF)
+			merged << in.rdbuf();
+	}
+	merged.close();
+	if (!merged){
+		cout << "Could not write " << filename << '\n';
+		exit(-1);
+	}
+}
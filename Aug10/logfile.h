@@ -0,0 +1,259 @@
+/**
+ * \file
+ * Log files with named columns, written as text or in a binary columnar format.
+ *
+ * Binary files (*.bin) have the following layout (little endian, as written by the machine running the simulation):
+ *
+ * Header: "PENTRKBC", uint32 version, uint32 number of columns, for each column: char type ('d': float64, 'f': float32, 'q': int64, 'i': int32, 'b': int8), uint32 name length, name
+ * (version 1 files only contain float64 and int64 columns, int64 columns have type 'i')
+ *
+ * Blocks: "BLCK", uint32 number of rows, for each column: values of all rows in this block
+ *
+ * Footer: "INDX", uint32 number of blocks, for each block: uint64 file offset, uint64 number of rows
+ *
+ * Trailer: uint64 file offset of footer, "PENTRKBC"
+ *
+ * If the trailer is missing, e.g. because the simulation was killed, the blocks can still be read sequentially.
+ * TLogFileReader reads these files, the bin2txt tool converts them to the text layout.
+ *
+ * If ::logthread is set, rows are collected in chunks which are handed to a single writer thread.
+ * It opens the files, formats the rows and writes them in large writes, so the tracking loop does not wait for the file system.
+ * Chunks are written in the order they were handed over, so each file contains its rows in the order they were created.
+ * If more than ::logbuffer MB are waiting to be written, the tracking loop waits for the writer thread.
+ */
+
+#ifndef LOGFILE_H_
+#define LOGFILE_H_
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstdio>
+
+#include <pthread.h>
+
+#include "globals.h"
+
+extern bool binarylog; ///< write log files in binary columnar format instead of text (read from config)
+extern bool logthread; ///< write log files in separate writer thread (read from config)
+extern double logbuffer; ///< max. amount of data [MB] waiting for writer thread before tracking waits (read from config)
+extern bool binaryfloat; ///< store floating point columns of track, hit and snapshot logs as float32 in binary log files (read from config)
+
+
+/**
+ * Check if a column type of binary log files is an integer type
+ *
+ * @param type Column type
+ *
+ * @return Returns true for int8, int32 and int64 columns
+ */
+inline bool LogIntegerType(char type){ return type == 'b' || type == 'i' || type == 'q'; }
+
+
+/**
+ * Log file with a fixed list of columns.
+ *
+ * Values of a row are added with operator<< and the row is written with TLogFile::WriteRow.
+ * In text mode it produces a header line with column names and one line of space-separated values per row (precision 10).
+ * In binary mode rows are collected in blocks, which are written column by column with the type of each column.
+ * Files are opened when the first rows are written, with ::logthread set this happens in the writer thread.
+ */
+class TLogFile{
+	friend class TLogWriter;
+private:
+	std::string fFilename; ///< name of file
+	std::vector<std::string> fNames; ///< column names
+	std::vector<char> fTypes; ///< type of each column (see binary file layout above)
+	std::vector<double> fRow; ///< values of current row
+	std::vector<double> fChunk; ///< rows waiting to be handed to writer thread
+	bool fOpened; ///< true if TLogFile::Open was called
+	bool fAsync; ///< true if rows are written by writer thread
+	bool fClosed; ///< set by writer thread when file was closed
+	std::string fError; ///< error message of writer thread
+	bool fBinary; ///< true if file is written in binary format
+	std::ofstream fText; ///< text file stream
+	FILE *fBinaryFile; ///< binary file
+	std::vector<double> fBlock; ///< rows collected for next binary block
+	std::vector<std::pair<unsigned long long, unsigned long long> > fIndex; ///< file offset and number of rows of each binary block
+	std::vector<char> fBuffer; ///< write buffer for binary file
+	bool fDeferred; ///< true if rows are held back until TLogFile::CommitDeferred or TLogFile::DiscardDeferred is called
+	unsigned int fDeferredMax; ///< max. number of held back rows kept in memory
+	std::vector<double> fDeferredRows; ///< held back rows kept in memory
+	FILE *fSpill; ///< temporary file containing held back rows which did not fit into memory
+
+	/**
+	 * Create file and write header
+	 *
+	 * @return Returns false if file could not be created
+	 */
+	bool CreateFile();
+
+	/**
+	 * Format rows and write them to file, creates file if necessary
+	 *
+	 * @param rows Values of rows, row by row
+	 * @param count Number of values
+	 *
+	 * @return Returns false if rows could not be written
+	 */
+	bool WriteRows(const double *rows, unsigned int count);
+
+	/**
+	 * Write remaining binary block and footer and close file
+	 *
+	 * @return Returns false if file could not be written
+	 */
+	bool CloseFile();
+
+	/**
+	 * Write collected rows to binary file as one block
+	 *
+	 * @return Returns false if block could not be written
+	 */
+	bool WriteBlock();
+
+	/**
+	 * Write rows to file or hand them to writer thread.
+	 *
+	 * @param rows Values of rows, row by row
+	 * @param count Number of values
+	 */
+	void AppendRows(const double *rows, unsigned int count);
+
+	/**
+	 * Hand collected rows to writer thread.
+	 *
+	 * Waits if writer thread is too far behind.
+	 * Exits program if writer thread reported an error.
+	 *
+	 * @param close Tell writer thread to close file after writing the rows and wait until it has done so
+	 */
+	void Submit(bool close);
+
+public:
+	/**
+	 * Constructor, does not open a file
+	 */
+	TLogFile();
+
+	/**
+	 * Destructor, calls TLogFile::Close
+	 */
+	~TLogFile();
+
+	/**
+	 * Set file name and columns, file is created when the first rows are written.
+	 *
+	 * Exits program if file could not be created, with ::logthread set when the next rows are handed to the writer thread.
+	 *
+	 * @param filename Name of file, if ::binarylog is set the extension ".out" is replaced by ".bin"
+	 * @param columns Space-separated list of column names, each optionally followed by a type suffix (e.g. "Nhit:i") for binary files,
+	 *        :b, :i and :q mark int8, int32 and int64 columns, :f and :d float32 and float64 columns, columns without suffix are floating point
+	 * @param singleprecision Store floating point columns without suffix as float32 if ::binaryfloat is set, otherwise as float64
+	 */
+	void Open(const std::string &filename, const std::string &columns, bool singleprecision = false);
+
+	/**
+	 * Write remaining rows, binary footer and close file.
+	 *
+	 * Waits until the writer thread has written all rows of this file.
+	 */
+	void Close();
+
+	/**
+	 * Check if file has been opened.
+	 *
+	 * @return Returns true if TLogFile::Open was called and file was not closed yet
+	 */
+	bool is_open() const{ return fOpened; };
+
+	/**
+	 * Add value to current row
+	 *
+	 * @param value Value of next column
+	 *
+	 * @return Returns reference to this log file
+	 */
+	template<typename T> TLogFile& operator<<(const T value){
+		fRow.push_back(static_cast<double>(value));
+		return *this;
+	};
+
+	/**
+	 * Write current row to file or hand it to writer thread.
+	 *
+	 * Exits program if number of values does not match number of columns.
+	 */
+	void WriteRow();
+
+	/**
+	 * Hold back all following rows until TLogFile::CommitDeferred or TLogFile::DiscardDeferred is called.
+	 *
+	 * Rows exceeding maxrows are moved into a temporary file.
+	 *
+	 * @param maxrows Max. number of rows kept in memory
+	 */
+	void BeginDeferred(unsigned int maxrows);
+
+	/**
+	 * Write all held back rows and stop holding back rows.
+	 */
+	void CommitDeferred();
+
+	/**
+	 * Throw away all held back rows and stop holding back rows.
+	 */
+	void DiscardDeferred();
+};
+
+
+/**
+ * Reader for binary log files written by TLogFile.
+ */
+class TLogFileReader{
+private:
+	FILE *fFile; ///< binary file
+	std::vector<std::pair<unsigned long long, unsigned long long> > fIndex; ///< file offset and number of rows of each block
+	unsigned int fNextBlock; ///< index of next block to read
+	long fNextOffset; ///< file offset of next block, if file has no footer
+public:
+	std::vector<std::string> columns; ///< column names
+	std::vector<char> types; ///< column types (see binary file layout above)
+
+	/**
+	 * Constructor, reads header and block index.
+	 *
+	 * Exits program if file is not a valid binary log file.
+	 *
+	 * @param filename Name of binary log file
+	 */
+	TLogFileReader(const std::string &filename);
+
+	/**
+	 * Destructor, closes file
+	 */
+	~TLogFileReader();
+
+	/**
+	 * Read next block of rows.
+	 *
+	 * @param rows Returns values of all rows in block, row by row
+	 *
+	 * @return Returns number of rows read, zero if end of file was reached
+	 */
+	unsigned long long ReadBlock(std::vector<double> &rows);
+};
+
+
+/**
+ * Merge log files with identical columns into one file.
+ *
+ * Text files are concatenated without repeating the header line, binary files (*.bin) are read with TLogFileReader and written with TLogFile.
+ * Exits program if a file cannot be read or written.
+ *
+ * @param files Names of files to merge, their rows are written in this order
+ * @param filename Name of merged file
+ */
+void MergeLogFiles(const std::vector<std::string> &files, const std::string &filename);
+
+#endif /* LOGFILE_H_ */
@@ -19,7 +19,14 @@
 #include <fstream>
 #include <iomanip>
 #include <numeric>
+#include <limits>
+#include <algorithm>
+#include <cerrno>
 #include <sys/time.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <dirent.h>
 
 using namespace std;
 
@@ -34,21 +41,76 @@ using namespace std;
 #include "mc.h" 
 #include "bruteforce.h"
 #include "ndist.h"
+#include "icproducer.h"
+#include "logfile.h"
+#include "histogram.h"
+#include "statefile.h"
+#include "server.h"
+#include "numapolicy.h"
 
 void ConfigInit(TConfig &config); // read config.in
-void OutputCodes(map<string, map<int, int> > &ID_counter); // print simulation summary at program exit
+void OutputCodes(map<string, map<int, int> > &ID_counter, map<string, map<int, double> > &weight_counter); // print simulation summary at program exit
 void PrintBFieldCut(const char *outfile, TFieldManager &field); // evaluate fields on given plane and write to outfile
 void PrintBField(const char *outfile, TFieldManager &field);
 void PrintGeometry(const char *outfile, TGeometry &geom); // do many random collisionchecks and write all collisions to outfile
+bool CheckConvergence(int nsimulated); // print estimates of observables and check if their uncertainties are below targeterror
+struct TSweepPoint;
+bool ParseSweepPoint(const string &name, const string &params, TSweepPoint &point, TFieldManager &field); // read parameters of a sweep point
+bool PrepareSweepPoint(const TSweepPoint &point, const string &basepath, string &pointpath); // check source and create output directory of a sweep point
+vector<TSweepPoint> ParseSweep(map<string, string> &sweepconf, TFieldManager &field); // read sweep points from [SWEEP] section of config.in
+string WorkerPath(long long basejob, int worker); // output directory of a worker process
+void MergeWorkerOutput(long long basejob); // merge output of all worker processes
 
 
 double SimTime = 1500.; ///< max. simulation time
 int simcount = 1; ///< number of particles for MC simulation (read from config)
 int simtype = PARTICLE; ///< type of particle which shall be simulated (read from config)
 int secondaries = 1; ///< should secondary particles be simulated? (read from config)
+int producerthreads = 0; ///< number of threads creating initial conditions ahead of tracking (read from config)
+int producerqueue = 1000; ///< max. number of initial conditions created ahead of tracking (read from config)
+string icfile; ///< file from which initial conditions are read or into which they are written (read from config)
+string savefile; ///< file into which states of particles still being simulated at simtime are written (read from config)
+string restorefile; ///< file from which particle states are read and continued instead of creating new particles (read from config)
+int restorerng = 1; ///< restore state of random number generator saved with each particle before continuing it (read from config)
+string serversocket; ///< UNIX socket on which simulation jobs are accepted, geometry and fields stay loaded between jobs (read from config)
+int workers = 1; ///< number of worker processes forked after geometry and fields are loaded (read from config)
+int numa = 0; ///< placement of field maps and geometry on NUMA nodes, 0: default, 1: interleaved, 2: replicated for each node used by workers (read from config)
 double BCutPlanePoint[9]; ///< 3 points on plane for field slice (read from config)
 int BCutPlaneSampleCount1; ///< number of field samples in BCutPlanePoint[3..5]-BCutPlanePoint[0..2] direction (read from config)
 int BCutPlaneSampleCount2; ///< number of field samples in BCutPlanePoint[6..8]-BCutPlanePoint[0..2] direction (read from config)
+double progressinterval = 10; ///< min. time [s] between progress messages of the whole run (read from config)
+
+/**
+ * Observable whose statistical uncertainty determines when the simulation stops
+ */
+struct TObservable{
+	string definition; ///< definition from config.in (particle:ID or particle:solid:ID)
+	string particlename; ///< particle type which is counted
+	bool solid; ///< count particles stopping in solid ID instead of particles with fate ID
+	int ID; ///< fate or solid ID
+	double sum; ///< sum of counted weights of each primary particle (including its copies and secondaries)
+	double sum2; ///< sum of squared counted weights of each primary particle
+};
+vector<TObservable> observables; ///< observables checked after each batch (read from config)
+double targeterror = 0; ///< stop simulation when relative uncertainties of all observables are below this value (read from config)
+int batchsize = 100; ///< number of primary particles between convergence checks (read from config)
+double maxwalltime = 0; ///< stop simulation after the batch during which the total wall-clock time [s] of the run was exceeded (read from config)
+double pointwalltime = 0; ///< stop simulation of a sweep point or server job after the batch during which its wall-clock time [s] was exceeded (read from config)
+
+/**
+ * Point of a parameter sweep, simulated with the geometry and field maps loaded for all points
+ */
+struct TSweepPoint{
+	string name; ///< name of point, its output is written into a subdirectory of the output path with this name
+	double simtime; ///< max. simulation time
+	int simcount; ///< number of primary particles
+	string source; ///< source definition replacing the [SOURCE] section of geometry.in (empty: keep source)
+	map<string, double> Bscales; ///< factors by which magnetic fields are scaled, indexed by field type in [FIELDS] section of geometry.in
+	map<string, double> Escales; ///< factors by which electric fields and potentials are scaled, indexed by field type
+	uint64_t seed; ///< random seed (0: use the same random numbers as all other points)
+	string outpath; ///< output directory (empty: subdirectory of the output path with the point's name)
+	TConfig particleoptions; ///< options overriding particle.in, indexed by particle name and option
+};
 
 /**
  * Catch signals.
@@ -110,12 +172,17 @@ int main(int argc, char **argv){
 
 	// read config.in
 	ConfigInit(configin);
+	if (!configin["HISTOGRAMS"].empty())
+		histograms = new THistograms(configin["HISTOGRAMS"]);
 
 	if(simtype == PARTICLE){
 		if (neutdist == 1) prepndist(); // prepare for neutron distribution-calculation
 	}
 	
-	cout << "Loading fields...\n";
+	if (numa == 1 && !NumaInterleave()) // spread field maps and geometry across memory of all NUMA nodes
+		cout << "Could not interleave memory across NUMA nodes!\n";
+	if (VERBOSE(VERBOSITY_SUMMARY))
+		cout << "Loading fields...\n";
 	// load field configuration from geometry.in
 	TFieldManager field(geometryin);
 
@@ -128,7 +195,8 @@ int main(int argc, char **argv){
 	}
 
 
-	cout << "Loading geometry...\n";
+	if (VERBOSE(VERBOSITY_SUMMARY))
+		cout << "Loading geometry...\n";
 	//load geometry configuration from geometry.in
 	TGeometry geom(geometryin);
 	
@@ -138,11 +206,15 @@ int main(int argc, char **argv){
 		return 0;
 	}
 	
-	cout << "Loading source...\n";
+	if (VERBOSE(VERBOSITY_SUMMARY))
+		cout << "Loading source...\n";
 	// load source configuration from geometry.in
 	TSource source(geometryin, geom, field);
+	if (numa == 1)
+		NumaResetPolicy(); // memory used during tracking is allocated locally
 	
-	cout << "Loading random number generator...\n";
+	if (VERBOSE(VERBOSITY_SUMMARY))
+		cout << "Loading random number generator...\n";
 	// load random number generator from all3inone.in
 	TMCGenerator mc(string(inpath + "/particle.in").c_str());
 	
@@ -160,6 +232,13 @@ int main(int argc, char **argv){
 	" ########################################################################\n");
 
 	map<string, map<int, int> > ID_counter; // 2D map to store number of each ID for each particle type
+	map<string, map<int, double> > weight_counter; // 2D map to store sum of weights of each ID for each particle type
+
+	if (simtype == INITIAL_CONDITIONS){ // write initial conditions into file, which can be replayed by setting icfile with simtype 1
+		TInitialConditionProducer producer(source, geom, &field, mc, simcount, producerthreads, producerqueue, "");
+		producer.WriteFile(icfile);
+		return 0;
+	}
 
 	/*
 	stringstream filename;
@@ -185,23 +264,267 @@ int main(int argc, char **argv){
 		infile >> ws;
 	}
 */
-	if (simtype == PARTICLE){ // if proton or neutron shall be simulated
-		for (int iMC = 1; iMC <= simcount; iMC++)
-		{
-			TParticle *p = source.CreateParticle(mc, geom, &field);
-			p->Integrate(SimTime, particlein[p->name]); // integrate particle
-			ID_counter[p->name][p->ID]++; // increment counters
-			ntotalsteps += p->Nstep;
-
-			if (secondaries == 1){
-				for (vector<TParticle*>::iterator i = p->secondaries.begin(); i != p->secondaries.end(); i++){
-					(*i)->Integrate(SimTime, particlein[(*i)->name]); // integrate secondary particles
-					ID_counter[(*i)->name][(*i)->ID]++;
-					ntotalsteps += (*i)->Nstep;
+	bool sweeping = !configin["SWEEP"].empty() || !serversocket.empty();
+	int worker = -1; // index of this process if it is a worker started by the launcher
+	FILE *workerresults = NULL; // pipe through which a worker sends its fate counters to the launcher
+	vector<pid_t> workerpids;
+	vector<FILE*> workerpipes;
+	long long basejob = jobnumber;
+	int icfirst = 0; // number of initial conditions in icfile simulated by other workers
+	if (workers > 1 && simtype == PARTICLE){ // fork workers after everything is loaded, so they share geometry and fields (copy-on-write)
+		if (sweeping || !restorefile.empty()){
+			cout << "workers cannot be combined with sweeps, server mode or restorefile!\n";
+			exit(-1);
+		}
+		int basecount = simcount;
+		uint64_t baseseed = mc.seed;
+		vector<int> nodes = NumaNodes();
+		int node = -1;
+		for (int i = 0; i < workers; i++){
+			if (numa == 2 && nodes[i*nodes.size()/workers] != node){ // workers are distributed evenly across nodes, the workers of each node share a copy of the field maps in the node's memory
+				node = nodes[i*nodes.size()/workers];
+				if (NumaBind(node)){
+					field.Replicate(); // workers forked from now on share this copy (copy-on-write)
+					printf("Workers from %i on run on NUMA node %i\n", i, node);
 				}
+				else
+					printf("Could not bind workers to NUMA node %i!\n", node);
+			}
+			int fd[2];
+			cout.flush();
+			fflush(stdout);
+			pid_t pid = (pipe(fd) == 0) ? fork() : -1;
+			if (pid < 0){
+				cout << "Could not start worker " << i << "!\n";
+				exit(-1);
 			}
+			if (pid == 0){
+				close(fd[0]);
+				for (vector<FILE*>::iterator j = workerpipes.begin(); j != workerpipes.end(); j++)
+					fclose(*j);
+				workerpipes.clear();
+				workerpids.clear();
+				workerresults = fdopen(fd[1], "w");
+				worker = i;
+				jobnumber = basejob*workers + i;
+				simcount = basecount/workers + (i < basecount % workers ? 1 : 0);
+				icfirst = i*(basecount/workers) + min(i, basecount % workers);
+				mc.SetSeed(TMCGenerator::StreamSeed(baseseed, -(i + 1))); // negative streams, unrelated to streams of producer threads (0, 1, 2, ...)
+				outpath = WorkerPath(basejob, i);
+				if (mkdir(outpath.c_str(), 0777) != 0 && errno != EEXIST){
+					cout << "Could not create " << outpath << "!\n";
+					exit(-1);
+				}
+				if (!savefile.empty())
+					savefile = outpath + "/particles.state";
+				break;
+			}
+			close(fd[1]);
+			workerpids.push_back(pid);
+			workerpipes.push_back(fdopen(fd[0], "r"));
+		}
+	}
 
-			delete p;
+	if (!workerpids.empty()){ // launcher: collect fate counters of workers and merge their output
+		if (numa == 2)
+			NumaUnbind(); // launcher does not have to stay on the node of the last workers
+		printf("Started %i workers\n", workers);
+		for (unsigned int i = 0; i < workerpids.size(); i++){
+			char name[64];
+			int ID, count, steps;
+			double weight;
+			while (fscanf(workerpipes[i], "%63s", name) == 1){
+				if (strcmp(name, "steps") == 0 && fscanf(workerpipes[i], "%i", &steps) == 1)
+					ntotalsteps += steps;
+				else if (fscanf(workerpipes[i], "%i %i %lf", &ID, &count, &weight) == 3){
+					ID_counter[name][ID] += count;
+					weight_counter[name][ID] += weight;
+				}
+			}
+			fclose(workerpipes[i]);
+			int status;
+			if (waitpid(workerpids[i], &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+				printf("Worker %i failed!\n", i);
+		}
+		MergeWorkerOutput(basejob);
+	}
+	else if (simtype == PARTICLE){ // if proton or neutron shall be simulated
+		vector<TSweepPoint> sweep = ParseSweep(configin["SWEEP"], field);
+		TSimulationServer *server = serversocket.empty() ? NULL : new TSimulationServer(serversocket);
+		string rngstate = mc.GetState();
+		string basepath = outpath;
+		double basesimtime = SimTime;
+		int basesimcount = simcount;
+		for (unsigned int n = 0; ; n++){
+			TSweepPoint sweeppoint;
+			if (server){ // wait for next job, its console output is sent to the client
+				string request, name, params;
+				if (!server->Next(request))
+					break;
+				istringstream req(request);
+				req >> name;
+				getline(req, params);
+				if (name.empty() || !ParseSweepPoint(name, params, sweeppoint, field)){
+					cout << "Invalid job, send: name [parameter=value ...]\n";
+					server->Finish();
+					continue;
+				}
+				if (!PrepareSweepPoint(sweeppoint, basepath, outpath)){ // report errors to client instead of exiting
+					server->Finish();
+					continue;
+				}
+			}
+			else if (n < sweep.size())
+				sweeppoint = sweep[n];
+			else
+				break;
+			TSweepPoint *point = &sweeppoint;
+			TSource *pointsource = &source;
+			TConfig pointparticlein = particlein;
+			if (sweeping){ // apply parameters of sweep point, geometry and field maps stay loaded
+				if (server)
+					printf("\nJob %s\n", point->name.c_str());
+				else
+					printf("\nSweep point %s (%i of %i)\n", point->name.c_str(), n + 1, (int)sweep.size());
+				SimTime = point->simtime;
+				simcount = point->simcount;
+				field.ResetFieldScales();
+				for (vector<string>::iterator i = field.fieldnames.begin(); i != field.fieldnames.end(); i++)
+					field.SetFieldScale(*i, point->Bscales.count(*i) ? point->Bscales[*i] : 1, point->Escales.count(*i) ? point->Escales[*i] : 1);
+				bool scaled = false;
+				for (map<string, double>::iterator i = point->Bscales.begin(); i != point->Bscales.end(); i++)
+					scaled |= i->second != 1;
+				for (map<string, double>::iterator i = point->Escales.begin(); i != point->Escales.end(); i++)
+					scaled |= i->second != 1;
+				TConfig pointgeometryin = geometryin;
+				if (!point->source.empty()){ // replace source definition
+					istringstream sourcedef(point->source);
+					string sourcemode, sourceparams;
+					sourcedef >> sourcemode;
+					getline(sourcedef, sourceparams);
+					pointgeometryin["SOURCE"].clear();
+					pointgeometryin["SOURCE"][sourcemode] = sourceparams;
+				}
+				if (!point->source.empty() || (source.PhaseSpaceWeighting != 0 && scaled))
+					pointsource = new TSource(pointgeometryin, geom, field); // source depends on scaled fields with PhaseSpaceWeighting
+				else
+					source.source->ParticleCounter = 0; // reuse source loaded at startup, number particles from 1 again
+				for (TConfig::iterator i = point->particleoptions.begin(); i != point->particleoptions.end(); i++){
+					for (TConfig::iterator j = pointparticlein.begin(); j != pointparticlein.end(); j++){
+						if (i->first == "all" || i->first == j->first)
+							for (map<string, string>::iterator k = i->second.begin(); k != i->second.end(); k++)
+								j->second[k->first] = k->second;
+					}
+				}
+				if (!server && !PrepareSweepPoint(*point, basepath, outpath))
+					exit(-1);
+				if (point->seed != 0)
+					mc.SetSeed(point->seed);
+				else
+					mc.SetState(rngstate); // all sweep points use the same random numbers
+				for (vector<TObservable>::iterator i = observables.begin(); i != observables.end(); i++)
+					i->sum = i->sum2 = 0;
+				ID_counter.clear();
+				weight_counter.clear();
+				if (histograms){
+					delete histograms;
+					histograms = new THistograms(configin["HISTOGRAMS"]);
+				}
+			}
+
+			TInitialConditionProducer producer(*pointsource, geom, &field, mc, restorefile.empty() ? simcount : 0, producerthreads, producerqueue, icfile, icfirst);
+			TInitialCondition ic;
+			TParticleStateFile *restored = restorefile.empty() ? NULL : new TParticleStateFile(restorefile, false);
+			TParticleStateFile *saved = savefile.empty() ? NULL : new TParticleStateFile(sweeping ? savefile + "_" + point->name : savefile, true);
+			int nsimulated = 0;
+			timespec pointstart, lastprogress;
+			clock_gettime(CLOCK_REALTIME, &pointstart);
+			lastprogress = pointstart;
+			for (;;){
+				TParticle *p = NULL;
+				if (restored)
+					p = restored->Read(mc, geom, &field, restorerng); // continue saved particle
+				else if (producer.Next(ic))
+					p = pointsource->CreateParticle(mc, ic, geom, &field);
+				if (!p)
+					break;
+				vector<TParticle*> particles(1, p); // particle, its copies from population splitting and secondary particles
+				vector<double> counted(observables.size(), 0); // weights counted for each observable
+				for (unsigned int i = 0; i < particles.size(); i++){
+					TParticle *q = particles[i];
+					q->Integrate(SimTime, pointparticlein[q->name]); // integrate particle
+					if (saved && q->ID == ID_NOT_FINISH && q->tend >= SimTime && q->lend < q->maxtraj)
+						saved->Write(*q, mc); // particle was stopped by simtime, save it before anything else uses the random number generator
+					ID_counter[q->name][q->ID]++; // increment counters
+					weight_counter[q->name][q->ID] += q->weight;
+					ntotalsteps += q->Nstep;
+					for (unsigned int j = 0; j < observables.size(); j++){
+						if (observables[j].particlename == q->name && (observables[j].solid ? (int)q->solidend.ID : q->ID) == observables[j].ID)
+							counted[j] += q->weight;
+					}
+
+					particles.insert(particles.end(), q->splits.begin(), q->splits.end());
+					if (secondaries == 1)
+						particles.insert(particles.end(), q->secondaries.begin(), q->secondaries.end());
+				}
+
+				delete p;
+				for (unsigned int j = 0; j < observables.size(); j++){
+					observables[j].sum += counted[j];
+					observables[j].sum2 += counted[j]*counted[j];
+				}
+
+				nsimulated++;
+				timespec now;
+				clock_gettime(CLOCK_REALTIME, &now);
+				if (VERBOSE(VERBOSITY_SUMMARY)){ // rate-limited progress of whole run
+					if (now.tv_sec - lastprogress.tv_sec + (now.tv_nsec - lastprogress.tv_nsec)/1e9 >= progressinterval){
+						printf("%i of %i particles simulated in %.0fs\n", nsimulated, simcount, now.tv_sec - simstart.tv_sec + (now.tv_nsec - simstart.tv_nsec)/1e9);
+						lastprogress = now;
+						fflush(stdout); // stream progress if output is redirected, e.g. to a job client
+					}
+				}
+				if ((targeterror > 0 || maxwalltime > 0 || pointwalltime > 0 || !observables.empty()) && nsimulated % batchsize == 0){ // batch finished
+					bool converged = CheckConvergence(nsimulated);
+					fflush(stdout);
+					if (targeterror > 0 && converged){
+						printf("Target uncertainty reached after %i particles\n", nsimulated);
+						break;
+					}
+					if ((maxwalltime > 0 && now.tv_sec - simstart.tv_sec + (now.tv_nsec - simstart.tv_nsec)/1e9 >= maxwalltime) ||
+						(pointwalltime > 0 && now.tv_sec - pointstart.tv_sec + (now.tv_nsec - pointstart.tv_nsec)/1e9 >= pointwalltime)){
+						printf("Wall-time limit reached after %i particles\n", nsimulated);
+						break;
+					}
+				}
+			}
+			if (!observables.empty() && nsimulated % batchsize != 0)
+				CheckConvergence(nsimulated);
+			delete restored;
+			delete saved;
+
+			if (sweeping){ // write results of sweep point into its own directory
+				OutputCodes(ID_counter, weight_counter);
+				ostringstream histprefix;
+				histprefix << outpath << "/" << setw(12) << setfill('0') << jobnumber << setw(0);
+				if (histograms)
+					histograms->Write(histprefix.str());
+				TNeutron::CloseLogs();
+				TProton::CloseLogs();
+				TElectron::CloseLogs();
+				if (pointsource != &source)
+					delete pointsource;
+			}
+			if (server)
+				server->Finish();
+			SimTime = basesimtime; // following jobs start from the global settings
+			simcount = basesimcount;
+		}
+		delete server;
+		outpath = basepath;
+		if (sweeping){ // histograms of each sweep point were already written
+			delete histograms;
+			histograms = NULL;
 		}
 	}
 	else{
@@ -211,20 +534,37 @@ int main(int argc, char **argv){
 
 
 
-	OutputCodes(ID_counter); // print particle IDs
-	
-	// print statistics
-	printf("The integrator made %d steps. \n", ntotalsteps);
-	clock_gettime(CLOCK_REALTIME, &simend);
-	float SimulationTime = simend.tv_sec - simstart.tv_sec + (float)(simend.tv_nsec - simstart.tv_nsec)/1e9;
-	printf("Init: %.2fs, Simulation: %.2fs",
-			InitTime, SimulationTime);
-	printf("That's it... Have a nice day!\n");
+	if (worker >= 0){ // send fate counters to launcher
+		for (map<string, map<int, int> >::iterator i = ID_counter.begin(); i != ID_counter.end(); i++)
+			for (map<int, int>::iterator j = i->second.begin(); j != i->second.end(); j++)
+				fprintf(workerresults, "%s %i %i %.17g\n", i->first.c_str(), j->first, j->second, weight_counter[i->first][j->first]);
+		fprintf(workerresults, "steps %i\n", ntotalsteps);
+		fclose(workerresults);
+	}
+	else{
+		if (!sweeping)
+			OutputCodes(ID_counter, weight_counter); // print particle IDs
+
+		// print statistics
+		printf("The integrator made %d steps. \n", ntotalsteps);
+		clock_gettime(CLOCK_REALTIME, &simend);
+		float SimulationTime = simend.tv_sec - simstart.tv_sec + (float)(simend.tv_nsec - simstart.tv_nsec)/1e9;
+		printf("Init: %.2fs, Simulation: %.2fs",
+				InitTime, SimulationTime);
+		printf("That's it... Have a nice day!\n");
+	}
 	
 
 	ostringstream fileprefix;
 	fileprefix << outpath << "/" << setw(8) << setfill('0') << jobnumber << setw(0);
-	if (neutdist == 1) outndist((fileprefix.str() + "ndist.out").c_str());   // print neutron distribution into file
+	if (neutdist == 1 && workerpids.empty()) outndist((fileprefix.str() + "ndist.out").c_str());   // print neutron distribution into file
+
+	if (histograms){
+		ostringstream histprefix;
+		histprefix << outpath << "/" << setw(12) << setfill('0') << jobnumber << setw(0);
+		histograms->Write(histprefix.str());
+		delete histograms;
+	}
 
 	return 0;
 }
@@ -250,6 +590,53 @@ void ConfigInit(TConfig &config){
 	istringstream(config["global"]["simcount"])		>> simcount;
 	istringstream(config["global"]["simtime"])		>> SimTime;
 	istringstream(config["global"]["secondaries"])	>> secondaries;
+	istringstream(config["global"]["producerthreads"])	>> producerthreads;
+	istringstream(config["global"]["producerqueue"])	>> producerqueue;
+	istringstream(config["global"]["icfile"])		>> icfile;
+	istringstream(config["global"]["savefile"])		>> savefile;
+	istringstream(config["global"]["restorefile"])	>> restorefile;
+	istringstream(config["global"]["restorerng"])	>> restorerng;
+	istringstream(config["global"]["serversocket"])	>> serversocket;
+	istringstream(config["global"]["workers"])		>> workers;
+	istringstream(config["global"]["numa"])			>> numa;
+	istringstream(config["global"]["binarylog"])	>> binarylog;
+	istringstream(config["global"]["binaryfloat"])	>> binaryfloat;
+	istringstream(config["global"]["logthread"])	>> logthread;
+	istringstream(config["global"]["logbuffer"])	>> logbuffer;
+	istringstream(config["global"]["verbosity"])	>> verbosity;
+	istringstream(config["global"]["progressinterval"])	>> progressinterval;
+	istringstream(config["global"]["targeterror"])	>> targeterror;
+	istringstream(config["global"]["batchsize"])	>> batchsize;
+	istringstream(config["global"]["maxwalltime"])	>> maxwalltime;
+	istringstream(config["global"]["pointwalltime"])	>> pointwalltime;
+	istringstream obsconf(config["global"]["observables"]);
+	string obs;
+	while (obsconf >> obs){
+		TObservable o = {obs, "", false, 0, 0, 0};
+		string def = obs;
+		replace(def.begin(), def.end(), ':', ' ');
+		istringstream obsdef(def);
+		string ID;
+		obsdef >> o.particlename >> ID;
+		if (ID == "solid"){
+			o.solid = true;
+			obsdef >> ID;
+		}
+		istringstream(ID) >> o.ID;
+		if (!obsdef || ID.empty() || ID.find_first_not_of("-0123456789") != string::npos){
+			cout << "Invalid observable '" << obs << "', use particle:ID or particle:solid:ID\n";
+			exit(-1);
+		}
+		observables.push_back(o);
+	}
+	if (batchsize < 1)
+		batchsize = 1;
+	if (numa == 2 && workers < 2)
+		cout << "numa 2 replicates field maps for workers, it has no effect without workers!\n";
+	if (targeterror > 0 && observables.empty()){
+		cout << "targeterror needs at least one observable!\n";
+		exit(-1);
+	}
 	istringstream(config["global"]["BCutPlane"])	>> BCutPlanePoint[0] >> BCutPlanePoint[1] >> BCutPlanePoint[2]
 													>> BCutPlanePoint[3] >> BCutPlanePoint[4] >> BCutPlanePoint[5]
 													>> BCutPlanePoint[6] >> BCutPlanePoint[7] >> BCutPlanePoint[8]
@@ -257,24 +644,230 @@ void ConfigInit(TConfig &config){
 }
 
 
+/**
+ * Read parameters of a sweep point.
+ *
+ * Parameters are given as parameter=value pairs:
+ * simtime, simcount, B:field and E:field (scale factors of a field type in the [FIELDS] section of geometry.in),
+ * source (colon-separated source definition as in the [SOURCE] section of geometry.in), seed, outpath
+ * and particle:option (overrides an option of a particle in particle.in, "all" overrides it for all particles).
+ * Parameters which are not given keep their global settings.
+ *
+ * @param name Name of point
+ * @param params Parameter list
+ * @param point Returns sweep point
+ * @param field Fields, used to check field names
+ *
+ * @return Returns false and prints an error if a parameter is invalid
+ */
+bool ParseSweepPoint(const string &name, const string &params, TSweepPoint &point, TFieldManager &field){
+	TSweepPoint global = {name, SimTime, simcount, "", map<string, double>(), map<string, double>(), 0, "", TConfig()};
+	point = global;
+	istringstream paramlist(params);
+	string param;
+	while (paramlist >> param){
+		string::size_type eq = param.find('=');
+		string key = param.substr(0, eq), value = (eq == string::npos) ? "" : param.substr(eq + 1);
+		string::size_type colon = key.find(':');
+		istringstream v(value);
+		if (key == "simtime")
+			v >> point.simtime;
+		else if (key == "simcount")
+			v >> point.simcount;
+		else if (key == "seed")
+			v >> point.seed;
+		else if (key == "outpath")
+			point.outpath = value;
+		else if (key == "source"){
+			replace(value.begin(), value.end(), ':', ' ');
+			point.source = value;
+		}
+		else if ((key.compare(0, 2, "B:") == 0 || key.compare(0, 2, "E:") == 0)
+				&& find(field.fieldnames.begin(), field.fieldnames.end(), key.substr(2)) != field.fieldnames.end())
+			v >> (key[0] == 'B' ? point.Bscales : point.Escales)[key.substr(2)];
+		else if (colon != string::npos && (key.substr(0, colon) == "all" || key.substr(0, colon) == NAME_NEUTRON || key.substr(0, colon) == NAME_PROTON || key.substr(0, colon) == NAME_ELECTRON))
+			point.particleoptions[key.substr(0, colon)][key.substr(colon + 1)] = value;
+		else
+			v.setstate(ios::failbit);
+		if (value.empty() || !v || colon == key.size() - 1){
+			cout << "Invalid parameter '" << param << "' in sweep point " << name << "!\n";
+			return false;
+		}
+	}
+	return true;
+}
+
+
+/**
+ * Check source definition of a sweep point and create its output directory.
+ *
+ * @param point Sweep point
+ * @param basepath Output path given on the command line
+ * @param pointpath Returns output directory of sweep point
+ *
+ * @return Returns false and prints an error if the source is invalid or the output directory could not be created
+ */
+bool PrepareSweepPoint(const TSweepPoint &point, const string &basepath, string &pointpath){
+	if (!point.source.empty()){
+		istringstream sourcedef(point.source);
+		string sourcemode, sourceparams;
+		sourcedef >> sourcemode;
+		getline(sourcedef, sourceparams);
+		if (!TSource::Check(sourcemode, sourceparams)){
+			cout << "Invalid source in sweep point " << point.name << "!\n";
+			return false;
+		}
+	}
+	pointpath = point.outpath.empty() ? basepath + "/" + point.name : point.outpath;
+	if (mkdir(pointpath.c_str(), 0777) != 0 && errno != EEXIST){
+		cout << "Could not create " << pointpath << "!\n";
+		return false;
+	}
+	return true;
+}
+
+
+/**
+ * Read sweep points.
+ *
+ * Each line contains the name of a point followed by its parameters, see ::ParseSweepPoint.
+ * Exits program if a parameter is invalid.
+ *
+ * @param sweepconf Map of point names and parameters, if empty a single point with the global settings is returned
+ * @param field Fields, used to check field names
+ *
+ * @return Returns list of sweep points
+ */
+vector<TSweepPoint> ParseSweep(map<string, string> &sweepconf, TFieldManager &field){
+	vector<TSweepPoint> sweep;
+	TSweepPoint point;
+	if (sweepconf.empty()){
+		ParseSweepPoint("", "", point, field);
+		sweep.push_back(point);
+	}
+	for (map<string, string>::iterator i = sweepconf.begin(); i != sweepconf.end(); i++){
+		if (!ParseSweepPoint(i->first, i->second, point, field))
+			exit(-1);
+		sweep.push_back(point);
+	}
+	return sweep;
+}
+
+
+/**
+ * Output directory of a worker process started by the launcher (see option workers in config.in).
+ *
+ * @param basejob Job number of launcher
+ * @param worker Index of worker
+ *
+ * @return Returns subdirectory of output path
+ */
+string WorkerPath(long long basejob, int worker){
+	ostringstream path;
+	path << outpath << "/" << setw(12) << setfill('0') << basejob << setw(0) << "worker" << worker;
+	return path.str();
+}
+
+
+/**
+ * Merge output of all worker processes into the output path and remove it from the workers' directories.
+ *
+ * Log files of all workers are merged into one file with the job number of the launcher, in the order of the workers.
+ * Histograms of all workers are added to ::histograms, particle states are merged into savefile.
+ * Files which cannot be merged (e.g. neutron distributions) stay in the workers' directories.
+ *
+ * @param basejob Job number of launcher
+ */
+void MergeWorkerOutput(long long basejob){
+	map<string, vector<string> > logs; // worker files for each merged file name, in the order of the workers
+	vector<string> states, merged;
+	for (int i = 0; i < workers; i++){
+		string path = WorkerPath(basejob, i);
+		DIR *dir = opendir(path.c_str());
+		if (!dir)
+			continue;
+		ostringstream prefix;
+		prefix << setw(12) << setfill('0') << basejob*workers + i;
+		for (dirent *entry = readdir(dir); entry; entry = readdir(dir)){
+			string name = entry->d_name;
+			if (name == "particles.state")
+				states.push_back(path + "/" + name);
+			else if (name.compare(0, prefix.str().size(), prefix.str()) != 0)
+				continue;
+			else if (name.size() > 4 && (name.compare(name.size() - 4, 4, ".out") == 0 || name.compare(name.size() - 4, 4, ".bin") == 0))
+				logs[name.substr(prefix.str().size())].push_back(path + "/" + name);
+			else if (name.size() > 5 && name.compare(name.size() - 5, 5, ".hist") == 0)
+				merged.push_back(path + "/" + name);
+		}
+		closedir(dir);
+		if (histograms)
+			histograms->Add(path + "/" + prefix.str());
+	}
+	ostringstream baseprefix;
+	baseprefix << outpath << "/" << setw(12) << setfill('0') << basejob;
+	for (map<string, vector<string> >::iterator i = logs.begin(); i != logs.end(); i++){
+		if (VERBOSE(VERBOSITY_SUMMARY))
+			cout << "Merging " << i->second.size() << " worker logs into " << baseprefix.str() << i->first << '\n';
+		MergeLogFiles(i->second, baseprefix.str() + i->first);
+		merged.insert(merged.end(), i->second.begin(), i->second.end());
+	}
+	if (!states.empty()){
+		TParticleStateFile::Merge(states, savefile);
+		merged.insert(merged.end(), states.begin(), states.end());
+	}
+	for (vector<string>::iterator i = merged.begin(); i != merged.end(); i++)
+		remove(i->c_str());
+	for (int i = 0; i < workers; i++)
+		rmdir(WorkerPath(basejob, i).c_str()); // fails if files are left
+}
+
+
+/**
+ * Print estimates of all observables with their statistical uncertainties.
+ *
+ * Each observable is estimated as the mean of the weights counted for each primary particle,
+ * its uncertainty as the standard error of this mean.
+ *
+ * @param nsimulated Number of simulated primary particles
+ *
+ * @return Returns true if relative uncertainties of all observables are below targeterror
+ */
+bool CheckConvergence(int nsimulated){
+	bool converged = true;
+	for (vector<TObservable>::iterator i = observables.begin(); i != observables.end(); i++){
+		double mean = i->sum/nsimulated;
+		double error = (nsimulated > 1) ? sqrt(max(0., i->sum2/nsimulated - mean*mean)/(nsimulated - 1)) : numeric_limits<double>::infinity();
+		double relerror = (mean > 0) ? error/mean : numeric_limits<double>::infinity();
+		converged &= relerror <= targeterror;
+		if (VERBOSE(VERBOSITY_SUMMARY))
+			printf("%i particles: %s = %g +- %g (%.3g%%)\n", nsimulated, i->definition.c_str(), mean, error, relerror*100);
+	}
+	return converged;
+}
+
+
 /**
  * Print final particles statistics.
  */
-void OutputCodes(map<string, map<int, int> > &ID_counter){
+void OutputCodes(map<string, map<int, int> > &ID_counter, map<string, map<int, double> > &weight_counter){
+	const int IDs[] = {2, 1, 0, -1, -2, -3, -4, -5, -6, -7, -8};
+	const char *fates[] = {"were absorbed on a surface", "were absorbed in a material", "were not categorized", "did not finish",
+			"hit outer boundaries", "produced integration error", "decayed", "found no initial position",
+			"encountered CGAL error", "encountered geometry error", "were stopped by Russian roulette"};
 	cout << "\nThe simulated particles suffered following fates:\n";
 	for (map<string, map<int, int> >::iterator i = ID_counter.begin(); i != ID_counter.end(); i++){
 		map<int, int> counts = i->second;
+		map<int, double> weights = weight_counter[i->first];
 		const char *name = i->first.c_str();
-		printf("%4i: %6i %10s(s) were absorbed on a surface\n",	 2, counts[ 2], name);
-		printf("%4i: %6i %10s(s) were absorbed in a material\n", 1, counts[ 1], name);
-		printf("%4i: %6i %10s(s) were not categorized\n",		 0, counts[ 0], name);
-		printf("%4i: %6i %10s(s) did not finish\n",				-1, counts[-1], name);
-		printf("%4i: %6i %10s(s) hit outer boundaries\n",		-2, counts[-2], name);
-		printf("%4i: %6i %10s(s) produced integration error\n", -3, counts[-3], name);
-		printf("%4i: %6i %10s(s) decayed\n",					-4, counts[-4], name);
-		printf("%4i: %6i %10s(s) found no initial position\n",	-5, counts[-5], name);
-		printf("%4i: %6i %10s(s) encountered CGAL error\n",		-6, counts[-6], name);
-		printf("%4i: %6i %10s(s) encountered geometry error\n",	-7, counts[-7], name);
+		bool weighted = false; // print sums of weights only if any particle had a weight != 1
+		for (map<int, int>::iterator j = counts.begin(); j != counts.end(); j++)
+			weighted |= weights[j->first] != j->second;
+		for (unsigned int j = 0; j < sizeof(IDs)/sizeof(IDs[0]); j++){
+			printf("%4i: %6i %10s(s) %s", IDs[j], counts[IDs[j]], name, fates[j]);
+			if (weighted)
+				printf(" (sum of weights %g)", weights[IDs[j]]);
+			printf("\n");
+		}
 		printf("\n");
 	}
 }
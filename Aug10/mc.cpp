@@ -1,16 +1,36 @@
 #include <cmath>
+#include <algorithm>
 #include <sys/time.h>
 
 #include "mc.h"
 #include "globals.h"
 
+static const int DENSITY_INTEGRATION_STEPS = 10000; ///< number of steps used to normalize user-defined distributions
 
-TMCGenerator::TMCGenerator(const char *infile){
-	// get high resolution timestamp to generate seed
-	timespec highrestime;
-	clock_gettime(CLOCK_REALTIME, &highrestime);
-	seed = (uint64_t)highrestime.tv_sec * (uint64_t)1000000000 + (uint64_t)highrestime.tv_nsec;
-	std::cout << "Random Seed: " << seed << "\n\n";
+
+/**
+ * Mix bits of a 64-bit number (finalizer of the splitmix64 generator)
+ *
+ * @param x Number to mix
+ *
+ * @return Returns mixed number
+ */
+static uint64_t SplitMix64(uint64_t x){
+	x = (x ^ (x >> 30))*0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27))*0x94d049bb133111ebULL;
+	return x ^ (x >> 31);
+}
+
+
+TMCGenerator::TMCGenerator(const char *infile, uint64_t aseed): seed(aseed){
+	if (seed == 0){
+		// get high resolution timestamp to generate seed
+		timespec highrestime;
+		clock_gettime(CLOCK_REALTIME, &highrestime);
+		seed = (uint64_t)highrestime.tv_sec * (uint64_t)1000000000 + (uint64_t)highrestime.tv_nsec;
+	}
+	if (VERBOSE(VERBOSITY_SUMMARY))
+		std::cout << "Random Seed: " << seed << "\n\n";
 	rangen.seed(seed);
 
 	TConfig invars; ///< contains variables from *.in file
@@ -47,14 +67,77 @@ TMCGenerator::TMCGenerator(const char *infile){
 			std::cout << exc.GetMsg();
 			exit(-1);
 		}
+		pconf->spectrumnorm = AcceptanceIntegral(pconf->spectrum, pconf->Emin, pconf->Emax);
+		pconf->phi_v_norm = AcceptanceIntegral(pconf->phi_v, pconf->phi_v_min, pconf->phi_v_max);
+		pconf->theta_v_norm = AcceptanceIntegral(pconf->theta_v, pconf->theta_v_min, pconf->theta_v_max);
 	}
 }
 
 
+TMCGenerator::TMCGenerator(const TMCGenerator &mc, uint64_t aseed): pconfigs(mc.pconfigs), seed(aseed){
+	rangen.seed(seed);
+	for (std::map<std::string, TParticleConfig>::iterator i = pconfigs.begin(); i != pconfigs.end(); i++){ // copied parsers still point to x variable of mc
+		i->second.spectrum.DefineVar("x", &xvar);
+		i->second.phi_v.DefineVar("x", &xvar);
+		i->second.theta_v.DefineVar("x", &xvar);
+	}
+}
+
 
 TMCGenerator::~TMCGenerator(){
 }
 
+double TMCGenerator::AcceptanceIntegral(mu::Parser &dist, double min, double max){
+	double sum = 0;
+	try{
+		for (int i = 0; i < DENSITY_INTEGRATION_STEPS; i++){ // midpoint rule, acceptance probability is clamped to [0..1] like in the rejection sampling
+			xvar = min + (i + 0.5)*(max - min)/DENSITY_INTEGRATION_STEPS;
+			sum += std::max(0., std::min(1., dist.Eval()));
+		}
+	}
+	catch (mu::Parser::exception_type &exc){ // distribution not defined for this particle
+		return 0;
+	}
+	return sum*(max - min)/DENSITY_INTEGRATION_STEPS;
+}
+
+double TMCGenerator::DistDensity(mu::Parser &dist, double min, double max, double norm, double x){
+	if (min == max)
+		return 1;
+	if (norm <= 0 || x < min || x > max)
+		return 0;
+	xvar = x;
+	try{
+		return std::max(0., std::min(1., dist.Eval()))/norm;
+	}
+	catch (mu::Parser::exception_type &exc){
+		std::cout << exc.GetMsg();
+		exit(-1);
+	}
+}
+
+void TMCGenerator::SetSeed(uint64_t aseed){
+	seed = aseed;
+	if (VERBOSE(VERBOSITY_SUMMARY))
+		std::cout << "Random Seed: " << seed << "\n\n";
+	rangen.seed(seed);
+}
+
+uint64_t TMCGenerator::StreamSeed(uint64_t aseed, int stream){
+	return SplitMix64(SplitMix64(aseed) + (stream + 1)*0x9e3779b97f4a7c15ULL);
+}
+
+std::string TMCGenerator::GetState(){
+	std::ostringstream state;
+	state << rangen;
+	return state.str();
+}
+
+void TMCGenerator::SetState(const std::string &state){
+	std::istringstream s(state);
+	s >> rangen;
+}
+
 double TMCGenerator::UniformDist(double min, double max){
 	if (min == max)
 		return min;
@@ -259,6 +342,17 @@ void TMCGenerator::AngularDist(const std::string &particlename, double &phi_v, d
 	}
 }
 
+double TMCGenerator::SpectrumDensity(const std::string &particlename, double E){
+	TParticleConfig *pconfig = &pconfigs[particlename];
+	return DistDensity(pconfig->spectrum, pconfig->Emin, pconfig->Emax, pconfig->spectrumnorm, E);
+}
+
+double TMCGenerator::AngularDensity(const std::string &particlename, double phi_v, double theta_v){
+	TParticleConfig *pconfig = &pconfigs[particlename];
+	return DistDensity(pconfig->phi_v, pconfig->phi_v_min, pconfig->phi_v_max, pconfig->phi_v_norm, phi_v)
+			*DistDensity(pconfig->theta_v, pconfig->theta_v_min, pconfig->theta_v_max, pconfig->theta_v_norm, theta_v);
+}
+
 double TMCGenerator::LifeTime(const std::string &particlename){
 	double tau = pconfigs[particlename].tau;
 	if (tau != 0)
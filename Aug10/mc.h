@@ -31,6 +31,9 @@ struct TParticleConfig{
 	double theta_v_min; ///< Parsed minimum for initial polarl angle of velocity given by user
 	double theta_v_max; ///< Parsed maximum for initial polar angle of velocity given by user
 	mu::Parser theta_v; ///< Parsed initial polar angle distribution of velocity given by user
+	double spectrumnorm; ///< integral of acceptance probability of energy spectrum over [Emin..Emax]
+	double phi_v_norm; ///< integral of acceptance probability of azimuthal angle distribution over [phi_v_min..phi_v_max]
+	double theta_v_norm; ///< integral of acceptance probability of polar angle distribution over [theta_v_min..theta_v_max]
 };
 
 /**
@@ -42,6 +45,30 @@ private:
 	double xvar; ///< x variable for formula parser
 	std::map<std::string, TParticleConfig> pconfigs;
 
+	/**
+	 * Integrate acceptance probability of a user-defined distribution
+	 *
+	 * @param dist Parsed distribution
+	 * @param min Lower limit
+	 * @param max Upper limit
+	 *
+	 * @return Returns integral of acceptance probability, zero if distribution cannot be evaluated
+	 */
+	double AcceptanceIntegral(mu::Parser &dist, double min, double max);
+
+	/**
+	 * Normalized probability density of values diced from a user-defined distribution
+	 *
+	 * @param dist Parsed distribution
+	 * @param min Lower limit
+	 * @param max Upper limit
+	 * @param norm Integral of acceptance probability, see TMCGenerator::AcceptanceIntegral
+	 * @param x Value
+	 *
+	 * @return Returns probability density at x, 1 if min == max (fixed value)
+	 */
+	double DistDensity(mu::Parser &dist, double min, double max, double norm, double x);
+
 public:
 	uint64_t seed; ///< initial random seed
 
@@ -51,8 +78,19 @@ public:
 	 * Create random seed and read infile.
 	 *
 	 * @param infile Path to configuration file
+	 * @param aseed Random seed, if zero a seed is created from the current time
 	 */
-	TMCGenerator(const char *infile);
+	TMCGenerator(const char *infile, uint64_t aseed = 0);
+
+	/**
+	 * Constructor.
+	 *
+	 * Copy particle configurations already read by another generator and seed an independent random number generator, without any output.
+	 *
+	 * @param mc Generator whose particle configurations are copied
+	 * @param aseed Random seed
+	 */
+	TMCGenerator(const TMCGenerator &mc, uint64_t aseed);
 
 	/**
 	 * Destructor.
@@ -61,6 +99,40 @@ public:
 	 */
 	~TMCGenerator();
 
+	/**
+	 * Reset random number generator with a new seed
+	 *
+	 * @param aseed Random seed
+	 */
+	void SetSeed(uint64_t aseed);
+
+	/**
+	 * Derive seed of an independent random number stream
+	 *
+	 * Seeds of different streams and of runs with similar seeds (e.g. consecutive job seeds) are unrelated, so their random number sequences do not overlap.
+	 * Streams 0, 1, 2, ... are used by producer threads, streams -1, -2, ... by worker processes.
+	 *
+	 * @param aseed Seed of main random number generator
+	 * @param stream Number of stream
+	 *
+	 * @return Returns seed of stream
+	 */
+	static uint64_t StreamSeed(uint64_t aseed, int stream);
+
+	/**
+	 * Get state of random number generator
+	 *
+	 * @return Returns state, which can be restored with TMCGenerator::SetState
+	 */
+	std::string GetState();
+
+	/**
+	 * Set state of random number generator
+	 *
+	 * @param state State returned by TMCGenerator::GetState
+	 */
+	void SetState(const std::string &state);
+
 	/// return uniformly distributed random number in [min..max]
 	double UniformDist(double min, double max);
 	
@@ -112,6 +184,27 @@ public:
 	 */
 	void AngularDist(const std::string &particlename, double &phi_v, double &theta_v);
 
+	/**
+	 * Probability density of energies diced by TMCGenerator::Spectrum
+	 *
+	 * @param particlename Name of the particle (chooses corresponding section in particle.in)
+	 * @param E Energy
+	 *
+	 * @return Returns probability density [1/eV]
+	 */
+	double SpectrumDensity(const std::string &particlename, double E);
+
+	/**
+	 * Probability density of angles diced by TMCGenerator::AngularDist
+	 *
+	 * @param particlename Name of the particle (chooses corresponding section in particle.in)
+	 * @param phi_v Velocity azimuth
+	 * @param theta_v Velocity polar angle
+	 *
+	 * @return Returns probability density per dphi_v dtheta_v [1/rad^2]
+	 */
+	double AngularDensity(const std::string &particlename, double phi_v, double theta_v);
+
 	/**
 	 * Lifetime of different particles
 	 *
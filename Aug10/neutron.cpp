@@ -18,11 +18,11 @@
 
 const char* NAME_NEUTRON = "neutron";
 
-ofstream TNeutron::endout; ///< endlog file stream
-ofstream TNeutron::snapshotout; ///< snapshot file stream
-ofstream TNeutron::trackout; ///< tracklog file stream
-ofstream TNeutron::hitout; ///< hitlog file stream
-ofstream TNeutron::spinout; ///< spinlog file stream
+TLogFile TNeutron::endout; ///< endlog file
+TLogFile TNeutron::snapshotout; ///< snapshot file
+TLogFile TNeutron::trackout; ///< tracklog file
+TLogFile TNeutron::hitout; ///< hitlog file
+TLogFile TNeutron::spinout; ///< spinlog file
 
 
 TNeutron::TNeutron(int number, double t, double x, double y, double z, double E, double phi, double theta, TMCGenerator &amc, TGeometry &geometry, TFieldManager *afield)
@@ -51,11 +51,13 @@ bool TNeutron::MRValid(state_type y, const double normal[3], solid *leaving, sol
 		if (2*mat->RMSRoughness*ki < 1 && 2*mat->RMSRoughness*kt < 1)
 			return true;
 	}
-	cout << "MR model not applicable on material " << mat->name << ". Falling back to Lambert model!\n";
+	if (VERBOSE(VERBOSITY_STEP))
+		cout << "MR model not applicable on material " << mat->name << ". Falling back to Lambert model!\n";
 	return false;
 }
 
 double TNeutron::MRDist(bool transmit, bool integral, state_type y, const double normal[3], solid *leaving, solid *entering, double theta, double phi){
+	NMR++;
 	double v2 = y[3]*y[3] + y[4]*y[4] + y[5]*y[5]; // velocity squared
 	double vnormal = y[3]*normal[0] + y[4]*normal[1] + y[5]*normal[2]; // velocity projected onto surface normal
 	double E = 0.5*m_n*v2; // kinetic energy
@@ -147,7 +149,7 @@ double TNeutron::MRDistMax(bool transmit, state_type y, const double normal[3],
 }
 
 void TNeutron::Transmit(value_type x1, state_type y1, value_type &x2, state_type &y2, int &polarisation,
-			const double normal[3], solid *leaving, solid *entering, bool &trajectoryaltered, bool &traversed){
+			const double normal[3], solid *leaving, solid *entering, bool &trajectoryaltered, bool &traversed, bool &diffuse){
 	value_type vnormal = y1[3]*normal[0] + y1[4]*normal[1] + y1[5]*normal[2]; // velocity normal to reflection plane
 	material *mat = vnormal < 0 ? &entering->mat : &leaving->mat;
 	double prob = mc->UniformDist(0,1);
@@ -167,7 +169,8 @@ void TNeutron::Transmit(value_type x1, state_type y1, value_type &x2, state_type
 	else
 		diffprob = mat->DiffProb; // use fixed probability of diffuse scattering for simple Lambert model
 
-	if (prob < diffprob){ // diffuse transmission
+	diffuse = prob < diffprob;
+	if (diffuse){ // diffuse transmission
 		double theta_t, phi_t;
 		if (UseMRModel){
 			double MRmax = MRDistMax(true, y1, normal, leaving, entering);
@@ -194,7 +197,7 @@ void TNeutron::Transmit(value_type x1, state_type y1, value_type &x2, state_type
 }
 
 void TNeutron::Reflect(value_type x1, state_type y1, value_type &x2, state_type &y2, int &polarisation,
-			const double normal[3], solid *leaving, solid *entering, bool &trajectoryaltered, bool &traversed){
+			const double normal[3], solid *leaving, solid *entering, bool &trajectoryaltered, bool &traversed, bool &diffuse, bool &spinflip){
 	value_type vnormal = y1[3]*normal[0] + y1[4]*normal[1] + y1[5]*normal[2]; // velocity normal to reflection plane
 	//particle was neither transmitted nor absorbed, so it has to be reflected
 	double prob = mc->UniformDist(0,1);
@@ -206,7 +209,8 @@ void TNeutron::Reflect(value_type x1, state_type y1, value_type &x2, state_type
 	else
 		diffprob = mat->DiffProb;
 //	cout << "prob: " << diffprob << '\n';
-	if (prob >= diffprob){
+	diffuse = prob < diffprob;
+	if (!diffuse){
 		//************** specular reflection **************
 //				printf("Specular reflection! Erefl=%LG neV\n",Enormal*1e9);
 		x2 = x1;
@@ -243,7 +247,8 @@ void TNeutron::Reflect(value_type x1, state_type y1, value_type &x2, state_type
 //				printf("Diffuse reflection! Erefl=%LG neV w_e=%LG w_s=%LG\n",Enormal*1e9,phi_r/conv,theta_r/conv);
 	}
 
-	if (mc->UniformDist(0,1) < entering->mat.SpinflipProb){
+	spinflip = mc->UniformDist(0,1) < entering->mat.SpinflipProb;
+	if (spinflip){
 		polarisation *= -1;
 		Nspinflip++;
 	}
@@ -259,6 +264,9 @@ void TNeutron::OnHit(value_type x1, state_type y1, value_type &x2, state_type &y
 	trajectoryaltered = false;
 	traversed = true;
 	value_type prob = mc->UniformDist(0,1);
+	solid leavingsolid = *leaving, enteringsolid = *entering; // keep materials to reweight for alternative material sets
+	THitOutcome outcome = HIT_REFLECTED;
+	bool diffuse = false, spinflip = false;
 
 	value_type Estep = entering->mat.FermiReal*1e-9 - leaving->mat.FermiReal*1e-9;
 //		cout << "Leaving " << leaving->ID << " Entering " << entering->ID << " Enormal = " << Enormal << " Estep = " << Estep;
@@ -267,10 +275,12 @@ void TNeutron::OnHit(value_type x1, state_type y1, value_type &x2, state_type &y
 		long double k2 = sqrt(Enormal - Estep); // wavenumber in second solid (use only real part for transmission!)
 		long double transprob = 4*k1*k2/(k1 + k2)/(k1 + k2); // transmission probability
 //			cout << " TransProb = " << transprob << '\n';
-		if (prob < transprob) // -> transmission
-			Transmit(x1, y1, x2, y2, polarisation, normal, leaving, entering, trajectoryaltered, traversed);
+		if (prob < transprob){ // -> transmission
+			Transmit(x1, y1, x2, y2, polarisation, normal, leaving, entering, trajectoryaltered, traversed, diffuse);
+			outcome = HIT_TRANSMITTED;
+		}
 		else // no transmission -> reflection
-			Reflect(x1, y1, x2, y2, polarisation, normal, leaving, entering, trajectoryaltered, traversed);
+			Reflect(x1, y1, x2, y2, polarisation, normal, leaving, entering, trajectoryaltered, traversed, diffuse, spinflip);
 	}
 	else{
 		double k1 = sqrt(Enormal); // wavenumber in first solid (only real part)
@@ -278,38 +288,116 @@ void TNeutron::OnHit(value_type x1, state_type y1, value_type &x2, state_type &y
 		complex<double> k2 = sqrt(Enormal - iEstep); // wavenumber in second solid (including imaginary part)
 		double reflprob = pow(abs((k1 - k2)/(k1 + k2)), 2); // reflection probability
 //			cout << " ReflProb = " << reflprob << '\n';
-		if (prob > reflprob){ // -> absorption on reflection
+		if (weighted){ // reduce weight by absorption probability and always reflect
+			weight *= reflprob;
+			Reflect(x1, y1, x2, y2, polarisation, normal, leaving, entering, trajectoryaltered, traversed, diffuse, spinflip);
+		}
+		else if (prob > reflprob){ // -> absorption on reflection
 			x2 = x1;
 			y2 = y1; // set end point to point right before collision and set ID to absorbed
 			StopIntegration(ID_ABSORBED_ON_SURFACE, x2, y2, polarisation, *entering);
 			traversed = false;
 			trajectoryaltered = true;
+			outcome = HIT_ABSORBED;
 		}
 		else // no absorption -> reflection
-			Reflect(x1, y1, x2, y2, polarisation, normal, leaving, entering, trajectoryaltered, traversed);
+			Reflect(x1, y1, x2, y2, polarisation, normal, leaving, entering, trajectoryaltered, traversed, diffuse, spinflip);
+	}
+
+	if (!likelihoodratios.empty())
+		ReweightHit(y1, normal, &leavingsolid, &enteringsolid, outcome, diffuse, spinflip);
+}
+
+
+double TNeutron::HitProb(state_type y, const double normal[3], solid *leaving, solid *entering, THitOutcome outcome, bool diffuse, bool spinflip){
+	value_type vnormal = y[3]*normal[0] + y[4]*normal[1] + y[5]*normal[2]; // velocity normal to reflection plane
+	value_type Enormal = 0.5*m_n*vnormal*vnormal; // energy normal to reflection plane
+	value_type Estep = entering->mat.FermiReal*1e-9 - leaving->mat.FermiReal*1e-9;
+	double prob;
+	if (Enormal > Estep){
+		long double k1 = sqrt(Enormal);
+		long double k2 = sqrt(Enormal - Estep);
+		long double transprob = 4*k1*k2/(k1 + k2)/(k1 + k2);
+		if (outcome == HIT_ABSORBED)
+			return 0;
+		prob = outcome == HIT_TRANSMITTED ? transprob : 1 - transprob;
+	}
+	else{
+		double k1 = sqrt(Enormal);
+		complex<double> iEstep(Estep, -entering->mat.FermiImag*1e-9);
+		complex<double> k2 = sqrt(Enormal - iEstep);
+		double reflprob = pow(abs((k1 - k2)/(k1 + k2)), 2);
+		if (outcome == HIT_TRANSMITTED)
+			return 0;
+		if (outcome == HIT_ABSORBED)
+			return 1 - reflprob;
+		prob = reflprob;
+	}
+
+	bool transmit = outcome == HIT_TRANSMITTED;
+	material *mat = vnormal < 0 ? &entering->mat : &leaving->mat;
+	double diffprob;
+	if (mat->UseMRModel && MRValid(y, normal, leaving, entering))
+		diffprob = MRProb(transmit, y, normal, leaving, entering);
+	else
+		diffprob = mat->DiffProb;
+	prob *= diffuse ? diffprob : 1 - diffprob;
+	if (!transmit)
+		prob *= spinflip ? entering->mat.SpinflipProb : 1 - entering->mat.SpinflipProb;
+	return prob;
+}
+
+
+void TNeutron::ReweightHit(state_type y, const double normal[3], solid *leaving, solid *entering, THitOutcome outcome, bool diffuse, bool spinflip){
+	double prob = 0;
+	for (unsigned int i = 0; i < likelihoodratios.size(); i++){
+		solid altleaving = *leaving, altentering = *entering;
+		bool altered = geom->GetAlternativeSolid(i, altleaving);
+		altered |= geom->GetAlternativeSolid(i, altentering);
+		if (altered){ // only material sets containing one of the two materials change the likelihood ratio
+			if (prob == 0)
+				prob = HitProb(y, normal, leaving, entering, outcome, diffuse, spinflip);
+			likelihoodratios[i] *= HitProb(y, normal, &altleaving, &altentering, outcome, diffuse, spinflip)/prob;
+		}
 	}
+}
+
 
+double TNeutron::BulkSurvivalProb(state_type y, double l, const solid &sld){
+	complex<long double> E(0.5*m_n*(y[3]*y[3] + y[4]*y[4] + y[5]*y[5]), sld.mat.FermiImag*1e-9); // E + i*W
+	complex<long double> k = sqrt(2*m_n*E)*ele_e/hbar; // wave vector
+	return exp(-2*imag(k)*l);
 }
 
 
 bool TNeutron::OnStep(value_type x1, state_type y1, value_type &x2, state_type &y2, int &polarisation, solid currentsolid){
 	bool result = false;
+	double l = sqrt(pow(y2[0] - y1[0], 2) + pow(y2[1] - y1[1], 2) + pow(y2[2] - y1[2], 2)); // travelled length
+	double survprob = 1;
 	if (currentsolid.mat.FermiImag > 0){
 		double prob = mc->UniformDist(0,1);
-		complex<long double> E(0.5*m_n*(y1[3]*y1[3] + y1[4]*y1[4] + y1[5]*y1[5]), currentsolid.mat.FermiImag*1e-9); // E + i*W
-		complex<long double> k = sqrt(2*m_n*E)*ele_e/hbar; // wave vector
-		double l = sqrt(pow(y2[0] - y1[0], 2) + pow(y2[1] - y1[1], 2) + pow(y2[2] - y1[2], 2)); // travelled length
-		double survprob = exp(-2*imag(k)*l);
-		if (prob > survprob){ // exponential probability decay
+		survprob = BulkSurvivalProb(y1, l, currentsolid);
+		if (weighted) // reduce weight by absorption probability instead of absorbing particle
+			weight *= survprob;
+		else if (prob > survprob){ // exponential probability decay
 			x2 = x1 + mc->UniformDist(0,1)*(x2 - x1); // if absorbed, chose a random time between x1 and x2
 			for (int i = 0; i < 6; i++)
 				stepper.calc_state(x2, y2);
 			StopIntegration(ID_ABSORBED_IN_MATERIAL, x2, y2, polarisation, currentsolid);
-			printf("Absorption!\n");
+			if (VERBOSE(VERBOSITY_STEP))
+				printf("Absorption!\n");
 			result = true; // stop integration
 		}
 	}
 
+	for (unsigned int i = 0; i < likelihoodratios.size(); i++){ // reweight for alternative material sets
+		solid alt = currentsolid;
+		if (geom->GetAlternativeSolid(i, alt)){
+			double altsurvprob = BulkSurvivalProb(y1, l, alt);
+			likelihoodratios[i] *= result ? (1 - altsurvprob)/(1 - survprob) : altsurvprob/survprob;
+		}
+	}
+
 	// do special calculations for neutrons (spinflipcheck, snapshots, etc)
 	if (neutdist == 1)
 		fillndist(x1, &y1[0], x2, &y2[0]); // write spatial neutron distribution
@@ -344,7 +432,8 @@ bool TNeutron::OnStep(value_type x1, state_type y1, value_type &x2, state_type &
 		{
 			polarisation *= -1;
 			Nspinflip++;
-			printf("\n The spin has flipped! Number of flips: %i\n",Nspinflip);
+			if (VERBOSE(VERBOSITY_STEP))
+				printf("\n The spin has flipped! Number of flips: %i\n",Nspinflip);
 			result = true;
 		}
 	}
@@ -39,12 +39,23 @@ public:
 	 */
 	TNeutron(int number, double t, double x, double y, double z, double E, double phi, double theta, TMCGenerator &amc, TGeometry &geometry, TFieldManager *afield);
 
+	/**
+	 * Close all log files of TNeutrons, following particles create new files.
+	 */
+	static void CloseLogs(){
+		endout.Close();
+		snapshotout.Close();
+		trackout.Close();
+		hitout.Close();
+		spinout.Close();
+	};
+
 protected:
-	static ofstream endout; ///< endlog file stream
-	static ofstream snapshotout; ///< snapshot file stream
-	static ofstream trackout; ///< tracklog file stream
-	static ofstream hitout; ///< hitlog file stream
-	static ofstream spinout; ///< spinlog file stream
+	static TLogFile endout; ///< endlog file
+	static TLogFile snapshotout; ///< snapshot file
+	static TLogFile trackout; ///< tracklog file
+	static TLogFile hitout; ///< hitlog file
+	static TLogFile spinout; ///< spinlog file
 
 	/**
 	 * Check for reflection/transmission/absorption on surfaces.
@@ -72,9 +83,11 @@ protected:
 	 *
 	 * Refracts or scatters the neutron according to Micro Roughness model.
 	 * For parameter documentation see TNeutron::OnHit.
+	 *
+	 * @param diffuse Returns true if the neutron was scattered diffusely
 	 */
 	void Transmit(value_type x1, state_type y1, value_type &x2, state_type &y2, int &polarisation,
-				const double normal[3], solid *leaving, solid *entering, bool &trajectoryaltered, bool &traversed);
+				const double normal[3], solid *leaving, solid *entering, bool &trajectoryaltered, bool &traversed, bool &diffuse);
 
 
 	/**
@@ -82,9 +95,12 @@ protected:
 	 *
 	 * Reflects or scatters the neutron according to Lambert or Micro Roughness model.
 	 * For parameter documentation see TNeutron::OnHit.
+	 *
+	 * @param diffuse Returns true if the neutron was scattered diffusely
+	 * @param spinflip Returns true if the neutron's spin was flipped
 	 */
 	void Reflect(value_type x1, state_type y1, value_type &x2, state_type &y2, int &polarisation,
-				const double normal[3], solid *leaving, solid *entering, bool &trajectoryaltered, bool &traversed);
+				const double normal[3], solid *leaving, solid *entering, bool &trajectoryaltered, bool &traversed, bool &diffuse, bool &spinflip);
 
 
 	/**
@@ -191,16 +207,90 @@ protected:
 	};
 
 
+	/**
+	 * Get track log file.
+	 *
+	 * @return Returns static trackout file to use same file for all TNeutrons
+	 */
+	TLogFile& GetTrackOut(){
+		return trackout;
+	};
+
+
+	/**
+	 * Get hit log file.
+	 *
+	 * @return Returns static hitout file to use same file for all TNeutrons
+	 */
+	TLogFile& GetHitOut(){
+		return hitout;
+	};
+
+
+	/**
+	 * Create copy of particle for population splitting.
+	 *
+	 * @return Returns new TNeutron with identical state
+	 */
+	TParticle* Clone(){
+		return new TNeutron(*this);
+	};
+
+
 	/**
 	 * Get spin log stream.
 	 *
-	 * @return Returns static spinout stream to use same stream for all TNeutrons
+	 * @return Returns static spinout file to use same file for all TNeutrons
 	 */
-	ofstream& GetSpinOut(){
+	TLogFile& GetSpinOut(){
 		return spinout;
 	};
 
 private:
+	/**
+	 * Possible outcomes of a wall interaction
+	 */
+	enum THitOutcome{
+		HIT_TRANSMITTED, ///< neutron was transmitted through the surface
+		HIT_REFLECTED, ///< neutron was reflected
+		HIT_ABSORBED ///< neutron was absorbed on the surface
+	};
+
+	/**
+	 * Probability of a wall interaction's outcome, used to reweight the neutron for alternative material sets.
+	 *
+	 * Diffuse scattering angles are assumed to follow the same distribution for all material sets.
+	 *
+	 * @param y State vector right before hitting the material
+	 * @param normal Normal vector of hit surface
+	 * @param leaving Solid that the particle is leaving
+	 * @param entering Solid that the particle is entering
+	 * @param outcome Outcome of wall interaction
+	 * @param diffuse True if the neutron was scattered diffusely
+	 * @param spinflip True if the neutron's spin was flipped
+	 *
+	 * @return Returns probability of outcome with the materials of leaving and entering
+	 */
+	double HitProb(state_type y, const double normal[3], solid *leaving, solid *entering, THitOutcome outcome, bool diffuse, bool spinflip);
+
+	/**
+	 * Multiply TParticle::likelihoodratios by ratio of the wall interaction's probability with alternative and actual materials.
+	 *
+	 * For parameter documentation see TNeutron::HitProb.
+	 */
+	void ReweightHit(state_type y, const double normal[3], solid *leaving, solid *entering, THitOutcome outcome, bool diffuse, bool spinflip);
+
+	/**
+	 * Probability that the neutron is not absorbed while moving through a solid
+	 *
+	 * @param y State vector at start of path
+	 * @param l Path length
+	 * @param sld Solid through which the neutron is moving
+	 *
+	 * @return Returns survival probability
+	 */
+	double BulkSurvivalProb(state_type y, double l, const solid &sld);
+
 	/**
 	 * Check if the MicroRoughness is model is applicable to the current interaction
 	 *
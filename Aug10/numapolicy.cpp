@@ -0,0 +1,117 @@
+/**
+ * \file
+ * Placement of memory and processes on NUMA nodes.
+ */
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+#include "numapolicy.h"
+
+using namespace std;
+
+static const unsigned int NUMA_MASK_BITS = 8*sizeof(unsigned long); ///< number of nodes per element of a node mask
+
+static bool affinitysaved = false; ///< true if NumaBind saved the original CPU affinity in originalaffinity
+static cpu_set_t originalaffinity; ///< CPU affinity of the process before it was bound to a node by NumaBind
+
+
+/**
+ * Read a comma-separated list of numbers and number ranges from a sysfs file, e.g. 0-7,16-23.
+ *
+ * @param filename Name of file
+ * @param list Returns all numbers in the list
+ *
+ * @return Returns false if the file could not be read
+ */
+static bool ReadRangeList(const string &filename, vector<int> &list){
+	ifstream f(filename.c_str());
+	string ranges;
+	if (!(f >> ranges))
+		return false;
+	istringstream rangelist(ranges);
+	string range;
+	while (getline(rangelist, range, ',')){
+		int first = 0, last;
+		char dash;
+		istringstream r(range);
+		r >> first;
+		if (!(r >> dash >> last)) // single number
+			last = first;
+		for (int i = first; i <= last; i++)
+			list.push_back(i);
+	}
+	return true;
+}
+
+
+/**
+ * Set memory policy of calling thread.
+ *
+ * @param mode Policy (MPOL_*)
+ * @param nodes Nodes used by the policy
+ *
+ * @return Returns false if policy could not be set
+ */
+static bool SetMemPolicy(int mode, const vector<int> &nodes){
+	unsigned long mask[NUMA_MAX_NODES/NUMA_MASK_BITS] = {0};
+	for (vector<int>::const_iterator i = nodes.begin(); i != nodes.end(); i++){
+		if (*i < 0 || *i >= NUMA_MAX_NODES)
+			return false;
+		mask[*i/NUMA_MASK_BITS] |= 1UL << (*i % NUMA_MASK_BITS);
+	}
+	return syscall(SYS_set_mempolicy, mode, nodes.empty() ? NULL : mask, nodes.empty() ? 0 : NUMA_MAX_NODES) == 0;
+}
+
+
+vector<int> NumaNodes(){
+	vector<int> nodes;
+	if (!ReadRangeList("/sys/devices/system/node/online", nodes) || nodes.empty())
+		return vector<int>(1, 0);
+	return nodes;
+}
+
+
+bool NumaInterleave(){
+	return SetMemPolicy(MPOL_INTERLEAVE, NumaNodes());
+}
+
+
+bool NumaBind(int node){
+	ostringstream filename;
+	filename << "/sys/devices/system/node/node" << node << "/cpulist";
+	vector<int> cpulist;
+	if (!ReadRangeList(filename.str(), cpulist))
+		return false;
+
+	cpu_set_t cpus;
+	CPU_ZERO(&cpus);
+	for (vector<int>::iterator cpu = cpulist.begin(); cpu != cpulist.end(); cpu++){
+		if (*cpu >= 0 && *cpu < CPU_SETSIZE)
+			CPU_SET(*cpu, &cpus);
+	}
+	if (!affinitysaved && sched_getaffinity(0, sizeof(originalaffinity), &originalaffinity) == 0)
+		affinitysaved = true;
+	if (CPU_COUNT(&cpus) == 0 || sched_setaffinity(0, sizeof(cpus), &cpus) != 0)
+		return false;
+	return SetMemPolicy(MPOL_PREFERRED, vector<int>(1, node));
+}
+
+
+void NumaUnbind(){
+	if (affinitysaved)
+		sched_setaffinity(0, sizeof(originalaffinity), &originalaffinity);
+	NumaResetPolicy();
+}
+
+
+void NumaResetPolicy(){
+	SetMemPolicy(MPOL_DEFAULT, vector<int>());
+}
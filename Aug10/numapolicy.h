@@ -0,0 +1,52 @@
+/**
+ * \file
+ * Placement of memory and processes on NUMA nodes, see option numa in config.in.
+ *
+ * Uses the Linux system calls directly, so no NUMA library is needed. On machines without NUMA support all functions fail gracefully.
+ */
+
+#ifndef NUMAPOLICY_H_
+#define NUMAPOLICY_H_
+
+#include <vector>
+
+static const int NUMA_MAX_NODES = 1024; ///< max. number of NUMA nodes supported
+
+/**
+ * List NUMA nodes of this machine which are online.
+ *
+ * Node IDs do not have to be contiguous, so they are read from /sys/devices/system/node/online.
+ *
+ * @return Returns IDs of nodes, only node 0 if the machine has no NUMA support
+ */
+std::vector<int> NumaNodes();
+
+/**
+ * Interleave all following memory allocations of the calling thread page by page across all NUMA nodes.
+ *
+ * @return Returns false if memory policy could not be set
+ */
+bool NumaInterleave();
+
+/**
+ * Bind calling process to the CPUs of a NUMA node and prefer this node for all following memory allocations.
+ *
+ * Child processes inherit CPU affinity and memory policy.
+ *
+ * @param node Index of NUMA node
+ *
+ * @return Returns false if CPU affinity or memory policy could not be set
+ */
+bool NumaBind(int node);
+
+/**
+ * Undo NumaBind: restore the CPU affinity the calling process had before its first call of NumaBind and reset its memory policy.
+ */
+void NumaUnbind();
+
+/**
+ * Reset memory policy of calling thread, memory is allocated on the node of the CPU which first touches it.
+ */
+void NumaResetPolicy();
+
+#endif /* NUMAPOLICY_H_ */
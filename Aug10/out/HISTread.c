@@ -0,0 +1,85 @@
+// Convert a binary histogram file (jobnumber + name + ".hist", see [HISTOGRAMS] in config.in) to a ROOT histogram
+// Usage: root [0] .x HISTread.c("000000000000wallhits.hist");
+// The histogram is drawn and written to [filename].root, bin errors are sqrt(sum of squared weights)
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+
+Bool_t HISTreadString(ifstream &infile, TString &s){
+	UInt_t len = 0;
+	infile.read((char*)&len, sizeof(len));
+	if (!infile) return false;
+	std::string buf(len, ' ');
+	if (len > 0) infile.read(&buf[0], len);
+	s = buf.c_str();
+	return infile.good();
+}
+
+void HISTread(TString filename){
+	ifstream infile(filename.Data(), ios_base::in | ios_base::binary);
+	char magic[8];
+	UInt_t header[2]; // file format version, number of axes
+	infile.read(magic, sizeof(magic));
+	infile.read((char*)header, sizeof(header));
+	if (!infile || strncmp(magic, "PENTRKHS", 8) != 0 || header[0] != 1 || header[1] < 1 || header[1] > 3){
+		cout << filename << " is not a histogram file of version 1!" << endl;
+		return;
+	}
+	TString quantity, particle;
+	HISTreadString(infile, quantity);
+	HISTreadString(infile, particle);
+
+	UInt_t naxes = header[1];
+	TString var[3];
+	Double_t min[3] = {0, 0, 0}, max[3] = {1, 1, 1};
+	UInt_t bins[3] = {1, 1, 1};
+	Long64_t total = 1;
+	for (UInt_t i = 0; i < naxes; i++){
+		HISTreadString(infile, var[i]);
+		infile.read((char*)&min[i], sizeof(Double_t));
+		infile.read((char*)&max[i], sizeof(Double_t));
+		infile.read((char*)&bins[i], sizeof(UInt_t));
+		total *= bins[i];
+	}
+	std::vector<Double_t> sum(2*total); // sum of weights followed by sum of squared weights
+	infile.read((char*)&sum[0], sum.size()*sizeof(Double_t));
+	if (!infile){
+		cout << "Could not read " << filename << endl;
+		return;
+	}
+	infile.close();
+
+	TString name = filename;
+	name.ReplaceAll(".hist", "");
+	TString title = quantity + " (" + particle + ")";
+	TH1 *hist;
+	if (naxes == 1)
+		hist = new TH1D(name, title, bins[0], min[0], max[0]);
+	else if (naxes == 2)
+		hist = new TH2D(name, title, bins[0], min[0], max[0], bins[1], min[1], max[1]);
+	else
+		hist = new TH3D(name, title, bins[0], min[0], max[0], bins[1], min[1], max[1], bins[2], min[2], max[2]);
+	hist->GetXaxis()->SetTitle(var[0]);
+	if (naxes > 1) hist->GetYaxis()->SetTitle(var[1]);
+	if (naxes > 2) hist->GetZaxis()->SetTitle(var[2]);
+
+	Long64_t index = 0; // first axis varies slowest in file
+	for (UInt_t i = 0; i < bins[0]; i++){
+		for (UInt_t j = 0; j < bins[1]; j++){
+			for (UInt_t k = 0; k < bins[2]; k++){
+				Int_t bin = naxes == 1 ? hist->GetBin(i + 1) : (naxes == 2 ? hist->GetBin(i + 1, j + 1) : hist->GetBin(i + 1, j + 1, k + 1));
+				hist->SetBinContent(bin, sum[index]);
+				hist->SetBinError(bin, sqrt(sum[total + index]));
+				index++;
+			}
+		}
+	}
+
+	TFile *outfile = new TFile(filename + ".root", "RECREATE");
+	hist->Write();
+	outfile->Close();
+	cout << "Wrote " << filename << ".root" << endl;
+	hist->Draw(naxes == 2 ? "COLZ" : "");
+}
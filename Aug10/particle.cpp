@@ -13,6 +13,32 @@
 
 #include "particle.h"
 #include "bruteforce.h"
+#include "histogram.h"
+
+
+/**
+ * Write value to binary particle state file
+ *
+ * @param f File
+ * @param value Value
+ */
+template<typename T> void WriteStateValue(FILE *f, const T &value){
+	fwrite(&value, sizeof(T), 1, f);
+}
+
+
+/**
+ * Read value from binary particle state file, exits program on failure
+ *
+ * @param f File
+ * @param value Returns value
+ */
+template<typename T> void ReadStateValue(FILE *f, T &value){
+	if (fread(&value, sizeof(T), 1, f) != 1){
+		cout << "Could not read particle state!\n";
+		exit(-1);
+	}
+}
 
 
 double TParticle::Hstart(){
@@ -37,8 +63,10 @@ double TParticle::Eend(){
 TParticle::TParticle(const char *aname, const  double qq, const long double mm, const long double mumu, const long double agamma, int number,
 		double t, double x, double y, double z, double E, double phi, double theta, TMCGenerator &amc, TGeometry &geometry, TFieldManager *afield)
 		: name(aname), q(qq), m(mm), mu(mumu), gamma(agamma), particlenumber(number), ID(ID_UNKNOWN),
-		  tstart(t), tend(t), Hmax(0), lend(0), Nhit(0), Nspinflip(0), noflipprob(1), Nstep(0),
-		  geom(&geometry), mc(&amc), field(afield){
+		  tstart(t), tend(t), Hmax(0), lend(0), Nhit(0), Nspinflip(0), noflipprob(1), Nstep(0), weight(1), likelihoodratios(geometry.materialsets.size(), 1),
+		  densityE(0), densitydir(0), densitypos(0), densityt(0),
+		  walltime(0), Nfield(0), Ncoll(0), maxhitdepth(0), Nspinstep(0), NMR(0), Nreject(0),
+		  geom(&geometry), mc(&amc), field(afield), costlog(false), gendensity(false), weighted(false), Nderiv(0){
 	value_type Eoverm = E/m/c_0/c_0; // gamma - 1
 	value_type beta = sqrt(1-(1/((Eoverm + 1)*(Eoverm + 1)))); // beta = sqrt(1 - 1/gamma^2)
 	value_type vstart;
@@ -68,10 +96,136 @@ TParticle::TParticle(const char *aname, const  double qq, const long double mm,
 TParticle::~TParticle(){
 	for (vector<TParticle*>::reverse_iterator i = secondaries.rbegin(); i != secondaries.rend(); i++)
 		delete *i;
+	for (vector<TParticle*>::reverse_iterator i = splits.rbegin(); i != splits.rend(); i++)
+		delete *i;
+}
+
+
+void TParticle::SaveState(FILE *f){
+	WriteStateValue(f, particlenumber);
+	WriteStateValue(f, tau);
+	WriteStateValue(f, maxtraj);
+	WriteStateValue(f, tstart);
+	WriteStateValue(f, tend);
+	for (int i = 0; i < 6; i++){
+		WriteStateValue(f, ystart[i]);
+		WriteStateValue(f, yend[i]);
+	}
+	WriteStateValue(f, polstart);
+	WriteStateValue(f, polend);
+	WriteStateValue(f, solidstart.ID);
+	WriteStateValue(f, solidend.ID);
+	WriteStateValue(f, Hmax);
+	WriteStateValue(f, lend);
+	WriteStateValue(f, Nhit);
+	WriteStateValue(f, Nspinflip);
+	WriteStateValue(f, noflipprob);
+	WriteStateValue(f, Nstep);
+	WriteStateValue(f, weight);
+	WriteStateValue(f, (unsigned int)likelihoodratios.size());
+	for (unsigned int i = 0; i < likelihoodratios.size(); i++)
+		WriteStateValue(f, likelihoodratios[i]);
+	WriteStateValue(f, densityE);
+	WriteStateValue(f, densitydir);
+	WriteStateValue(f, densitypos);
+	WriteStateValue(f, densityt);
+	WriteStateValue(f, walltime);
+	WriteStateValue(f, Nfield);
+	WriteStateValue(f, Ncoll);
+	WriteStateValue(f, maxhitdepth);
+	WriteStateValue(f, Nspinstep);
+	WriteStateValue(f, NMR);
+	WriteStateValue(f, Nreject);
+	WriteStateValue(f, Nderiv);
+	WriteStateValue(f, (unsigned int)currentsolids.size());
+	for (map<solid, bool>::iterator i = currentsolids.begin(); i != currentsolids.end(); i++){
+		WriteStateValue(f, i->first.ID);
+		WriteStateValue(f, i->second);
+	}
+}
+
+
+/**
+ * Look up solid of a particle state by its ID, exits program if the current geometry has no such solid.
+ *
+ * @param solidsbyID Solids of current geometry indexed by their IDs
+ * @param solidID ID of solid stored in particle state
+ * @param filename Name of state file, printed in error message
+ *
+ * @return Returns solid with ID solidID
+ */
+static const solid& StateSolid(map<unsigned, solid> &solidsbyID, unsigned solidID, const string &filename){
+	map<unsigned, solid>::iterator it = solidsbyID.find(solidID);
+	if (it == solidsbyID.end()){
+		cout << "Solid " << solidID << " of particle state in " << filename << " does not exist in geometry!\n";
+		exit(-1);
+	}
+	return it->second;
+}
+
+
+void TParticle::RestoreState(FILE *f, const std::string &filename){
+	map<unsigned, solid> solidsbyID; // look up solids of current geometry by ID
+	solidsbyID[geom->defaultsolid.ID] = geom->defaultsolid;
+	for (vector<solid>::iterator i = geom->solids.begin(); i != geom->solids.end(); i++)
+		solidsbyID[i->ID] = *i;
+
+	unsigned int solidID, n;
+	ReadStateValue(f, particlenumber);
+	ReadStateValue(f, tau);
+	ReadStateValue(f, maxtraj);
+	ReadStateValue(f, tstart);
+	ReadStateValue(f, tend);
+	for (int i = 0; i < 6; i++){
+		ReadStateValue(f, ystart[i]);
+		ReadStateValue(f, yend[i]);
+	}
+	ReadStateValue(f, polstart);
+	ReadStateValue(f, polend);
+	ReadStateValue(f, solidID);
+	solidstart = StateSolid(solidsbyID, solidID, filename);
+	ReadStateValue(f, solidID);
+	solidend = StateSolid(solidsbyID, solidID, filename);
+	ReadStateValue(f, Hmax);
+	ReadStateValue(f, lend);
+	ReadStateValue(f, Nhit);
+	ReadStateValue(f, Nspinflip);
+	ReadStateValue(f, noflipprob);
+	ReadStateValue(f, Nstep);
+	ReadStateValue(f, weight);
+	ReadStateValue(f, n);
+	if (n != likelihoodratios.size()){
+		cout << "Particle state in " << filename << " contains " << n << " material sets, but geometry defines " << likelihoodratios.size() << "!\n";
+		exit(-1);
+	}
+	for (unsigned int i = 0; i < n; i++)
+		ReadStateValue(f, likelihoodratios[i]);
+	ReadStateValue(f, densityE);
+	ReadStateValue(f, densitydir);
+	ReadStateValue(f, densitypos);
+	ReadStateValue(f, densityt);
+	ReadStateValue(f, walltime);
+	ReadStateValue(f, Nfield);
+	ReadStateValue(f, Ncoll);
+	ReadStateValue(f, maxhitdepth);
+	ReadStateValue(f, Nspinstep);
+	ReadStateValue(f, NMR);
+	ReadStateValue(f, Nreject);
+	ReadStateValue(f, Nderiv);
+	ReadStateValue(f, n);
+	currentsolids.clear();
+	for (unsigned int i = 0; i < n; i++){
+		bool ignored;
+		ReadStateValue(f, solidID);
+		ReadStateValue(f, ignored);
+		currentsolids[StateSolid(solidsbyID, solidID, filename)] = ignored;
+	}
+	ID = ID_UNKNOWN;
 }
 
 
 void TParticle::operator()(state_type y, state_type &dydx, value_type x){
+	Nderiv++;
 	derivs(x,y,dydx);
 }
 
@@ -81,9 +235,11 @@ void TParticle::Integrate(double tmax, map<string, string> &conf){
 		geom->GetSolids(tend, &yend[0], currentsolids);
 
 	int perc = 0;
-	cout << "Particle no.: " << particlenumber << " particle type: " << name << '\n';
-	cout << "x: " << yend[0] << "m y: " << yend[1] << "m z: " << yend[2]
-		 << "m E: " << Eend() << "eV t: " << tend << "s tau: " << tau << "s lmax: " << maxtraj << "m\n";
+	if (VERBOSE(VERBOSITY_PARTICLE)){
+		cout << "Particle no.: " << particlenumber << " particle type: " << name << '\n';
+		cout << "x: " << yend[0] << "m y: " << yend[1] << "m z: " << yend[2]
+			 << "m E: " << Eend() << "eV t: " << tend << "s tau: " << tau << "s lmax: " << maxtraj << "m\n";
+	}
 
 	// set initial values for integrator
 	value_type x = tend, x1, x2;
@@ -106,21 +262,61 @@ void TParticle::Integrate(double tmax, map<string, string> &conf){
 
 	bool tracklog = false;
 	istringstream(conf["tracklog"]) >> tracklog;
+	bool hitlog = false;
+	istringstream(conf["hitlog"]) >> hitlog;
+
+	string logfilter = conf["logfilter"];
+	bool filterlog = (tracklog || hitlog) && logfilter.find_first_not_of(" \t") != string::npos;
+	if (filterlog){ // hold back track and hit log until final state is known
+		LogFilter(logfilter); // check expression before integration
+		unsigned int logfiltermax = 100000;
+		istringstream(conf["logfiltermax"]) >> logfiltermax;
+		if (tracklog)
+			GetTrackOut().BeginDeferred(logfiltermax);
+		if (hitlog)
+			GetHitOut().BeginDeferred(logfiltermax);
+	}
+
 	if (tracklog)
 		PrintTrack(tend, yend, polend, solidend);
 	double trackloginterval = 1e-3;
 	istringstream(conf["trackloginterval"]) >> trackloginterval;
 	value_type lastsave = x;
-
-	bool hitlog = false;
-	istringstream(conf["hitlog"]) >> hitlog;
+	double trackposerror = 0, trackEerror = 0;
+	istringstream(conf["trackposerror"]) >> trackposerror;
+	istringstream(conf["trackEerror"]) >> trackEerror;
+	bool decimatetrack = tracklog && (trackposerror > 0 || trackEerror > 0); // adaptive track decimation replaces fixed track log interval
+	TTrackDecimation trackdecimation;
+	trackdecimation.held = -1;
+	if (decimatetrack)
+		DecimateTrack(trackdecimation, tend, yend, polend, solidend, false, trackposerror, trackEerror);
 
 	bool flipspin;
 	istringstream(conf["flipspin"]) >> flipspin;
 	TBFIntegrator BFint(gamma, name, conf, GetSpinOut());
 
+	istringstream(conf["costlog"]) >> costlog;
+	istringstream(conf["gendensity"]) >> gendensity;
+
+	istringstream(conf["weighted"]) >> weighted;
+	double meanlifetime = 0;
+	istringstream(conf["tau"]) >> meanlifetime;
+	if (weighted)
+		tau = numeric_limits<double>::infinity(); // particle does not decay, decay probability is applied to its weight instead
+
+	double importance = 1;
+	if (!geom->importanceregions.empty())
+		importance = geom->GetImportance(&y[0], GetCurrentsolid());
+	timespec lastupdate;
+	clock_gettime(CLOCK_MONOTONIC, &lastupdate);
+	unsigned long long lastfieldevals = field ? field->Evaluations() : 0;
+	long int lastspinsteps = 0;
+
 	stepper = boost::numeric::odeint::make_dense_output(1e-9, 1e-9, stepper_type());
 
+	if (histograms && tend == tstart) // copies created by population splitting do not fill start histograms again
+		histograms->Fill(name, THistogram::START, tstart, &ystart[0], Estart(), weight);
+
 	while (ID == ID_UNKNOWN){ // integrate as long as nothing happened to particle
 		if (resetintegration){
 			stepper.initialize(y, x, h);
@@ -129,11 +325,13 @@ void TParticle::Integrate(double tmax, map<string, string> &conf){
 		y1 = y;
 
 		try{
+			long long derivs = Nderiv;
 			stepper.do_step(boost::ref(*this));
 			x = stepper.current_time();
 			y = stepper.current_state();
 			h = stepper.current_time_step();
 			Nstep++;
+			Nreject += (Nderiv - derivs)/DOPRI5_EVALUATIONS - 1; // (re)initialization adds a single evaluation, which is dropped by integer division
 		}
 		catch(...){ // catch Exceptions thrown by numerical recipes routines
 			StopIntegration(ID_ODEINT_ERROR, x, y, polarisation, GetCurrentsolid());
@@ -159,6 +357,7 @@ void TParticle::Integrate(double tmax, map<string, string> &conf){
 				stepper.calc_state(x2, y2);
 			}
 
+			int prevNhit = Nhit;
 			resetintegration = CheckHit(x1, y1, x2, y2, polarisation, hitlog); // check if particle hit a material boundary or was absorbed between y1 and y2
 			if (resetintegration){
 				x = x2; // if particle path was changed: reset integration end point
@@ -166,6 +365,21 @@ void TParticle::Integrate(double tmax, map<string, string> &conf){
 			}
 
 			lend += sqrt(pow(y2[0] - y1[0], 2) + pow(y2[1] - y1[1], 2) + pow(y2[2] - y1[2], 2));
+			if (weighted && meanlifetime > 0)
+				weight *= exp(-(x2 - x1)/meanlifetime); // probability that particle has not decayed during this piece
+			if (!geom->importanceregions.empty() && ID == ID_UNKNOWN){
+				double newimportance = geom->GetImportance(&y2[0], GetCurrentsolid());
+				if (newimportance != importance){
+					ChangeImportance(x2, y2, polarisation, newimportance/importance, meanlifetime);
+					importance = newimportance;
+					if (ID != ID_UNKNOWN){ // particle was stopped by Russian roulette
+						x = x2;
+						y = y2;
+					}
+				}
+			}
+			if (histograms)
+				histograms->FillSegment(name, x1, &y1[0], Ekin(&y1[3]), x2, &y2[0], Ekin(&y2[3]), weight);
 			Hmax = max(Ekin(&y2[3]) + Epot(x, y2, polarisation, field, GetCurrentsolid()), Hmax);
 
 			// take snapshots at certain times
@@ -173,14 +387,18 @@ void TParticle::Integrate(double tmax, map<string, string> &conf){
 				if (x1 <= nextsnapshot && x2 > nextsnapshot){
 					state_type ysnap(6);
 					stepper.calc_state(nextsnapshot, ysnap);
-					cout << "\n Snapshot at " << nextsnapshot << " s \n";
+					if (VERBOSE(VERBOSITY_STEP))
+						cout << "\n Snapshot at " << nextsnapshot << " s \n";
 
+					UpdateCost(lastupdate, lastfieldevals, lastspinsteps, BFint);
 					PrintSnapshot(nextsnapshot, ysnap, polarisation, GetCurrentsolid());
 					snapshots >> nextsnapshot;
 				}
 			}
 
-			if (tracklog && x2 - lastsave > trackloginterval/v1){
+			if (decimatetrack)
+				DecimateTrack(trackdecimation, x2, y2, polarisation, GetCurrentsolid(), Nhit != prevNhit, trackposerror, trackEerror); // always keep points after wall hits
+			else if (tracklog && x2 - lastsave > trackloginterval/v1){
 				PrintTrack(x2, y2, polarisation, GetCurrentsolid());
 				lastsave = x2;
 			}
@@ -190,8 +408,11 @@ void TParticle::Integrate(double tmax, map<string, string> &conf){
 				field->BField(y1[0], y1[1], y1[2], x1, B1);
 				field->BField(y2[0], y2[1], y2[2], x2, B2);
 				long double noflip = BFint.Integrate(x1, &y1[0], B1, x2, &y2[0], B2);
-				if (mc->UniformDist(0,1) > noflip)
+				if (mc->UniformDist(0,1) > noflip){
 					polarisation *= -1;
+					if (histograms)
+						histograms->Fill(name, THistogram::SPINFLIPS, x2, &y2[0], Ekin(&y2[3]), weight);
+				}
 				noflipprob *= noflip; // accumulate no-spin-flip probability
 			}
 
@@ -210,28 +431,171 @@ void TParticle::Integrate(double tmax, map<string, string> &conf){
 			StopIntegration(ID_NOT_FINISH, x, y, polarisation, GetCurrentsolid());
 	}
 
+	if (histograms)
+		histograms->Fill(name, THistogram::END, tend, &yend[0], Eend(), weight);
+
+	if (decimatetrack && trackdecimation.held > 0) // write last track point
+		PrintTrack(trackdecimation.last.t, trackdecimation.last.y, trackdecimation.last.polarisation, trackdecimation.last.sld);
+
+	UpdateCost(lastupdate, lastfieldevals, lastspinsteps, BFint);
 	Print(tend, yend, polend, solidend);
 
+	if (filterlog){
+		bool keep = LogFilter(logfilter);
+		if (tracklog){
+			if (keep)
+				GetTrackOut().CommitDeferred();
+			else
+				GetTrackOut().DiscardDeferred();
+		}
+		if (hitlog){
+			if (keep)
+				GetHitOut().CommitDeferred();
+			else
+				GetHitOut().DiscardDeferred();
+		}
+	}
+
 	if (ID == ID_DECAYED){ // if particle reached its lifetime call TParticle::Decay
-		cout << "Decayed!\n";
+		if (VERBOSE(VERBOSITY_PARTICLE))
+			cout << "Decayed!\n";
 		Decay();
 	}
 
-	cout << "x: " << yend[0];
-	cout << " y: " << yend[1];
-	cout << " z: " << yend[2];
-	cout << " E: " << Eend();
-	cout << " Code: " << ID;
-	cout << " t: " << tend;
-	cout << " l: " << lend;
-	cout << " hits: " << Nhit;
-	cout << " spinflips: " << Nspinflip << '\n';
-	cout << "Computation took " << Nstep << " steps\n";
-	cout << "Done!!\n\n";
+	if (VERBOSE(VERBOSITY_PARTICLE)){
+		cout << "x: " << yend[0];
+		cout << " y: " << yend[1];
+		cout << " z: " << yend[2];
+		cout << " E: " << Eend();
+		cout << " Code: " << ID;
+		cout << " t: " << tend;
+		cout << " l: " << lend;
+		cout << " hits: " << Nhit;
+		cout << " spinflips: " << Nspinflip << '\n';
+		cout << "Computation took " << Nstep << " steps\n";
+		cout << "Done!!\n\n";
+	}
 //			cout.flush();
 }
 
 
+void TParticle::ChangeImportance(value_type x, state_type y, int polarisation, double ratio, double meanlifetime){
+	if (ratio > 1){
+		int n = (int)ratio;
+		if (mc->UniformDist(0,1) < ratio - n) // round randomly, so average number of copies equals ratio
+			n++;
+		weight /= ratio;
+		for (int i = 1; i < n; i++){ // particle itself continues as first copy
+			TParticle *p = Clone();
+			p->secondaries.clear();
+			p->splits.clear();
+			p->Nstep = 0; // step and cost counters of copies only count work done after the split, so the shared history is counted once
+			p->walltime = 0;
+			p->Nfield = p->Ncoll = p->Nspinstep = p->NMR = p->Nreject = 0;
+			p->maxhitdepth = 0;
+			p->tend = x;
+			p->yend = y;
+			p->polend = polarisation;
+			p->solidend = GetCurrentsolid();
+			if (!weighted && meanlifetime > 0)
+				p->tau = x - tstart + mc->LifeTime(name); // dice remaining lifetime, so copies decay independently
+			splits.push_back(p);
+		}
+		if (VERBOSE(VERBOSITY_STEP))
+			cout << "\nSplit into " << n << " copies with weight " << weight << '\n';
+	}
+	else if (mc->UniformDist(0,1) < ratio)
+		weight /= ratio;
+	else{
+		weight = 0;
+		StopIntegration(ID_RUSSIAN_ROULETTE, x, y, polarisation, GetCurrentsolid());
+		if (VERBOSE(VERBOSITY_STEP))
+			cout << "\nStopped by Russian roulette\n";
+	}
+}
+
+
+void TParticle::UpdateCost(timespec &lastupdate, unsigned long long &lastfieldevals, long int &lastspinsteps, TBFIntegrator &BFint){
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	walltime += now.tv_sec - lastupdate.tv_sec + (now.tv_nsec - lastupdate.tv_nsec)*1e-9;
+	lastupdate = now;
+	if (field){
+		unsigned long long evals = field->Evaluations();
+		Nfield += evals - lastfieldevals;
+		lastfieldevals = evals;
+	}
+	Nspinstep += BFint.GetTotalIntSteps() - lastspinsteps;
+	lastspinsteps = BFint.GetTotalIntSteps();
+}
+
+
+void TParticle::DecimateTrack(TTrackDecimation &track, value_type x, state_type y, int polarisation, const solid &sld, bool keep, double poserror, double Eerror){
+	TTrackPoint p = {x, y, Ekin(&y[3]), polarisation, sld};
+	if (track.held < 0){ // first point has already been written
+		track.start = p;
+		track.held = 0;
+		return;
+	}
+	value_type tolerance[4] = {poserror/sqrt(3.), poserror/sqrt(3.), poserror/sqrt(3.), Eerror}; // tolerance of each coordinate and kinetic energy
+	for (int j = 0; j < 4; j++){
+		if (tolerance[j] <= 0) // ignore unset tolerance
+			tolerance[j] = numeric_limits<value_type>::infinity();
+	}
+
+	if (track.held > 0){ // check if linear interpolation between last written point and new point is within tolerances at all held back points
+		bool exceeded = track.held >= MAX_TRACK_POINTS;
+		for (int j = 0; j < 4 && !exceeded; j++){
+			value_type slope = ((j < 3 ? p.y[j] : p.E) - (j < 3 ? track.start.y[j] : track.start.E))/(x - track.start.t);
+			exceeded = slope < track.minslope[j] || slope > track.maxslope[j];
+		}
+		if (exceeded){ // write last held back point
+			PrintTrack(track.last.t, track.last.y, track.last.polarisation, track.last.sld);
+			track.start = track.last;
+			track.held = 0;
+		}
+	}
+
+	if (keep){
+		PrintTrack(x, y, polarisation, sld);
+		track.start = p;
+		track.held = 0;
+		return;
+	}
+
+	for (int j = 0; j < 4; j++){ // narrow range of slopes by new held back point
+		value_type d = (j < 3 ? p.y[j] : p.E) - (j < 3 ? track.start.y[j] : track.start.E), dt = x - track.start.t;
+		value_type minslope = (d - tolerance[j])/dt, maxslope = (d + tolerance[j])/dt;
+		if (track.held == 0 || minslope > track.minslope[j])
+			track.minslope[j] = minslope;
+		if (track.held == 0 || maxslope < track.maxslope[j])
+			track.maxslope[j] = maxslope;
+	}
+	track.last = p;
+	track.held++;
+}
+
+
+bool TParticle::LogFilter(const std::string &filter){
+	double IDvar = ID, solidvar = solidend.ID, Nhitvar = Nhit, Evar = Eend(), tvar = tend;
+	try{
+		mu::Parser parser;
+		parser.DefineVar("ID", &IDvar);
+		parser.DefineVar("solidend", &solidvar);
+		parser.DefineVar("Nhit", &Nhitvar);
+		parser.DefineVar("E", &Evar);
+		parser.DefineVar("t", &tvar);
+		parser.SetExpr(filter);
+		return parser.Eval() != 0;
+	}
+	catch (mu::Parser::exception_type &exc){
+		cout << "Invalid logfilter: " << exc.GetMsg() << '\n';
+		exit(-1);
+	}
+	return false;
+}
+
+
 solid TParticle::GetCurrentsolid(){
 	map<solid, bool>::iterator it = currentsolids.begin();
 	while (it->second) // skip over ignored solids
@@ -249,8 +613,10 @@ void TParticle::derivs(value_type x, state_type y, state_type &dydx){
 		F[2] += -gravconst*m*ele_e; // add gravitation to force
 	if (field){
 		double B[4][4], E[3], V; // magnetic/electric field and electric potential in lab frame
-		if (q != 0 || (mu != 0 && polend != 0))
-			field->BField(y[0],y[1],y[2], x, B); // if particle has charge or magnetic moment, calculate magnetic field
+		if (mu != 0 && polend != 0)
+			field->BField(y[0],y[1],y[2], x, B); // if particle has magnetic moment, calculate magnetic field and its gradient
+		else if (q != 0)
+			field->BField(y[0],y[1],y[2], x, B, BFIELD_VALUE); // if particle has charge, Lorentz force only needs field vector
 		if (q != 0)
 			field->EField(y[0],y[1],y[2], x, V, E); // if particle has charge caculate electric field+potential
 		if (q != 0){
@@ -293,15 +659,18 @@ bool TParticle::CheckHitError(solid *hitsolid, double distnormal){
 
 
 bool TParticle::CheckHit(value_type x1, state_type y1, value_type &x2, state_type &y2, int &pol, bool hitlog, int iteration){
+	maxhitdepth = max(maxhitdepth, iteration);
 	solid currentsolid = GetCurrentsolid();
 	if (!geom->CheckSegment(&y1[0], &y2[0])){ // check if start point is inside bounding box of the simulation geometry
-		printf("\nParticle has hit outer boundaries: Stopping it! t=%g x=%g y=%g z=%g\n",x2,y2[0],y2[1],y2[2]);
+		if (VERBOSE(VERBOSITY_PARTICLE))
+			printf("\nParticle has hit outer boundaries: Stopping it! t=%g x=%g y=%g z=%g\n",x2,y2[0],y2[1],y2[2]);
 		StopIntegration(ID_HIT_BOUNDARIES, x2, y2, pol, currentsolid);
 		return true;
 	}
 
 	map<TCollision, bool> colls;
 	bool collfound = false;
+	Ncoll++;
 	try{
 		collfound = geom->GetCollisions(x1, &y1[0], x2, &y2[0], colls);
 	}
@@ -351,11 +720,14 @@ bool TParticle::CheckHit(value_type x1, state_type y1, value_type &x2, state_typ
 					entering = it->first;
 				}
 			}
-//			cout << "Leaving " << leaving.name << ", entering " << entering.name << ", currently " << currentsolid.name << '\n';
+			if (VERBOSE(VERBOSITY_DEBUG))
+				cout << "Leaving " << leaving.name << ", entering " << entering.name << ", currently " << currentsolid.name << '\n';
 			if (leaving.ID != entering.ID){ // if the particle actually traversed a material interface
 				OnHit(x1, y1, x2, y2, pol, coll.normal, &leaving, &entering, trajectoryaltered, traversed); // do particle specific things
 				if (hitlog)
 					PrintHit(x1, y1, y2, prevpol, pol, coll.normal, &leaving, &entering); // print collision to file if requested
+				if (histograms)
+					histograms->Fill(name, THistogram::HITS, x1, &y1[0], Ekin(&y1[3]), weight, leaving.ID, entering.ID);
 				Nhit++;
 			}
 
@@ -366,7 +738,8 @@ bool TParticle::CheckHit(value_type x1, state_type y1, value_type &x2, state_typ
 			if (trajectoryaltered)
 				return true;
 			else if (OnStep(x1, y1, x2, y2, pol, GetCurrentsolid())){ // check for absorption
-				printf("Absorption!\n");
+				if (VERBOSE(VERBOSITY_STEP))
+					printf("Absorption!\n");
 				return true;
 			}
 
@@ -423,28 +796,32 @@ void TParticle::StopIntegration(int aID, value_type x, state_type y, int polaris
 }
 
 
-void TParticle::Print(std::ofstream &file, value_type x, state_type y, int polarisation, solid sld, std::string filesuffix){
+void TParticle::Print(TLogFile &file, value_type x, state_type y, int polarisation, solid sld, std::string filesuffix){
+	bool logweight = weighted || !geom->importanceregions.empty() || !geom->materialsets.empty(); // weights can only differ from 1 in these cases, otherwise keep default log layout
 	if (!file.is_open()){
 		ostringstream filename;
 		filename << outpath << '/' << setw(12) << setfill('0') << jobnumber << name << filesuffix;
-		cout << "Creating " << filename.str() << '\n';
-		file.open(filename.str().c_str());
-		if (!file.is_open()){
-			cout << "Could not create" << filename.str() << '\n';
-			exit(-1);
-		}
-		file <<	"jobnumber particle "
-					"tstart xstart ystart zstart "
-					"vxstart vystart vzstart polstart "
-					"Hstart Estart Bstart Ustart solidstart "
-					"tend xend yend zend "
-					"vxend vyend vzend polend "
-					"Hend Eend Bend Uend solidend "
-					"stopID Nspinflip spinflipprob "
-					"Nhit Nstep trajlength Hmax\n";
-		file.precision(10);
-	}
-	cout << "Printing status\n";
+		string columns =	"jobnumber:q particle:i "
+							"tstart:d xstart ystart zstart "
+							"vxstart vystart vzstart polstart:b "
+							"Hstart Estart Bstart Ustart solidstart:i "
+							"tend:d xend yend zend "
+							"vxend vyend vzend polend:b "
+							"Hend Eend Bend Uend solidend:i "
+							"stopID:b Nspinflip:i spinflipprob "
+							"Nhit:i Nstep:i trajlength Hmax";
+		if (logweight)
+			columns += " weight";
+		for (vector<TMaterialSet>::iterator i = geom->materialsets.begin(); i != geom->materialsets.end(); i++)
+			columns += " weight_" + i->name;
+		if (gendensity)
+			columns += " densityE densitydir densitypos densityt";
+		if (costlog)
+			columns += " walltime Nfield:q Ncoll:q maxhitdepth:i Nspinstep:q NMR:q Nreject:q";
+		file.Open(filename.str(), columns, filesuffix != "end.out"); // snapshots may be stored in single precision like track and hit logs, end logs are not
+	}
+	if (VERBOSE(VERBOSITY_STEP))
+		cout << "Printing status\n";
 
 	value_type E = Ekin(&y[3]);
 	double B[4][4], Ei[3], V;
@@ -452,42 +829,45 @@ void TParticle::Print(std::ofstream &file, value_type x, state_type y, int polar
 	field->BField(ystart[0], ystart[1], ystart[2], tstart, B);
 	field->EField(ystart[0], ystart[1], ystart[2], tstart, V, Ei);
 
-	file	<< jobnumber << " " << particlenumber << " "
-			<< tstart << " " << ystart[0] << " " << ystart[1] << " " << ystart[2] << " "
-			<< ystart[3] << " " << ystart[4] << " " << ystart[5] << " "
-			<< polstart << " " << Hstart() << " " << Estart() << " "
-			<< B[3][3] << " " << V << " " << solidstart.ID << " ";
+	file	<< jobnumber << particlenumber
+			<< tstart << ystart[0] << ystart[1] << ystart[2]
+			<< ystart[3] << ystart[4] << ystart[5]
+			<< polstart << Hstart() << Estart()
+			<< B[3][3] << V << solidstart.ID;
 
 	field->BField(y[0], y[1], y[2], x, B);
 	field->EField(y[0], y[1], y[2], x, V, Ei);
 
-	file	<< x << " " << y[0] << " " << y[1] << " " << y[2] << " "
-			<< y[3] << " " << y[4] << " " << y[5] << " "
-			<< polarisation << " " << E + Epot(x, y, polarisation, field, GetCurrentsolid()) << " " << E << " " // use GetCurrentsolid() for Epot, since particle may not actually have entered sld
-			<< B[3][3] << " " << V << " " << sld.ID << " "
-			<< ID << " " << Nspinflip << " " << 1 - noflipprob << " "
-			<< Nhit << " " << Nstep << " " << lend << " " << Hmax << '\n';
+	file	<< x << y[0] << y[1] << y[2]
+			<< y[3] << y[4] << y[5]
+			<< polarisation << E + Epot(x, y, polarisation, field, GetCurrentsolid()) << E // use GetCurrentsolid() for Epot, since particle may not actually have entered sld
+			<< B[3][3] << V << sld.ID
+			<< ID << Nspinflip << 1 - noflipprob
+			<< Nhit << Nstep << lend << Hmax;
+	if (logweight)
+		file << weight;
+	for (unsigned int i = 0; i < likelihoodratios.size(); i++)
+		file << weight*likelihoodratios[i];
+	if (gendensity)
+		file << densityE << densitydir << densitypos << densityt;
+	if (costlog)
+		file << walltime << Nfield << Ncoll << maxhitdepth << Nspinstep << NMR << Nreject;
+	file.WriteRow();
 }
 
 
-void TParticle::PrintTrack(std::ofstream &trackfile, value_type x, state_type y, int polarisation, solid sld){
+void TParticle::PrintTrack(TLogFile &trackfile, value_type x, state_type y, int polarisation, solid sld){
 	if (!trackfile.is_open()){
 		ostringstream filename;
 		filename << outpath << '/' << setw(12) << setfill('0') << jobnumber << name << "track.out";
-		cout << "Creating " << filename.str() << '\n';
-		trackfile.open(filename.str().c_str());
-		if (!trackfile.is_open()){
-			cout << "Could not create" << filename.str() << '\n';
-			exit(-1);
-		}
-		trackfile << 	"jobnumber particle polarisation "
-						"t x y z vx vy vz "
-						"H E Bx dBxdx dBxdy dBxdz By dBydx "
-						"dBydy dBydz Bz dBzdx dBzdy dBzdz Babs dBdx dBdy dBdz Ex Ey Ez V\n";
-		trackfile.precision(10);
+		trackfile.Open(filename.str(),	"jobnumber:q particle:i polarisation:b "
+										"t:d x y z vx vy vz "
+										"H E Bx dBxdx dBxdy dBxdz By dBydx "
+										"dBydy dBydz Bz dBzdx dBzdy dBzdz Babs dBdx dBdy dBdz Ex Ey Ez V", true); // time keeps double precision to resolve short steps
 	}
 
-	cout << "-";
+	if (VERBOSE(VERBOSITY_STEP))
+		cout << "-";
 	double B[4][4] = {{0,0,0,0},{0,0,0,0},{0,0,0,0},{0,0,0,0}};
 	double E[3] = {0,0,0};
 	double V = 0;
@@ -498,38 +878,34 @@ void TParticle::PrintTrack(std::ofstream &trackfile, value_type x, state_type y,
 	value_type Ek = Ekin(&y[3]);
 	value_type H = Ek + Epot(x, y, polarisation, field, sld);
 
-	trackfile << jobnumber << " " << particlenumber << " " << polarisation << " "
-				<< x << " " << y[0] << " " << y[1] << " " << y[2] << " " << y[3] << " " << y[4] << " " << y[5] << " "
-				<< H << " " << Ek << " ";
+	trackfile << jobnumber << particlenumber << polarisation
+				<< x << y[0] << y[1] << y[2] << y[3] << y[4] << y[5]
+				<< H << Ek;
 	for (int i = 0; i < 4; i++)
 		for (int j = 0; j < 4; j++)
-			trackfile << B[i][j] << " ";
-	trackfile << E[0] << " " << E[1] << " " << E[2] << " " << V << '\n';
+			trackfile << B[i][j];
+	trackfile << E[0] << E[1] << E[2] << V;
+	trackfile.WriteRow();
 }
 
 
-void TParticle::PrintHit(std::ofstream &hitfile, value_type x, state_type y1, state_type y2, int pol1, int pol2, const double *normal, solid *leaving, solid *entering){
+void TParticle::PrintHit(TLogFile &hitfile, value_type x, state_type y1, state_type y2, int pol1, int pol2, const double *normal, solid *leaving, solid *entering){
 	if (!hitfile.is_open()){
 		ostringstream filename;
 		filename << outpath << '/' << setw(12) << setfill('0') << jobnumber << name << "hit.out";
-		cout << "Creating " << filename.str() << '\n';
-		hitfile.open(filename.str().c_str());
-		if (!hitfile.is_open()){
-			cout << "Could not create" << filename.str() << '\n';
-			exit(-1);
-		}
-		hitfile << "jobnumber particle "
-					"t x y z v1x v1y v1z pol1 "
-					"v2x v2y v2z pol2 "
-					"nx ny nz solid1 solid2\n";
-		hitfile.precision(10);
-	}
-
-	cout << ":";
-	hitfile << jobnumber << " " << particlenumber << " "
-			<< x << " " << y1[0] << " " << y1[1] << " " << y1[2] << " " << y1[3] << " " << y1[4] << " " << y1[5] << " " << pol1 << " "
-			<< y2[3] << " " << y2[4] << " " << y2[5] << " " << pol2 << " "
-			<< normal[0] << " " << normal[1] << " " << normal[2] << " " << leaving->ID << " " << entering->ID << '\n';
+		hitfile.Open(filename.str(),	"jobnumber:q particle:i "
+										"t:d x y z v1x v1y v1z pol1:b "
+										"v2x v2y v2z pol2:b "
+										"nx ny nz solid1:i solid2:i", true);
+	}
+
+	if (VERBOSE(VERBOSITY_STEP))
+		cout << ":";
+	hitfile << jobnumber << particlenumber
+			<< x << y1[0] << y1[1] << y1[2] << y1[3] << y1[4] << y1[5] << pol1
+			<< y2[3] << y2[4] << y2[5] << pol2
+			<< normal[0] << normal[1] << normal[2] << leaving->ID << entering->ID;
+	hitfile.WriteRow();
 }
 
 
@@ -551,7 +927,7 @@ double TParticle::Epot(value_type t, state_type y, int polarisation, TFieldManag
 	if ((q != 0 || mu != 0) && field){
 		double B[4][4], E[3], V;
 		if (mu != 0){
-			field->BField(y[0],y[1],y[2],t,B);
+			field->BField(y[0],y[1],y[2],t,B,BFIELD_VALUE);
 			result += -polarisation*mu/ele_e*B[3][0];
 		}
 		if (q != 0){
@@ -9,16 +9,23 @@
 #include <fstream>
 #include <vector>
 #include <map>
+#include <ctime>
+#include <cstdio>
 
 #include <boost/numeric/odeint.hpp>
 
 #include "geometry.h"
 #include "mc.h"
 #include "fields.h"
+#include "logfile.h"
 
 using namespace std;
 
 static const double MAX_SAMPLE_DIST = 0.01; ///< max spatial distance of reflection checks, spin flip calculation, etc; longer integration steps will be interpolated
+static const int MAX_TRACK_POINTS = 1000; ///< max number of track points held back by adaptive track decimation
+static const int DOPRI5_EVALUATIONS = 6; ///< evaluations of the equations of motion per attempted step of the Dormand-Prince stepper (first same as last)
+
+struct TBFIntegrator;
 
 
 /**
@@ -100,7 +107,47 @@ public:
 	/// number of integration steps
 	int Nstep;
 
+	/// statistical weight, reduced by survival probabilities instead of stopping the particle in weighted mode
+	double weight;
+
+	/// likelihood ratios of particle history for each alternative material set in TGeometry::materialsets
+	std::vector<double> likelihoodratios;
+
+	/// probability density of diced start energy, set by the particle source (zero for secondary particles)
+	double densityE;
+
+	/// probability density of diced start direction per dphi dtheta, set by the particle source (zero for secondary particles)
+	double densitydir;
+
+	/// probability density of diced start point, set by the particle source (zero for secondary particles)
+	double densitypos;
+
+	/// probability density of diced start time, set by the particle source (zero for secondary particles)
+	double densityt;
+
+	/// wall-clock time spent integrating [s]
+	double walltime;
+
+	/// number of field evaluations
+	long long Nfield;
+
+	/// number of collision queries
+	long long Ncoll;
+
+	/// max. recursion depth of TParticle::CheckHit
+	int maxhitdepth;
+
+	/// number of spin integration steps
+	long long Nspinstep;
+
+	/// number of micro-roughness model evaluations
+	long long NMR;
+
+	/// number of rejected integration steps
+	long long Nreject;
+
 	std::vector<TParticle*> secondaries; ///< list of secondary particles
+	std::vector<TParticle*> splits; ///< copies of particle created by population splitting, continuing from the point where it entered a more important region
 
 
 	/**
@@ -146,6 +193,25 @@ public:
 	void operator()(state_type y, state_type &dydx, value_type x);
 
 
+	/**
+	 * Write complete state of particle to binary file, so its integration can be continued by TParticle::RestoreState.
+	 *
+	 * Solids are stored by their IDs, secondary particles and copies are not included.
+	 *
+	 * @param f File
+	 */
+	void SaveState(FILE *f);
+
+	/**
+	 * Read particle state written by TParticle::SaveState and prepare particle to continue its integration.
+	 *
+	 * Solids are taken from the current geometry, exits program if state cannot be read or does not fit to the current geometry.
+	 *
+	 * @param f File
+	 * @param filename Name of file, printed in error messages
+	 */
+	void RestoreState(FILE *f, const std::string &filename);
+
 	/**
 	 * Integrate particle trajectory.
 	 *
@@ -165,6 +231,35 @@ protected:
 	TMCGenerator *mc; ///< TMCGenerator structure passed by "Integrate"
 	TFieldManager *field; ///< TFieldManager structure passed by "Integrate"
 	dense_stepper_type stepper; ///< ODE integrator
+	bool costlog; ///< add computational cost columns to end and snapshot logs
+	bool gendensity; ///< add generation probability densities of start variables to end and snapshot logs
+	bool weighted; ///< weighted mode: reduce TParticle::weight instead of letting the particle decay or be absorbed
+	long long Nderiv; ///< number of evaluations of the equations of motion
+
+	/**
+	 * Track point held back by adaptive track decimation
+	 */
+	struct TTrackPoint{
+		value_type t; ///< time
+		state_type y; ///< state vector
+		value_type E; ///< kinetic energy
+		int polarisation; ///< polarisation
+		solid sld; ///< solid in which the particle is
+	};
+
+	/**
+	 * State of adaptive track decimation
+	 *
+	 * Instead of all held back track points, only the range of slopes of a linear interpolation from the last written point
+	 * which stays within the tolerances at all held back points is stored, so each new point is checked in constant time.
+	 */
+	struct TTrackDecimation{
+		TTrackPoint start; ///< last written track point
+		TTrackPoint last; ///< newest held back track point
+		int held; ///< number of held back track points, -1 if no track point was written yet
+		value_type minslope[4]; ///< lower bounds of slopes of x, y, z and kinetic energy allowed by held back points
+		value_type maxslope[4]; ///< upper bounds of slopes of x, y, z and kinetic energy allowed by held back points
+	};
 
 
 	/**
@@ -218,6 +313,36 @@ protected:
 	bool CheckHit(value_type x1, state_type y1, value_type &x2, state_type &y2, int &pol, bool hitlog, int iteration = 1);
 
 
+	/**
+	 * Add wall-clock time, field evaluations and spin integration steps since last call to the particle's cost counters.
+	 *
+	 * @param lastupdate Time of last call, is set to current time
+	 * @param lastfieldevals Value of TFieldManager::Evaluations at last call, is set to current value
+	 * @param lastspinsteps Value of TBFIntegrator::GetTotalIntSteps at last call, is set to current value
+	 * @param BFint Spin integrator used in TParticle::Integrate
+	 */
+	void UpdateCost(timespec &lastupdate, unsigned long long &lastfieldevals, long int &lastspinsteps, TBFIntegrator &BFint);
+
+
+	/**
+	 * Adaptive track decimation, writes track points only where linear interpolation would be too inaccurate.
+	 *
+	 * If linear interpolation between the last written point and the new point deviates from any held back point
+	 * by more than poserror in position or Eerror in kinetic energy, the last held back point is written.
+	 * The position tolerance is checked for each coordinate with poserror/sqrt(3), so the distance never exceeds poserror.
+	 *
+	 * @param track State of decimation, first call (track.held = -1) only marks the already written first track point
+	 * @param x Time of new track point
+	 * @param y State vector of new track point
+	 * @param polarisation Polarisation at new track point
+	 * @param sld Solid in which the particle is at new track point
+	 * @param keep Write new track point in any case (e.g. after a material boundary hit)
+	 * @param poserror Max. position error [m] of linear interpolation, ignored if zero
+	 * @param Eerror Max. kinetic energy error [eV] of linear interpolation, ignored if zero
+	 */
+	void DecimateTrack(TTrackDecimation &track, value_type x, state_type y, int polarisation, const solid &sld, bool keep, double poserror, double Eerror);
+
+
 	/**
 	 * This virtual method is executed, when a particle crosses a material boundary.
 	 *
@@ -339,46 +464,106 @@ protected:
 	 *
 	 * Has to be derived by all derived classes.
 	 *
-	 * @return Reference to spin log stream
+	 * @return Reference to spin log file
+	 */
+	virtual TLogFile& GetSpinOut() = 0;
+
+
+	/**
+	 * Get track log file.
+	 *
+	 * Has to be derived by all derived classes.
+	 *
+	 * @return Reference to track log file
+	 */
+	virtual TLogFile& GetTrackOut() = 0;
+
+
+	/**
+	 * Get hit log file.
+	 *
+	 * Has to be derived by all derived classes.
+	 *
+	 * @return Reference to hit log file
+	 */
+	virtual TLogFile& GetHitOut() = 0;
+
+
+	/**
+	 * Create copy of particle with identical state.
+	 *
+	 * Has to be derived by all derived classes.
+	 *
+	 * @return Returns new particle of same type
+	 */
+	virtual TParticle* Clone() = 0;
+
+
+	/**
+	 * Population splitting and Russian roulette when particle moves into a region of different importance.
+	 *
+	 * If importance increases, the particle is split into on average ratio copies (TParticle::splits), each carrying 1/ratio of its weight.
+	 * Copies keep the particle's history, but start with zero integration steps and cost counters.
+	 * If importance decreases, the particle survives with probability ratio and its weight is divided by ratio,
+	 * otherwise it is stopped with ::ID_RUSSIAN_ROULETTE and its weight is set to zero.
+	 *
+	 * @param x Current time
+	 * @param y Current state vector
+	 * @param polarisation Current polarisation
+	 * @param ratio New importance divided by old importance
+	 * @param meanlifetime Mean lifetime of particle, used to dice new lifetimes of copies (0: no decay)
+	 */
+	void ChangeImportance(value_type x, state_type y, int polarisation, double ratio, double meanlifetime);
+
+
+	/**
+	 * Evaluate log filter expression with the particle's final state.
+	 *
+	 * Variables ID, solidend, Nhit, E (final kinetic energy) and t (final time) can be used in the expression.
+	 * Exits program if expression is invalid.
+	 *
+	 * @param filter Expression, parsed by muParser
+	 *
+	 * @return Returns true if expression evaluates to a non-zero value
 	 */
-	virtual ofstream& GetSpinOut() = 0;
+	bool LogFilter(const std::string &filter);
 
 
 	/**
-	 * Print start and current values to a stream.
+	 * Print start and current values to a log file.
 	 *
 	 * This is a simple prototype that can be called by derived particle classes.
 	 *
-	 * @param file stream to print into
+	 * @param file Log file to print into
 	 * @param x Current time
 	 * @param y Current state vector
 	 * @param polarisation Current polarisation
 	 * @param sld Solid in which the particle is currently.
 	 * @param filesuffix Optional suffix added to the file name (default: "end.out")
 	 */
-	void Print(std::ofstream &file, value_type x, state_type y, int polarisation, solid sld, std::string filesuffix = "end.out");
+	void Print(TLogFile &file, value_type x, state_type y, int polarisation, solid sld, std::string filesuffix = "end.out");
 
 
 	/**
-	 * Print current track point into stream to allow visualization of the particle's trajectory.
+	 * Print current track point into log file to allow visualization of the particle's trajectory.
 	 *
 	 * This is a simple prototype that can be called by derived particle classes.
 	 *
-	 * @param trackfile Stream to print into
+	 * @param trackfile Log file to print into
 	 * @param x Current time
 	 * @param y Current state vector
 	 * @param polarisation Current polarisation
 	 * @param sld Solid in which the particle is currently.
 	 */
-	void PrintTrack(std::ofstream &trackfile, value_type x, state_type y, int polarisation, solid sld);
+	void PrintTrack(TLogFile &trackfile, value_type x, state_type y, int polarisation, solid sld);
 
 
 	/**
-	 * Print material boundary hits into stream.
+	 * Print material boundary hits into log file.
 	 *
 	 * This is a simple prototype that can be called by derived particle classes.
 	 *
-	 * @param hitfile stream to print into
+	 * @param hitfile Log file to print into
 	 * @param x Time of material hit
 	 * @param y1 State vector before material hit
 	 * @param y2 State vector after material hit
@@ -388,7 +573,7 @@ protected:
 	 * @param leaving Material which is left at this boundary
 	 * @param entering Material which is entered at this boundary
 	 */
-	void PrintHit(std::ofstream &hitfile, value_type x, state_type y1, state_type y2, int pol1, int pol2, const double *normal, solid *leaving, solid *entering);
+	void PrintHit(TLogFile &hitfile, value_type x, state_type y1, state_type y2, int pol1, int pol2, const double *normal, solid *leaving, solid *entering);
 
 
 	/**
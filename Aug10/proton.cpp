@@ -8,11 +8,11 @@
 
 const char* NAME_PROTON = "proton";
 
-ofstream TProton::endout; ///< endlog file stream
-ofstream TProton::snapshotout; ///< snapshot file stream
-ofstream TProton::trackout; ///< tracklog file stream
-ofstream TProton::hitout; ///< hitlog file stream
-ofstream TProton::spinout; ///< spinlog file stream
+TLogFile TProton::endout; ///< endlog file
+TLogFile TProton::snapshotout; ///< snapshot file
+TLogFile TProton::trackout; ///< tracklog file
+TLogFile TProton::hitout; ///< hitlog file
+TLogFile TProton::spinout; ///< spinlog file
 
 
 TProton::TProton(int number, double t, double x, double y, double z, double E, double phi, double theta, TMCGenerator &amc, TGeometry &geometry, TFieldManager *afield)
@@ -34,7 +34,8 @@ bool TProton::OnStep(value_type x1, state_type y1, value_type &x2, state_type &y
 		for (int i = 0; i < 6; i++)
 			y2[i] = y1[i];
 		StopIntegration(ID_ABSORBED_IN_MATERIAL, x2, y2, polarisation, currentsolid);
-		printf("Absorption!\n");
+		if (VERBOSE(VERBOSITY_STEP))
+			printf("Absorption!\n");
 		return true;
 	}
 	return false;
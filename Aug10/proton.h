@@ -37,12 +37,23 @@ public:
 	 */
 	TProton(int number, double t, double x, double y, double z, double E, double phi, double theta, TMCGenerator &amc, TGeometry &geometry, TFieldManager *afield);
 
+	/**
+	 * Close all log files of TProtons, following particles create new files.
+	 */
+	static void CloseLogs(){
+		endout.Close();
+		snapshotout.Close();
+		trackout.Close();
+		hitout.Close();
+		spinout.Close();
+	};
+
 protected:
-	static ofstream endout; ///< endlog file stream
-	static ofstream snapshotout; ///< snapshot file stream
-	static ofstream trackout; ///< tracklog file stream
-	static ofstream hitout; ///< hitlog file stream
-	static ofstream spinout; ///< spinlog file stream
+	static TLogFile endout; ///< endlog file
+	static TLogFile snapshotout; ///< snapshot file
+	static TLogFile trackout; ///< tracklog file
+	static TLogFile hitout; ///< hitlog file
+	static TLogFile spinout; ///< spinlog file
 
 	/**
 	 * This method is executed, when a particle crosses a material boundary.
@@ -149,12 +160,42 @@ protected:
 	};
 
 
+	/**
+	 * Get track log file.
+	 *
+	 * @return Returns static trackout file to use same file for all TProtons
+	 */
+	TLogFile& GetTrackOut(){
+		return trackout;
+	};
+
+
+	/**
+	 * Get hit log file.
+	 *
+	 * @return Returns static hitout file to use same file for all TProtons
+	 */
+	TLogFile& GetHitOut(){
+		return hitout;
+	};
+
+
+	/**
+	 * Create copy of particle for population splitting.
+	 *
+	 * @return Returns new TProton with identical state
+	 */
+	TParticle* Clone(){
+		return new TProton(*this);
+	};
+
+
 	/**
 	 * Get spin log stream.
 	 *
-	 * @return Returns static spinout stream to use same stream for all TNeutrons
+	 * @return Returns static spinout file to use same file for all TNeutrons
 	 */
-	ofstream& GetSpinOut(){
+	TLogFile& GetSpinOut(){
 		return spinout;
 	};
 
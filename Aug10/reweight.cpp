@@ -0,0 +1,255 @@
+/**
+ * \file
+ * Reweights end logs written with option gendensity to other start distributions.
+ *
+ * Each particle gets the likelihood ratio target density/generation density for every start variable with a target expression.
+ * Results are self-normalized: the ratios are scaled such that their sum equals the number of reweighted particles,
+ * so the target expressions do not need to be normalized.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+
+#include "muParser.h"
+#include "logfile.h"
+
+using namespace std;
+
+static const char *DENSITY_COLUMNS[] = {"densityE", "densitydir", "densitypos", "densityt"}; ///< end log columns containing generation densities
+static const char *TARGET_OPTIONS[] = {"-E", "-dir", "-pos", "-t"}; ///< command line options setting target densities, same order as ::DENSITY_COLUMNS
+static const unsigned int NDENSITIES = 4; ///< number of start variables
+
+
+/**
+ * Sums of weights per fate or bin
+ */
+struct TWeightSum{
+	unsigned long long N; ///< number of particles
+	double sum; ///< sum of weights
+	double sum2; ///< sum of squared weights
+};
+
+
+/**
+ * One-dimensional histogram of an end log column
+ */
+struct THist{
+	string column; ///< histogrammed column
+	double min; ///< lower edge
+	double max; ///< upper edge
+	vector<TWeightSum> bins; ///< bins
+};
+
+
+/**
+ * Add a weight to a sum
+ *
+ * @param s Sum
+ * @param w Weight
+ */
+void Add(TWeightSum &s, double w){
+	s.N++;
+	s.sum += w;
+	s.sum2 += w*w;
+}
+
+
+/**
+ * Read all rows of a text or binary end log.
+ *
+ * Binary logs are recognized by their file extension ".bin".
+ *
+ * @param filename Name of end log
+ * @param columns Returns column names
+ * @param rows Returns values of all rows, row by row
+ */
+void ReadLog(const string &filename, vector<string> &columns, vector<double> &rows){
+	if (filename.size() >= 4 && filename.compare(filename.size() - 4, 4, ".bin") == 0){
+		TLogFileReader reader(filename);
+		columns = reader.columns;
+		vector<double> block;
+		while (reader.ReadBlock(block))
+			rows.insert(rows.end(), block.begin(), block.end());
+		return;
+	}
+
+	ifstream f(filename.c_str());
+	string header;
+	if (!getline(f, header)){
+		cout << "Could not read " << filename << '\n';
+		exit(-1);
+	}
+	istringstream h(header);
+	string col;
+	while (h >> col)
+		columns.push_back(col);
+	string value;
+	while (f >> value)
+		rows.push_back(strtod(value.c_str(), NULL)); // strtod also parses inf and nan
+	if (rows.size() % columns.size() != 0){
+		cout << "Incomplete row in " << filename << '\n';
+		exit(-1);
+	}
+}
+
+
+/**
+ * Reweight end logs and print fate counts and histograms.
+ *
+ * @param argc Number of parameters passed via the command line
+ * @param argv Array of parameters passed via the command line (./reweight [-E expr] [-dir expr] [-pos expr] [-t expr] [-hist column:min:max:bins] endlog...)
+ * @return Return 0 on success, value !=0 on failure
+ */
+int main(int argc, char **argv){
+	string targets[NDENSITIES];
+	vector<THist> hists;
+	vector<string> files;
+	for (int i = 1; i < argc; i++){
+		string arg = argv[i];
+		unsigned int t = find(TARGET_OPTIONS, TARGET_OPTIONS + NDENSITIES, arg) - TARGET_OPTIONS;
+		if (t < NDENSITIES && i + 1 < argc)
+			targets[t] = argv[++i];
+		else if (arg == "-hist" && i + 1 < argc){
+			string def = argv[++i];
+			replace(def.begin(), def.end(), ':', ' ');
+			istringstream hdef(def);
+			THist h;
+			unsigned int nbins = 0;
+			hdef >> h.column >> h.min >> h.max >> nbins;
+			if (!hdef || nbins == 0 || h.max <= h.min){
+				cout << "Invalid histogram " << argv[i] << '\n';
+				return 1;
+			}
+			TWeightSum zero = {0, 0, 0};
+			h.bins.resize(nbins, zero);
+			hists.push_back(h);
+		}
+		else if (arg[0] != '-')
+			files.push_back(arg);
+		else{
+			files.clear();
+			break;
+		}
+	}
+	if (files.empty()){
+		cout << "Usage:\nreweight [-E expr] [-dir expr] [-pos expr] [-t expr] [-hist column:min:max:bins] path/to/endlog...\n"
+				"Target densities of start energy (-E), direction (-dir), start point (-pos) and start time (-t) are expressions of end log columns, e.g. -E \"sqrt(Estart)*(Estart < 100e-9)\".\n"
+				"Start variables without target keep their generation density. End logs have to be written with option gendensity.\n"
+				"Start points of volume sources with PhaseSpaceWeighting have no generation density and cannot be reweighted with -pos.\n";
+		return 1;
+	}
+
+	map<int, TWeightSum> fates;
+	double sumratio = 0, sumratio2 = 0;
+	unsigned long long skipped = 0;
+	for (vector<string>::iterator file = files.begin(); file != files.end(); file++){
+		vector<string> columns;
+		vector<double> rows;
+		ReadLog(*file, columns, rows);
+		unsigned int ncols = columns.size();
+		vector<double> row(ncols);
+
+		unsigned int stopID = find(columns.begin(), columns.end(), "stopID") - columns.begin();
+		unsigned int weight = find(columns.begin(), columns.end(), "weight") - columns.begin();
+		unsigned int density[NDENSITIES];
+		for (unsigned int i = 0; i < NDENSITIES; i++){
+			density[i] = find(columns.begin(), columns.end(), DENSITY_COLUMNS[i]) - columns.begin();
+			if (density[i] >= ncols){
+				cout << *file << " has no column " << DENSITY_COLUMNS[i] << ", was it written with option gendensity?\n";
+				return 1;
+			}
+		}
+		if (stopID >= ncols){
+			cout << *file << " has no column stopID\n";
+			return 1;
+		}
+		vector<unsigned int> histcols;
+		for (vector<THist>::iterator h = hists.begin(); h != hists.end(); h++){
+			histcols.push_back(find(columns.begin(), columns.end(), h->column) - columns.begin());
+			if (histcols.back() >= ncols){
+				cout << *file << " has no column " << h->column << '\n';
+				return 1;
+			}
+		}
+
+		mu::Parser parsers[NDENSITIES];
+		try{
+			for (unsigned int i = 0; i < NDENSITIES; i++){
+				if (targets[i].empty())
+					continue;
+				for (unsigned int j = 0; j < ncols; j++)
+					parsers[i].DefineVar(columns[j], &row[j]);
+				parsers[i].SetExpr(targets[i]);
+			}
+
+			for (unsigned int r = 0; r < rows.size()/ncols; r++){
+				copy(rows.begin() + r*ncols, rows.begin() + (r + 1)*ncols, row.begin());
+				bool valid = row[density[0]] > 0; // secondary particles have no generation densities
+				double ratio = 1;
+				for (unsigned int i = 0; i < NDENSITIES; i++){
+					if (targets[i].empty())
+						continue;
+					if (std::isnan(row[density[i]])){ // e.g. densitypos of phase-space-weighted volume sources
+						cout << *file << " contains particles with undefined " << DENSITY_COLUMNS[i] << ", they cannot be reweighted with " << TARGET_OPTIONS[i] << '\n';
+						return 1;
+					}
+					if (row[density[i]] > 0)
+						ratio *= max(0., parsers[i].Eval())/row[density[i]];
+					else
+						valid = false;
+				}
+				if (!valid){
+					skipped++;
+					continue;
+				}
+				sumratio += ratio;
+				sumratio2 += ratio*ratio;
+				double w = ratio*((weight < ncols) ? row[weight] : 1);
+				if (!fates.count((int)row[stopID])){
+					TWeightSum zero = {0, 0, 0};
+					fates[(int)row[stopID]] = zero;
+				}
+				Add(fates[(int)row[stopID]], w);
+				for (unsigned int i = 0; i < hists.size(); i++){
+					THist &h = hists[i];
+					double x = row[histcols[i]];
+					if (x >= h.min && x < h.max)
+						Add(h.bins[min(h.bins.size() - 1, (size_t)((x - h.min)/(h.max - h.min)*h.bins.size()))], w);
+				}
+			}
+		}
+		catch (mu::Parser::exception_type &exc){
+			cout << exc.GetMsg() << '\n';
+			return 1;
+		}
+	}
+
+	unsigned long long N = 0;
+	for (map<int, TWeightSum>::iterator i = fates.begin(); i != fates.end(); i++)
+		N += i->second.N;
+	if (N == 0 || sumratio <= 0){
+		cout << "No particles with non-zero target density\n";
+		return 1;
+	}
+	double scale = N/sumratio; // self-normalization
+	printf("%llu particles reweighted, %llu skipped (secondary particles or zero generation density)\n", N, skipped);
+	printf("Effective sample size: %g\n\n", sumratio*sumratio/sumratio2);
+	printf("stopID N reweighted error\n");
+	for (map<int, TWeightSum>::iterator i = fates.begin(); i != fates.end(); i++)
+		printf("%i %llu %g %g\n", i->first, i->second.N, scale*i->second.sum, scale*sqrt(i->second.sum2));
+	for (vector<THist>::iterator h = hists.begin(); h != hists.end(); h++){
+		printf("\n%s_min %s_max N reweighted error\n", h->column.c_str(), h->column.c_str());
+		for (unsigned int i = 0; i < h->bins.size(); i++)
+			printf("%g %g %llu %g %g\n", h->min + i*(h->max - h->min)/h->bins.size(), h->min + (i + 1)*(h->max - h->min)/h->bins.size(),
+					h->bins[i].N, scale*h->bins[i].sum, scale*sqrt(h->bins[i].sum2));
+	}
+	return 0;
+}
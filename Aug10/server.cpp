@@ -0,0 +1,111 @@
+/**
+ * \file
+ * Simulation server accepting jobs on a local UNIX socket.
+ */
+
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <csignal>
+#include <cerrno>
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "server.h"
+
+using namespace std;
+
+static const int REQUEST_TIMEOUT = 10; ///< seconds a client may take to send its request line
+
+TSimulationServer::TSimulationServer(const string &socketpath): fSocketPath(socketpath), fSocket(-1), fConnection(-1), fStdout(-1){
+	sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (socketpath.size() >= sizeof(addr.sun_path)){
+		cout << "Socket path " << socketpath << " is too long!\n";
+		exit(-1);
+	}
+	strcpy(addr.sun_path, socketpath.c_str());
+	struct stat st;
+	if (lstat(socketpath.c_str(), &st) == 0){
+		if (!S_ISSOCK(st.st_mode)){ // never delete other files given by mistake
+			cout << socketpath << " exists and is not a socket!\n";
+			exit(-1);
+		}
+		unlink(socketpath.c_str()); // remove socket left over by previous server
+	}
+	fSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fSocket < 0 || bind(fSocket, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(fSocket, 8) != 0){
+		cout << "Could not create socket " << socketpath << "!\n";
+		exit(-1);
+	}
+	signal(SIGPIPE, SIG_IGN); // do not terminate when a client disconnects during a job
+	cout << "Waiting for jobs on " << socketpath << '\n';
+}
+
+
+TSimulationServer::~TSimulationServer(){
+	Finish();
+	close(fSocket);
+	unlink(fSocketPath.c_str());
+}
+
+
+bool TSimulationServer::Next(string &request){
+	for (;;){
+		fConnection = accept(fSocket, NULL, NULL);
+		if (fConnection < 0){
+			if (errno == EINTR || errno == ECONNABORTED) // interrupted by signal or client gave up before connection was accepted
+				continue;
+			cout << "Could not accept connection on " << fSocketPath << ": " << strerror(errno) << "!\n";
+			exit(-1);
+		}
+		timeval timeout = {REQUEST_TIMEOUT, 0};
+		setsockopt(fConnection, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+		request.clear();
+		char c;
+		ssize_t n;
+		while ((n = read(fConnection, &c, 1)) == 1 && c != '\n')
+			request += c;
+		if (n < 0){ // timeout or error while reading request, drop connection
+			cout << "Could not read request on " << fSocketPath << ": " << strerror(errno) << "!\n";
+			close(fConnection);
+			fConnection = -1;
+			continue;
+		}
+		if (!request.empty() && request[request.size() - 1] == '\r')
+			request.erase(request.size() - 1);
+		if (request == "quit"){
+			close(fConnection);
+			fConnection = -1;
+			return false;
+		}
+		if (request.find_first_not_of(" \t") == string::npos){ // ignore empty requests
+			close(fConnection);
+			fConnection = -1;
+			continue;
+		}
+		cout.flush();
+		fflush(stdout);
+		fStdout = dup(STDOUT_FILENO);
+		dup2(fConnection, STDOUT_FILENO);
+		return true;
+	}
+}
+
+
+void TSimulationServer::Finish(){
+	if (fConnection < 0)
+		return;
+	cout.flush();
+	fflush(stdout);
+	dup2(fStdout, STDOUT_FILENO);
+	close(fStdout);
+	close(fConnection);
+	fStdout = fConnection = -1;
+}
@@ -0,0 +1,61 @@
+/**
+ * \file
+ * Simulation server accepting jobs on a local UNIX socket, see serversocket in config.in.
+ *
+ * A client connects, sends one line "name [parameter=value ...]" with the parameters of a sweep point
+ * and receives the console output of the job until the server closes the connection.
+ * The line "quit" stops the server. Clients which do not send their request within a few seconds are disconnected.
+ */
+
+#ifndef SERVER_H_
+#define SERVER_H_
+
+#include <string>
+
+/**
+ * Server keeping geometry, fields and source loaded between simulation jobs.
+ *
+ * While a job is running, standard output is redirected to the connection of the client which sent it.
+ */
+class TSimulationServer{
+private:
+	std::string fSocketPath; ///< path of UNIX socket
+	int fSocket; ///< listening socket
+	int fConnection; ///< connection of current job, -1 if no job is running
+	int fStdout; ///< original standard output
+
+public:
+	/**
+	 * Constructor, creates socket and listens on it.
+	 *
+	 * Exits program if socket cannot be created or socketpath exists and is not a socket.
+	 *
+	 * @param socketpath Path of socket, an existing socket file is replaced
+	 */
+	TSimulationServer(const std::string &socketpath);
+
+	/**
+	 * Destructor, closes and removes socket
+	 */
+	~TSimulationServer();
+
+	/**
+	 * Wait for next job and redirect standard output to its client.
+	 *
+	 * Connections which do not deliver a request line in time are dropped, so a silent client cannot block the server.
+	 *
+	 * Exits program if connections cannot be accepted anymore.
+	 *
+	 * @param request Returns job request sent by client
+	 *
+	 * @return Returns false if client sent "quit"
+	 */
+	bool Next(std::string &request);
+
+	/**
+	 * Finish current job, restores standard output and closes connection to client.
+	 */
+	void Finish();
+};
+
+#endif /* SERVER_H_ */
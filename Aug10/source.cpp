@@ -4,6 +4,9 @@
  * Class TSource creates one of these according to user input.
  */
 
+#include <fstream>
+#include <limits>
+
 #include "source.h"
 #include "neutron.h"
 #include "proton.h"
@@ -14,6 +17,9 @@
 #include "globals.h"
 
 static const int MAX_DICE_ROLL = 42000000; ///< number of tries to find particle start point
+static const int MAX_VOXELS = 1 << 18; ///< approximate number of voxels used to subdivide STL volume sources
+static const int MAX_POTENTIAL_MAP_CELLS = 1 << 15; ///< approximate number of cells in potential map of volume sources
+static const int POTENTIAL_MAP_TIMES = 11; ///< number of times during ActiveTime at which the potential map is sampled
 
 TParticleSource::TParticleSource(const string ParticleName, double ActiveTime): fActiveTime(ActiveTime), fParticleName(ParticleName), ParticleCounter(0){
 
@@ -40,12 +46,31 @@ TParticle* TParticleSource::CreateParticle(TMCGenerator &mc, double t, double x,
 }
 
 
+TParticle* TParticleSource::CreateParticle(TMCGenerator &mc, const TInitialCondition &ic, TGeometry &geometry, TFieldManager *field){
+	TParticle *p = CreateParticle(mc, ic.t, ic.x, ic.y, ic.z, ic.E, ic.phi, ic.theta, ic.polarisation, geometry, field);
+	if (ic.ID == ID_INITIAL_NOT_FOUND)
+		p->ID = ID_INITIAL_NOT_FOUND;
+	p->densityE = ic.densityE;
+	p->densitydir = ic.densitydir;
+	p->densitypos = ic.densitypos;
+	p->densityt = ic.densityt;
+	return p;
+}
+
+
+TParticle* TParticleSource::CreateParticle(TMCGenerator &mc, TGeometry &geometry, TFieldManager *field){
+	TInitialCondition ic;
+	RandomInitialCondition(mc, geometry, field, ic);
+	return CreateParticle(mc, ic, geometry, field);
+}
+
+
 TSurfaceSource::TSurfaceSource(const string ParticleName, double ActiveTime, double E_normal): TParticleSource(ParticleName, ActiveTime), sourcearea(0), Enormal(E_normal){
 
 }
 
 
-TParticle* TSurfaceSource::CreateParticle(TMCGenerator &mc, TGeometry &geometry, TFieldManager *field){
+void TSurfaceSource::RandomInitialCondition(TMCGenerator &mc, TGeometry &geometry, TFieldManager *field, TInitialCondition &ic){
 	double t = mc.UniformDist(0, fActiveTime);
 	double RandA = mc.UniformDist(0,sourcearea);
 	double SumA = 0;
@@ -64,73 +89,256 @@ TParticle* TSurfaceSource::CreateParticle(TMCGenerator &mc, TGeometry &geometry,
 	CPoint p = i->tri[0] + a*(i->tri[1] - i->tri[0]) + b*(i->tri[2] - i->tri[0]) + nv*REFLECT_TOLERANCE;
 
 	double Ekin = mc.Spectrum(fParticleName);
+	double densityE = mc.SpectrumDensity(fParticleName, Ekin);
 	double phi_v = mc.UniformDist(0, 2*pi); // generate random velocity angles in upper hemisphere
 	double theta_v = mc.SinCosDist(0, 0.5*pi); // Lambert's law!
 	if (Enormal > 0){
 		double vnormal = sqrt(Ekin*cos(theta_v)*cos(theta_v) + Enormal); // add E_normal to component normal to surface
 		double vtangential = sqrt(Ekin)*sin(theta_v);
 		theta_v = atan2(vtangential, vnormal); // update angle
+		densityE = (Ekin > 0) ? densityE*(Ekin + Enormal)/Ekin : 0; // Jacobian of boost (Ekin, cos(theta_v)) -> (Ekin + Enormal, cos(theta_v'))
 		Ekin = vnormal*vnormal + vtangential*vtangential; // update energy
 	}
+	double densitydir = cos(theta_v)/pi; // Lambert's law, per solid angle
 
 	double v[3] = {cos(phi_v)*sin(theta_v), sin(phi_v)*sin(theta_v), cos(theta_v)};
 	double n[3] = {nv[0], nv[1], nv[2]};
 	RotateVector(v, n);
 	phi_v = atan2(v[1],v[0]);
 	theta_v = acos(v[2]);
+	densitydir *= sin(theta_v); // per dphi dtheta in global coordinates
 	int polarisation = mc.DicePolarisation(fParticleName);
 
-	return TParticleSource::CreateParticle(mc, t, p[0], p[1], p[2], Ekin, phi_v, theta_v, polarisation, geometry, field);
+	TInitialCondition result = {t, p[0], p[1], p[2], Ekin, phi_v, theta_v, polarisation, ID_UNKNOWN,
+								densityE, densitydir, 1/sourcearea, (fActiveTime > 0) ? 1/fActiveTime : 1};
+	ic = result;
 }
 
 
-TVolumeSource::TVolumeSource(std::string ParticleName, double ActiveTime, bool PhaseSpaceWeighting)
-			:TParticleSource(ParticleName, ActiveTime), fPhaseSpaceWeighting(PhaseSpaceWeighting){
+TVolumeSource::TVolumeSource(std::string ParticleName, double ActiveTime, int PhaseSpaceWeighting)
+			:TParticleSource(ParticleName, ActiveTime), fPhaseSpaceWeighting(PhaseSpaceWeighting), fCharge(0), fMass(0), fMagMoment(0), fMinFermi(0), fMapValid(true){
+	pthread_mutex_init(&fMapMutex, NULL);
+	if (fParticleName == NAME_NEUTRON){ // same constants as in particle constructors
+		fMass = m_n;
+		fMagMoment = mu_nSI;
+	}
+	else if (fParticleName == NAME_PROTON){
+		fCharge = ele_e;
+		fMass = m_p;
+	}
+	else if (fParticleName == NAME_ELECTRON){
+		fCharge = -ele_e;
+		fMass = m_e;
+	}
+}
+
 
+TVolumeSource::~TVolumeSource(){
+	pthread_mutex_destroy(&fMapMutex);
 }
 
 
-TParticle* TVolumeSource::CreateParticle(TMCGenerator &mc, TGeometry &geometry, TFieldManager *field){
+double TVolumeSource::PotentialEnergy(double t, const double pos[3], int polarisation, TGeometry &geometry, TFieldManager *field){
+	double V = fMass*gravconst*pos[2];
+	if ((fCharge != 0 || fMagMoment != 0) && field){
+		if (fMagMoment != 0){
+			double B[4][4];
+			field->BField(pos[0], pos[1], pos[2], t, B, BFIELD_VALUE);
+			V += -polarisation*fMagMoment/ele_e*B[3][0];
+		}
+		if (fCharge != 0){
+			double Ei[3], phi;
+			field->EField(pos[0], pos[1], pos[2], t, phi, Ei);
+			V += fCharge/ele_e*phi;
+		}
+	}
+	if (fParticleName == NAME_NEUTRON)
+		V += geometry.GetSolid(t, pos).mat.FermiReal*1e-9;
+	return V;
+}
+
+
+void TVolumeSource::InitPotentialMap(TGeometry &geometry, TFieldManager *field){
+	double max[3];
+	SourceBoundingBox(fMapMin, max);
+	int nodes[3];
+	double boxvolume = 1;
+	for (int i = 0; i < 3; i++)
+		boxvolume *= max[i] - fMapMin[i];
+	double edge = pow(boxvolume/MAX_POTENTIAL_MAP_CELLS, 1./3.);
+	for (int i = 0; i < 3; i++){
+		fMapCells[i] = (edge > 0) ? std::max(1, std::min(MAX_POTENTIAL_MAP_CELLS, (int)ceil((max[i] - fMapMin[i])/edge))) : 1;
+		fMapCellSize[i] = (max[i] - fMapMin[i])/fMapCells[i];
+		nodes[i] = fMapCells[i] + 1;
+	}
+
+	fMinFermi = 0; // only neutrons feel the Fermi potential (see PotentialEnergy)
+	if (fParticleName == NAME_NEUTRON){
+		fMinFermi = geometry.defaultsolid.mat.FermiReal;
+		for (vector<solid>::iterator i = geometry.solids.begin(); i != geometry.solids.end(); i++)
+			fMinFermi = std::min(fMinFermi, i->mat.FermiReal);
+		fMinFermi *= 1e-9;
+	}
+
+	int ntimes = (fActiveTime > 0) ? POTENTIAL_MAP_TIMES : 1;
+	if (VERBOSE(VERBOSITY_SUMMARY))
+		cout << "Calculating potential map for " << fParticleName << " source (" << fMapCells[0] << " x " << fMapCells[1] << " x " << fMapCells[2] << " cells) ";
+	double halfdiagonal = 0.5*sqrt(fMapCellSize[0]*fMapCellSize[0] + fMapCellSize[1]*fMapCellSize[1] + fMapCellSize[2]*fMapCellSize[2]);
+	for (int pol = -1; pol <= 1; pol++){
+		vector<double> nodevalues(nodes[0]*nodes[1]*nodes[2], numeric_limits<double>::infinity());
+		vector<double> nodegradients(nodes[0]*nodes[1]*nodes[2], 0); // largest absolute gradient of potential at each node
+		for (int ix = 0; ix < nodes[0]; ix++){
+			for (int iy = 0; iy < nodes[1]; iy++){
+				for (int iz = 0; iz < nodes[2]; iz++){
+					double pos[3] = {fMapMin[0] + ix*fMapCellSize[0], fMapMin[1] + iy*fMapCellSize[1], fMapMin[2] + iz*fMapCellSize[2]};
+					double &V = nodevalues[ix + nodes[0]*(iy + nodes[1]*iz)];
+					double &G = nodegradients[ix + nodes[0]*(iy + nodes[1]*iz)];
+					for (int it = 0; it < ntimes; it++){
+						double t = (ntimes > 1) ? fActiveTime*it/(ntimes - 1) : 0;
+						double Vt = fMass*gravconst*pos[2];
+						double grad[3] = {0, 0, (double)(fMass*gravconst)}; // gradient of potential
+						if ((fCharge != 0 || fMagMoment != 0) && field){
+							if (fMagMoment != 0 && pol != 0){
+								double B[4][4];
+								field->BField(pos[0], pos[1], pos[2], t, B, BFIELD_ALL);
+								Vt += -pol*fMagMoment/ele_e*B[3][0];
+								for (int i = 0; i < 3; i++)
+									grad[i] += -pol*fMagMoment/ele_e*B[3][i + 1];
+							}
+							if (fCharge != 0){
+								double Ei[3], phi;
+								field->EField(pos[0], pos[1], pos[2], t, phi, Ei);
+								Vt += fCharge/ele_e*phi;
+								for (int i = 0; i < 3; i++)
+									grad[i] += -fCharge/ele_e*Ei[i];
+							}
+						}
+						V = std::min(V, Vt);
+						G = std::max(G, sqrt(grad[0]*grad[0] + grad[1]*grad[1] + grad[2]*grad[2]));
+					}
+				}
+			}
+		}
+		if (VERBOSE(VERBOSITY_SUMMARY))
+			cout << '.';
+
+		vector<double> &bound = fMapLowerBound[pol + 1];
+		bound.resize(fMapCells[0]*fMapCells[1]*fMapCells[2]);
+		for (int ix = 0; ix < fMapCells[0]; ix++){
+			for (int iy = 0; iy < fMapCells[1]; iy++){
+				for (int iz = 0; iz < fMapCells[2]; iz++){
+					double Vmin = numeric_limits<double>::infinity(), Vmax = -numeric_limits<double>::infinity(), Gmax = 0;
+					for (int corner = 0; corner < 8; corner++){
+						int node = (ix + (corner & 1)) + nodes[0]*((iy + ((corner >> 1) & 1)) + nodes[1]*(iz + (corner >> 2)));
+						Vmin = std::min(Vmin, nodevalues[node]);
+						Vmax = std::max(Vmax, nodevalues[node]);
+						Gmax = std::max(Gmax, nodegradients[node]);
+					}
+					bound[ix + fMapCells[0]*(iy + fMapCells[1]*iz)] = Vmin - std::max(Vmax - Vmin, 2*Gmax*halfdiagonal) + fMinFermi; // allow for variation of the potential inside the cell
+				}
+			}
+		}
+	}
+	if (VERBOSE(VERBOSITY_SUMMARY))
+		cout << '\n';
+}
+
+
+double TVolumeSource::PotentialLowerBound(const double pos[3], int polarisation){
+	int index = 0, stride = 1;
+	for (int i = 0; i < 3; i++){
+		double c = (pos[i] - fMapMin[i])/fMapCellSize[i];
+		if (!(c >= 0 && c <= fMapCells[i])) // point outside of map (or map cell size zero)
+			return -numeric_limits<double>::infinity();
+		index += std::min((int)c, fMapCells[i] - 1)*stride;
+		stride *= fMapCells[i];
+	}
+	if (polarisation < -1 || polarisation > 1)
+		return -numeric_limits<double>::infinity();
+	return fMapLowerBound[polarisation + 1][index];
+}
+
+
+bool TVolumeSource::PotentialMapValid(){
+	pthread_mutex_lock(&fMapMutex);
+	bool valid = fMapValid;
+	pthread_mutex_unlock(&fMapMutex);
+	return valid;
+}
+
+
+void TVolumeSource::InvalidatePotentialMap(const double pos[3], double V, double bound){
+	pthread_mutex_lock(&fMapMutex);
+	if (fMapValid){
+		printf("\nWarning: potential %g eV at (%g %g %g) is below lower bound %g eV of potential map, switching to exact phase space weighting (PhaseSpaceWeighting 1)!\n"
+				"The start distribution of particles created before may be biased, consider using PhaseSpaceWeighting 1.\n", V, pos[0], pos[1], pos[2], bound);
+		fMapValid = false;
+	}
+	pthread_mutex_unlock(&fMapMutex);
+}
+
+
+void TVolumeSource::RandomInitialCondition(TMCGenerator &mc, TGeometry &geometry, TFieldManager *field, TInitialCondition &ic){
 	double t = mc.UniformDist(0, fActiveTime);
 	double E = mc.Spectrum(fParticleName);
+	double densityE = mc.SpectrumDensity(fParticleName, E);
 	double phi_v, theta_v;
 	mc.AngularDist(fParticleName, phi_v, theta_v);
+	double densitydir = mc.AngularDensity(fParticleName, phi_v, theta_v);
 	int polarisation = mc.DicePolarisation(fParticleName);
 	double x, y, z;
 	RandomPointInSourceVolume(mc, x, y, z);
-	TParticle *p;
+	int ID = ID_UNKNOWN;
 	if (fPhaseSpaceWeighting){
 		double H = E; // if spatial distribution should be weighted by available phase space the energy spectrum N(E) determines the total energy H
-		cout << "Trying to find starting position for " << fParticleName << " with total energy = " << H*1e9 << " neV ";
+		bool usemap = fPhaseSpaceWeighting == 2 && PotentialMapValid();
+		if (VERBOSE(VERBOSITY_PARTICLE))
+			cout << "Trying to find starting position for " << fParticleName << " with total energy = " << H*1e9 << " neV ";
 		for (int nroll = 0; nroll <= MAX_DICE_ROLL; nroll++){
-			if (nroll % 100000 == 0){
+			if (nroll % 100000 == 0 && VERBOSE(VERBOSITY_PARTICLE)){
 				cout << '.'; // print progress
 			}
-			p = TParticleSource::CreateParticle(mc, t, x, y, z, H, phi_v, theta_v, polarisation, geometry, field);
-			ParticleCounter--;
-			double V = p->Hstart() - H; // a particle is created with Ekin = H, so the total energy of particle is actually H + V
-			if (mc.UniformDist(0,1) < sqrt((H - V)/H)){ // weight density with sqrt(Ekin/H)
-				E = H - V; // calculate correct kinetic energy Ekin = H - V
-				delete p;
-				if (E > 0)
-					break;
+			double pos[3] = {x, y, z};
+			double u = mc.UniformDist(0,1);
+			// cheap rejection with lower bound of potential before calculating exact potential, weight density with sqrt(Ekin/H)
+			double bound = usemap ? PotentialLowerBound(pos, polarisation) : 0;
+			if (!usemap || u < sqrt((H - bound)/H)){
+				double V = PotentialEnergy(t, pos, polarisation, geometry, field);
+				if (usemap && V < bound){ // map would have rejected points which should have been accepted
+					InvalidatePotentialMap(pos, V, bound);
+					usemap = false;
+				}
+				if (u < sqrt((H - V)/H)){
+					E = H - V; // calculate correct kinetic energy Ekin = H - V
+					if (E > 0)
+						break;
+				}
 			}
-			else if (nroll >= MAX_DICE_ROLL){
-				p->ID = ID_INITIAL_NOT_FOUND;
-				printf("\nABORT: Failed %i times to find a compatible spot!! NO particle will be simulated!!\n\n", MAX_DICE_ROLL);
-				return p;
+			if (nroll >= MAX_DICE_ROLL){
+				E = H;
+				ID = ID_INITIAL_NOT_FOUND;
+				if (VERBOSE(VERBOSITY_PARTICLE)) // counted as "found no initial position" in the summary
+					printf("\nABORT: Failed %i times to find a compatible spot!! NO particle will be simulated!!\n\n", MAX_DICE_ROLL);
+				break;
 			}
 			RandomPointInSourceVolume(mc, x, y, z);
 		}
+		if (VERBOSE(VERBOSITY_PARTICLE))
+			cout << '\n';
 	}
-	cout << '\n';
-	return TParticleSource::CreateParticle(mc, t, x, y, z, E, phi_v, theta_v, polarisation, geometry, field);
+	TInitialCondition result = {t, x, y, z, E, phi_v, theta_v, polarisation, ID,
+								densityE, densitydir, (SourceVolume() > 0) ? 1/SourceVolume() : 1, (fActiveTime > 0) ? 1/fActiveTime : 1};
+	if (fPhaseSpaceWeighting != 0) // points are accepted with a probability depending on total energy, their density would need the potential in the whole volume
+		result.densitypos = numeric_limits<double>::quiet_NaN();
+	ic = result;
 }
 
 
 
-TCuboidVolumeSource::TCuboidVolumeSource(const string ParticleName, double ActiveTime, bool PhaseSpaceWeighting, double x_min, double x_max, double y_min, double y_max, double z_min, double z_max)
+TCuboidVolumeSource::TCuboidVolumeSource(const string ParticleName, double ActiveTime, int PhaseSpaceWeighting, TGeometry &geometry, TFieldManager *field, double x_min, double x_max, double y_min, double y_max, double z_min, double z_max)
 	: TVolumeSource(ParticleName, ActiveTime, PhaseSpaceWeighting), xmin(x_min), xmax(x_max), ymin(y_min), ymax(y_max), zmin(z_min), zmax(z_max){
+	if (fPhaseSpaceWeighting == 2)
+		InitPotentialMap(geometry, field);
 
 }
 
@@ -142,9 +350,26 @@ void TCuboidVolumeSource::RandomPointInSourceVolume(TMCGenerator &mc, double &x,
 }
 
 
+void TCuboidVolumeSource::SourceBoundingBox(double min[3], double max[3]){
+	min[0] = xmin;
+	min[1] = ymin;
+	min[2] = zmin;
+	max[0] = xmax;
+	max[1] = ymax;
+	max[2] = zmax;
+}
+
+
+double TCuboidVolumeSource::SourceVolume(){
+	return (xmax - xmin)*(ymax - ymin)*(zmax - zmin);
+}
+
+
 
-TCylindricalVolumeSource::TCylindricalVolumeSource(const string ParticleName, double ActiveTime, bool PhaseSpaceWeighting, double r_min, double r_max, double phi_min, double phi_max, double z_min, double z_max)
+TCylindricalVolumeSource::TCylindricalVolumeSource(const string ParticleName, double ActiveTime, int PhaseSpaceWeighting, TGeometry &geometry, TFieldManager *field, double r_min, double r_max, double phi_min, double phi_max, double z_min, double z_max)
 	: TVolumeSource(ParticleName, ActiveTime, PhaseSpaceWeighting), rmin(r_min), rmax(r_max), phimin(phi_min), phimax(phi_max), zmin(z_min), zmax(z_max){
+	if (fPhaseSpaceWeighting == 2)
+		InitPotentialMap(geometry, field);
 
 }
 
@@ -158,6 +383,19 @@ void TCylindricalVolumeSource::RandomPointInSourceVolume(TMCGenerator &mc, doubl
 }
 
 
+void TCylindricalVolumeSource::SourceBoundingBox(double min[3], double max[3]){
+	min[0] = min[1] = -rmax;
+	max[0] = max[1] = rmax;
+	min[2] = zmin;
+	max[2] = zmax;
+}
+
+
+double TCylindricalVolumeSource::SourceVolume(){
+	return 0.5*(rmax*rmax - rmin*rmin)*(phimax - phimin)*(zmax - zmin);
+}
+
+
 bool TCylindricalSurfaceSource::InSourceVolume(CPoint p){
 	double r = sqrt(p[0]*p[0] + p[1]*p[1]);
 	double phi = atan2(p[1],p[0]);
@@ -175,23 +413,112 @@ TCylindricalSurfaceSource::TCylindricalSurfaceSource(const string ParticleName,
 			sourcearea += i->area();
 		}
 	}
-	printf("Source Area: %g m^2\n",sourcearea);
+	if (VERBOSE(VERBOSITY_SUMMARY))
+		printf("Source Area: %g m^2\n",sourcearea);
 }
 
 
-TSTLVolumeSource::TSTLVolumeSource(const string ParticleName, double ActiveTime, bool PhaseSpaceWeighting, string sourcefile): TVolumeSource(ParticleName, ActiveTime, PhaseSpaceWeighting){
+TSTLVolumeSource::TSTLVolumeSource(const string ParticleName, double ActiveTime, int PhaseSpaceWeighting, TGeometry &geometry, TFieldManager *field, string sourcefile): TVolumeSource(ParticleName, ActiveTime, PhaseSpaceWeighting){
 	kdtree.ReadFile(sourcefile.c_str(),0);
+	if (kdtree.triangles.empty()){ // tree of empty mesh has no bounding box
+		printf("Source volume %s is empty! Exiting...\n", sourcefile.c_str());
+		exit(-1);
+	}
 	kdtree.Init();
+	volume = 0; // sum signed volumes of tetrahedra spanned by origin and triangles
+	for (CIterator tri = kdtree.triangles.begin(); tri != kdtree.triangles.end(); tri++)
+		volume += (tri->tri[0] - CGAL::ORIGIN)*CGAL::cross_product(tri->tri[1] - CGAL::ORIGIN, tri->tri[2] - CGAL::ORIGIN)/6;
+	volume = abs(volume);
+	bool flat = false; // voxel grid needs a bounding box with non-zero extent in all directions
+	for (int i = 0; i < 3; i++)
+		flat |= !(kdtree.tree.bbox().max(i) - kdtree.tree.bbox().min(i) > 0);
+	if (volume == 0 || flat){
+		printf("Source volume %s is empty! Exiting...\n", sourcefile.c_str());
+		exit(-1);
+	}
+	InitVoxels();
+	if (insidevoxels.empty() && boundaryvoxels.empty()){ // RandomPointInSourceVolume would never find a point
+		printf("Source volume %s is empty! Exiting...\n", sourcefile.c_str());
+		exit(-1);
+	}
+	if (fPhaseSpaceWeighting == 2)
+		InitPotentialMap(geometry, field);
+}
+
+
+void TSTLVolumeSource::InitVoxels(){
+	double boxvolume = 1;
+	for (int i = 0; i < 3; i++){
+		voxelmin[i] = kdtree.tree.bbox().min(i);
+		boxvolume *= kdtree.tree.bbox().max(i) - voxelmin[i];
+	}
+	double edge = pow(boxvolume/MAX_VOXELS, 1./3.); // edge length of cubic voxels filling the bounding box
+	for (int i = 0; i < 3; i++){
+		double l = kdtree.tree.bbox().max(i) - voxelmin[i];
+		nvoxels[i] = max(1, min(MAX_VOXELS, (int)ceil(l/edge)));
+		voxelsize[i] = l/nvoxels[i];
+	}
+
+	enum {OUTSIDE = 0, INSIDE, BOUNDARY};
+	vector<char> voxeltype(nvoxels[0]*nvoxels[1]*nvoxels[2], OUTSIDE);
+	for (CIterator tri = kdtree.triangles.begin(); tri != kdtree.triangles.end(); tri++){ // mark all voxels touched by a triangle as boundary voxels
+		int imin[3], imax[3];
+		for (int i = 0; i < 3; i++){
+			double tmin = min(tri->tri[0][i], min(tri->tri[1][i], tri->tri[2][i]));
+			double tmax = max(tri->tri[0][i], max(tri->tri[1][i], tri->tri[2][i]));
+			imin[i] = max(0, (int)floor((tmin - voxelmin[i])/voxelsize[i]) - 1); // add one layer of voxels to account for rounding errors
+			imax[i] = min(nvoxels[i] - 1, (int)floor((tmax - voxelmin[i])/voxelsize[i]) + 1);
+		}
+		CVector n = CGAL::cross_product(tri->tri[1] - tri->tri[0], tri->tri[2] - tri->tri[0]); // triangle plane, not normalized to handle degenerate triangles
+		double reach = 0.5*(abs(n[0])*voxelsize[0] + abs(n[1])*voxelsize[1] + abs(n[2])*voxelsize[2]); // max. distance of voxel corners from its center, projected onto n
+		for (int ix = imin[0]; ix <= imax[0]; ix++){
+			for (int iy = imin[1]; iy <= imax[1]; iy++){
+				for (int iz = imin[2]; iz <= imax[2]; iz++){
+					CPoint c(voxelmin[0] + (ix + 0.5)*voxelsize[0], voxelmin[1] + (iy + 0.5)*voxelsize[1], voxelmin[2] + (iz + 0.5)*voxelsize[2]);
+					if (abs(n*(c - tri->tri[0])) <= reach*(1 + 1e-6)) // voxel intersects triangle plane
+						voxeltype[ix + nvoxels[0]*(iy + nvoxels[1]*iz)] = BOUNDARY;
+				}
+			}
+		}
+	}
+
+	for (int ix = 0; ix < nvoxels[0]; ix++){ // all voxels between two boundary voxels in a z column are either inside or outside
+		for (int iy = 0; iy < nvoxels[1]; iy++){
+			char runtype = BOUNDARY;
+			for (int iz = 0; iz < nvoxels[2]; iz++){
+				int index = ix + nvoxels[0]*(iy + nvoxels[1]*iz);
+				if (voxeltype[index] == BOUNDARY)
+					runtype = BOUNDARY;
+				else{
+					if (runtype == BOUNDARY){ // first voxel in run, check its center
+						double c[3] = {voxelmin[0] + (ix + 0.5)*voxelsize[0], voxelmin[1] + (iy + 0.5)*voxelsize[1], voxelmin[2] + (iz + 0.5)*voxelsize[2]};
+						runtype = kdtree.InSolid(c) ? INSIDE : OUTSIDE;
+					}
+					voxeltype[index] = runtype;
+				}
+				if (voxeltype[index] == INSIDE)
+					insidevoxels.push_back(index);
+				else if (voxeltype[index] == BOUNDARY)
+					boundaryvoxels.push_back(index);
+			}
+		}
+	}
+	if (VERBOSE(VERBOSITY_SUMMARY))
+		printf("Source voxels: %u inside, %u on boundary (%i x %i x %i)\n", (unsigned)insidevoxels.size(), (unsigned)boundaryvoxels.size(), nvoxels[0], nvoxels[1], nvoxels[2]);
 }
 
 
 void TSTLVolumeSource::RandomPointInSourceVolume(TMCGenerator &mc, double &x, double &y, double &z){
+	int ninside = insidevoxels.size();
+	int nvox = ninside + boundaryvoxels.size(); // all voxels have the same volume, so choose one with uniform probability
 	double p[3];
 	for(;;){
-		p[0] = mc.UniformDist(kdtree.tree.bbox().xmin(),kdtree.tree.bbox().xmax()); // random point
-		p[1] = mc.UniformDist(kdtree.tree.bbox().ymin(),kdtree.tree.bbox().ymax()); // random point
-		p[2] = mc.UniformDist(kdtree.tree.bbox().zmin(),kdtree.tree.bbox().zmax()); // random point
-		if (kdtree.InSolid(p)){
+		int i = min((int)mc.UniformDist(0, nvox), nvox - 1);
+		int index = (i < ninside) ? insidevoxels[i] : boundaryvoxels[i - ninside];
+		int ivox[3] = {index % nvoxels[0], (index / nvoxels[0]) % nvoxels[1], index / (nvoxels[0]*nvoxels[1])};
+		for (int j = 0; j < 3; j++)
+			p[j] = voxelmin[j] + mc.UniformDist(ivox[j], ivox[j] + 1)*voxelsize[j]; // random point in voxel
+		if (i < ninside || kdtree.InSolid(p)){ // only points in boundary voxels have to be checked
 			x = p[0];
 			y = p[1];
 			z = p[2];
@@ -201,6 +528,19 @@ void TSTLVolumeSource::RandomPointInSourceVolume(TMCGenerator &mc, double &x, do
 }
 
 
+void TSTLVolumeSource::SourceBoundingBox(double min[3], double max[3]){
+	for (int i = 0; i < 3; i++){
+		min[i] = kdtree.tree.bbox().min(i);
+		max[i] = kdtree.tree.bbox().max(i);
+	}
+}
+
+
+double TSTLVolumeSource::SourceVolume(){
+	return volume;
+}
+
+
 TSTLSurfaceSource::TSTLSurfaceSource(const string ParticleName, double ActiveTime, TGeometry &geometry, string sourcefile, double E_normal): TSurfaceSource(ParticleName, ActiveTime, E_normal){
 	TTriangleMesh mesh;
 	mesh.ReadFile(sourcefile.c_str(),0);
@@ -212,35 +552,35 @@ TSTLSurfaceSource::TSTLSurfaceSource(const string ParticleName, double ActiveTim
 			sourcearea += i->area();
 		}
 	}
-	printf("Source Area: %g m^2\n",sourcearea);
+	if (VERBOSE(VERBOSITY_SUMMARY))
+		printf("Source Area: %g m^2\n",sourcearea);
 }
 
 
-TSource::TSource(TConfig &geometryconf, TGeometry &geom, TFieldManager &field): source(NULL){
+TSource::TSource(TConfig &geometryconf, TGeometry &geom, TFieldManager &field): source(NULL), PhaseSpaceWeighting(0){
 	sourcemode = geometryconf["SOURCE"].begin()->first; // only first source in geometry.in is read in
 	istringstream sourceconf(geometryconf["SOURCE"].begin()->second);
 	string ParticleName;
 	sourceconf >> ParticleName;
 
 	double ActiveTime;
-	bool PhaseSpaceWeighting;
 	if (sourcemode == "boxvolume"){
 		double x_min, x_max, y_min, y_max, z_min, z_max;
 		sourceconf >> x_min >> x_max >> y_min >> y_max >> z_min >> z_max >> ActiveTime >> PhaseSpaceWeighting;
 		if (sourceconf)
-			source = new TCuboidVolumeSource(ParticleName, ActiveTime, PhaseSpaceWeighting, x_min, x_max, y_min, y_max, z_min, z_max);
+			source = new TCuboidVolumeSource(ParticleName, ActiveTime, PhaseSpaceWeighting, geom, &field, x_min, x_max, y_min, y_max, z_min, z_max);
 	}
 	else if (sourcemode == "cylvolume"){
 		double r_min, r_max, phi_min, phi_max, z_min, z_max;
 		sourceconf >> r_min >> r_max >> phi_min >> phi_max >> z_min >> z_max >> ActiveTime >> PhaseSpaceWeighting;
 		if (sourceconf)
-			source = new TCylindricalVolumeSource(ParticleName, ActiveTime, PhaseSpaceWeighting, r_min, r_max, phi_min*conv, phi_max*conv, z_min, z_max);
+			source = new TCylindricalVolumeSource(ParticleName, ActiveTime, PhaseSpaceWeighting, geom, &field, r_min, r_max, phi_min*conv, phi_max*conv, z_min, z_max);
 	}
 	else if (sourcemode == "STLvolume"){
 		string sourcefile;
 		sourceconf >> sourcefile >> ActiveTime >> PhaseSpaceWeighting;
 		if (sourceconf)
-			source = new TSTLVolumeSource(ParticleName, ActiveTime, PhaseSpaceWeighting, sourcefile);
+			source = new TSTLVolumeSource(ParticleName, ActiveTime, PhaseSpaceWeighting, geom, &field, sourcefile);
 	}
 	else if (sourcemode == "cylsurface"){
 		double r_min, r_max, phi_min, phi_max, z_min, z_max, E_normal;
@@ -260,7 +600,44 @@ TSource::TSource(TConfig &geometryconf, TGeometry &geom, TFieldManager &field):
 		cout << "\nCould not load source """ << sourcemode << """! Did you enter invalid parameters?\n";
 		exit(-1);
 	}
-	cout << '\n';
+	if (VERBOSE(VERBOSITY_SUMMARY))
+		cout << '\n';
+}
+
+
+bool TSource::Check(const string &sourcemode, const string &params){
+	istringstream sourceconf(params);
+	string ParticleName, sourcefile;
+	sourceconf >> ParticleName;
+	if (ParticleName != NAME_NEUTRON && ParticleName != NAME_PROTON && ParticleName != NAME_ELECTRON){
+		cout << "Unknown particle " << ParticleName << " in source " << sourcemode << "!\n";
+		return false;
+	}
+
+	int nparams; // number of numerical parameters
+	if (sourcemode == "boxvolume" || sourcemode == "cylvolume" || sourcemode == "cylsurface")
+		nparams = 8;
+	else if (sourcemode == "STLvolume" || sourcemode == "STLsurface"){
+		sourceconf >> sourcefile;
+		nparams = 2;
+	}
+	else{
+		cout << "Unknown source " << sourcemode << "!\n";
+		return false;
+	}
+	for (int i = 0; i < nparams; i++){
+		double p;
+		sourceconf >> p;
+	}
+	if (!sourceconf){
+		cout << "Invalid parameters of source " << sourcemode << "!\n";
+		return false;
+	}
+	if (!sourcefile.empty() && !ifstream(sourcefile.c_str()).is_open()){
+		cout << "Could not open " << sourcefile << "!\n";
+		return false;
+	}
+	return true;
 }
 
 
@@ -273,3 +650,8 @@ TSource::~TSource(){
 TParticle* TSource::CreateParticle(TMCGenerator &mc, TGeometry &geometry, TFieldManager *field){
 	return source->CreateParticle(mc, geometry, field);
 }
+
+
+TParticle* TSource::CreateParticle(TMCGenerator &mc, const TInitialCondition &ic, TGeometry &geometry, TFieldManager *field){
+	return source->CreateParticle(mc, ic, geometry, field);
+}
@@ -9,11 +9,33 @@
 
 #include <string>
 
+#include <pthread.h>
+
 #include "particle.h"
 #include "mc.h"
 
 using namespace std;
 
+/**
+ * Initial conditions of a particle, created by a particle source
+ */
+struct TInitialCondition{
+	double t; ///< Starting time
+	double x; ///< x coordinate of creation point
+	double y; ///< y coordinate of creation point
+	double z; ///< z coordinate of creation point
+	double E; ///< Initial kinetic energy
+	double phi; ///< Azimuthal angle of initial velocity vector
+	double theta; ///< Polar angle of initial velocity vector
+	int polarisation; ///< Initial polarisation of particle (-1, 0, 1)
+	int ID; ///< ID_UNKNOWN or ID_INITIAL_NOT_FOUND, if source could not find a starting point
+	double densityE; ///< Probability density of diced energy [1/eV] (total energy for phase-space-weighted volume sources, see TVolumeSource)
+	double densitydir; ///< Probability density of velocity direction per dphi dtheta [1/rad^2]
+	double densitypos; ///< Probability density of creation point [1/m^3 for volume sources, 1/m^2 for surface sources], 1 if source volume is zero, NaN for phase-space-weighted volume sources (see TVolumeSource)
+	double densityt; ///< Probability density of starting time [1/s], 1 if source has no active time
+};
+
+
 /**
  * Virtual base class for all particle sources
  */
@@ -57,7 +79,19 @@ public:
 
 
 	/**
-	 * Virtual routine that has to be implemented by every derived source class
+	 * Create a new particle from initial conditions produced by TParticleSource::RandomInitialCondition
+	 *
+	 * @param mc Random number generator
+	 * @param ic Initial conditions
+	 * @param geometry Experiment geometry
+	 * @param field Optional fields (can be NULL)
+	 *
+	 * @return Returns newly created particle, memory has to be freed by user
+	 */
+	TParticle* CreateParticle(TMCGenerator &mc, const TInitialCondition &ic, TGeometry &geometry, TFieldManager *field);
+
+	/**
+	 * Create random initial conditions and a new particle from them
 	 *
 	 * @param mc Random number generator
 	 * @param geometry Experiment geometry
@@ -65,7 +99,19 @@ public:
 	 *
 	 * @return Returns newly created particle, memory has to be freed by user
 	 */
-	virtual TParticle* CreateParticle(TMCGenerator &mc, TGeometry &geometry, TFieldManager *field) = 0;
+	TParticle* CreateParticle(TMCGenerator &mc, TGeometry &geometry, TFieldManager *field);
+
+	/**
+	 * Virtual routine that has to be implemented by every derived source class
+	 *
+	 * Has to be thread-safe, since it may be called by several TInitialConditionProducer threads, each with its own random number generator.
+	 *
+	 * @param mc Random number generator
+	 * @param geometry Experiment geometry
+	 * @param field Optional field (can be NULL)
+	 * @param ic Returns initial conditions
+	 */
+	virtual void RandomInitialCondition(TMCGenerator &mc, TGeometry &geometry, TFieldManager *field, TInitialCondition &ic) = 0;
 };
 
 
@@ -90,15 +136,17 @@ public:
 	TSurfaceSource(const string ParticleName, double ActiveTime, double E_normal);
 
 	/**
-	 * Create new particle on surface
+	 * Create initial conditions on surface
+	 *
+	 * TInitialCondition::densityE times TInitialCondition::densitydir is the joint density of energy and direction,
+	 * which are correlated if the particles get a boost normal to the surface.
 	 *
 	 * @param mc random number generator
 	 * @param geometry Experiment geometry
 	 * @param field Optional fields (can be NULL)
-	 *
-	 * @return Returns newly created particle, memory has to be freed by user
+	 * @param ic Returns initial conditions
 	 */
-	TParticle* CreateParticle(TMCGenerator &mc, TGeometry &geometry, TFieldManager *field);
+	void RandomInitialCondition(TMCGenerator &mc, TGeometry &geometry, TFieldManager *field, TInitialCondition &ic);
 };
 
 
@@ -111,7 +159,18 @@ public:
  */
 class TVolumeSource: public TParticleSource{
 protected:
-	bool fPhaseSpaceWeighting; ///< Tells source to weight particle density according to available phase space.
+	int fPhaseSpaceWeighting; ///< Tells source to weight particle density according to available phase space (0: no weighting, 1: weighting, 2: weighting using precomputed potential map).
+	double fCharge; ///< Charge of created particles [C]
+	double fMass; ///< Mass of created particles [eV/c^2]
+	double fMagMoment; ///< Magnetic moment of created particles [J/T]
+
+	double fMinFermi; ///< Lowest Fermi potential in geometry [eV], used as lower bound for Fermi potential in potential map
+	double fMapMin[3]; ///< Lower corner of potential map
+	double fMapCellSize[3]; ///< Edge lengths of potential map cells
+	int fMapCells[3]; ///< Number of potential map cells in each direction
+	vector<double> fMapLowerBound[3]; ///< Lower bound of potential energy in each potential map cell, for polarisation -1, 0 and 1
+	bool fMapValid; ///< False if an exact potential was found below the lower bound of its potential map cell, the map is not used any more then
+	pthread_mutex_t fMapMutex; ///< Protects fMapValid, which is checked by all threads creating initial conditions
 
 	/**
 	 * Produce random point in the source volume
@@ -124,6 +183,80 @@ protected:
 	 * @param z Returns z coordinate
 	 */
 	virtual void RandomPointInSourceVolume(TMCGenerator &mc, double &x, double &y, double &z) = 0;
+
+	/**
+	 * Return cuboid containing the complete source volume
+	 *
+	 * Has to be implemented by every derived class
+	 *
+	 * @param min Returns lower corner of cuboid
+	 * @param max Returns upper corner of cuboid
+	 */
+	virtual void SourceBoundingBox(double min[3], double max[3]) = 0;
+
+	/**
+	 * Return volume of source
+	 *
+	 * Has to be implemented by every derived class
+	 *
+	 * @return Returns volume [m^3]
+	 */
+	virtual double SourceVolume() = 0;
+
+	/**
+	 * Calculate potential energy of particle at a point.
+	 *
+	 * Same as TParticle::Epot but without creating a particle.
+	 *
+	 * @param t Time
+	 * @param pos Position
+	 * @param polarisation Polarisation of particle
+	 * @param geometry Experiment geometry, used to get Fermi potential for neutrons
+	 * @param field Optional fields (can be NULL)
+	 *
+	 * @return Returns potential energy [eV]
+	 */
+	double PotentialEnergy(double t, const double pos[3], int polarisation, TGeometry &geometry, TFieldManager *field);
+
+	/**
+	 * Precompute lower bounds of the potential energy on a grid covering the source volume.
+	 *
+	 * The potential without Fermi potential and its gradient are calculated on the nodes of the grid at several times during the source's active time.
+	 * The lower bound for each cell is the minimum of its corner values minus the larger of the spread of the corner values
+	 * and twice the largest gradient at the corners times the half cell diagonal, the lowest Fermi potential in the geometry is added to it.
+	 * This is not strictly guaranteed between the sampled times or if the gradient changes strongly within a cell,
+	 * so RandomInitialCondition checks all exact potentials against the bound and stops using the map if it is violated.
+	 *
+	 * @param geometry Experiment geometry
+	 * @param field Optional fields (can be NULL)
+	 */
+	void InitPotentialMap(TGeometry &geometry, TFieldManager *field);
+
+	/**
+	 * Return lower bound of potential energy at a point
+	 *
+	 * @param pos Position
+	 * @param polarisation Polarisation of particle
+	 *
+	 * @return Returns lower bound from potential map or -infinity if point is outside of potential map
+	 */
+	double PotentialLowerBound(const double pos[3], int polarisation);
+
+	/**
+	 * Check if potential map can still be used
+	 *
+	 * @return Returns false if a potential below the map's lower bound was found
+	 */
+	bool PotentialMapValid();
+
+	/**
+	 * Stop using the potential map after an exact potential was found below its lower bound, prints a warning once
+	 *
+	 * @param pos Position where the bound was violated
+	 * @param V Exact potential at pos [eV]
+	 * @param bound Lower bound of potential map at pos [eV]
+	 */
+	void InvalidatePotentialMap(const double pos[3], double V, double bound);
 public:
 	/**
 	 * Constructor
@@ -132,20 +265,29 @@ public:
 	 *
 	 * @param ParticleName Name of particle that the source should create
 	 * @param ActiveTime Duration for which the source shall be active
-	 * @param PhaseSpaceWeighting If this is set true, the source will weight the particle density by available phase space
+	 * @param PhaseSpaceWeighting If this is set to 1, the source will weight the particle density by available phase space, if set to 2 it will additionally use a precomputed potential map to speed up the weighting
 	 */
-	TVolumeSource(std::string ParticleName, double ActiveTime, bool PhaseSpaceWeighting);
+	TVolumeSource(std::string ParticleName, double ActiveTime, int PhaseSpaceWeighting);
 
 	/**
-	 * Create particle in source volume
+	 * Destructor
+	 */
+	~TVolumeSource();
+
+	/**
+	 * Create initial conditions in source volume
 	 *
-	 * Particle density distribution can be weighted by available phase space
+	 * Particle density distribution can be weighted by available phase space.
+	 * In this case the spectrum determines the total energy and TInitialCondition::densityE is the density of the total energy,
+	 * The density of the creation point given the total energy depends on the potential in the whole source volume and is not calculated,
+	 * TInitialCondition::densitypos is NaN in this case.
 	 *
 	 * @param mc Random number generator
 	 * @param geometry Experiment geometry
 	 * @param field Optional fields (can be NULL)
+	 * @param ic Returns initial conditions
 	 */
-	TParticle* CreateParticle(TMCGenerator &mc, TGeometry &geometry, TFieldManager *field);
+	void RandomInitialCondition(TMCGenerator &mc, TGeometry &geometry, TFieldManager *field, TInitialCondition &ic);
 };
 
 /**
@@ -160,7 +302,9 @@ public:
 	 *
 	 * @param ParticleName Name of particle type that the source should produce
 	 * @param ActiveTime Duration for which the source shall be active
-	 * @param PhaseSpaceWeighting If this is set true, the source will weight the particle density by available phase space
+	 * @param PhaseSpaceWeighting If this is set to 1 or 2, the source will weight the particle density by available phase space
+	 * @param geometry Experiment geometry, used for potential map if PhaseSpaceWeighting is 2
+	 * @param field Optional fields (can be NULL), used for potential map if PhaseSpaceWeighting is 2
 	 * @param x_min Minimal radial coordinate range
 	 * @param x_max Maximal radial coordinate range
 	 * @param y_min Minimal azimuthal coordinate range
@@ -168,7 +312,7 @@ public:
 	 * @param z_min Minimal axial coordinate range
 	 * @param z_max Maximal axial coordinate range
 	 */
-	TCuboidVolumeSource(const string ParticleName, double ActiveTime, bool PhaseSpaceWeighting, double x_min, double x_max, double y_min, double y_max, double z_min, double z_max);
+	TCuboidVolumeSource(const string ParticleName, double ActiveTime, int PhaseSpaceWeighting, TGeometry &geometry, TFieldManager *field, double x_min, double x_max, double y_min, double y_max, double z_min, double z_max);
 
 
 	/**
@@ -180,6 +324,21 @@ public:
 	 * @param z Returns z coordinate
 	 */
 	virtual void RandomPointInSourceVolume(TMCGenerator &mc, double &x, double &y, double &z);
+
+	/**
+	 * Return cuboid containing the complete source volume
+	 *
+	 * @param min Returns lower corner of cuboid
+	 * @param max Returns upper corner of cuboid
+	 */
+	virtual void SourceBoundingBox(double min[3], double max[3]);
+
+	/**
+	 * Return volume of source
+	 *
+	 * @return Returns volume [m^3]
+	 */
+	virtual double SourceVolume();
 };
 
 
@@ -195,7 +354,9 @@ public:
 	 *
 	 * @param ParticleName Name of particle type that the source should produce
 	 * @param ActiveTime Duration for which the source shall be active
-	 * @param PhaseSpaceWeighting If this is set true, the source will weight the particle density by available phase space
+	 * @param PhaseSpaceWeighting If this is set to 1 or 2, the source will weight the particle density by available phase space
+	 * @param geometry Experiment geometry, used for potential map if PhaseSpaceWeighting is 2
+	 * @param field Optional fields (can be NULL), used for potential map if PhaseSpaceWeighting is 2
 	 * @param r_min Minimal radial coordinate range
 	 * @param r_max Maximal radial coordinate range
 	 * @param phi_min Minimal azimuthal coordinate range
@@ -203,7 +364,7 @@ public:
 	 * @param z_min Minimal axial coordinate range
 	 * @param z_max Maximal axial coordinate range
 	 */
-	TCylindricalVolumeSource(const string ParticleName, double ActiveTime, bool PhaseSpaceWeighting, double r_min, double r_max, double phi_min, double phi_max, double z_min, double z_max);
+	TCylindricalVolumeSource(const string ParticleName, double ActiveTime, int PhaseSpaceWeighting, TGeometry &geometry, TFieldManager *field, double r_min, double r_max, double phi_min, double phi_max, double z_min, double z_max);
 
 
 	/**
@@ -215,6 +376,21 @@ public:
 	 * @param z Returns z coordinate
 	 */
 	virtual void RandomPointInSourceVolume(TMCGenerator &mc, double &x, double &y, double &z);
+
+	/**
+	 * Return cuboid containing the complete source volume
+	 *
+	 * @param min Returns lower corner of cuboid
+	 * @param max Returns upper corner of cuboid
+	 */
+	virtual void SourceBoundingBox(double min[3], double max[3]);
+
+	/**
+	 * Return volume of source
+	 *
+	 * @return Returns volume [m^3]
+	 */
+	virtual double SourceVolume();
 };
 
 /**
@@ -257,16 +433,32 @@ public:
 class TSTLVolumeSource: public TVolumeSource{
 private:
 	TTriangleMesh kdtree; ///< internal AABB tree storing the STL solid
+	double voxelmin[3]; ///< lower corner of voxel grid (lower corner of STL bounding box)
+	double voxelsize[3]; ///< edge lengths of a single voxel
+	int nvoxels[3]; ///< number of voxels in each direction
+	vector<int> insidevoxels; ///< indices of voxels which are completely inside the STL solid
+	vector<int> boundaryvoxels; ///< indices of voxels which might be intersected by the STL surface
+	double volume; ///< volume enclosed by the STL solid
+
+	/**
+	 * Divide bounding box of STL solid into voxels and sort them into TSTLVolumeSource::insidevoxels and TSTLVolumeSource::boundaryvoxels.
+	 *
+	 * Voxels which might be touched by a triangle are marked as boundary voxels.
+	 * All remaining voxels are either completely inside or completely outside the solid, this is checked with a single InSolid test for each run of such voxels along the z axis.
+	 */
+	void InitVoxels();
 public:
 	/**
 	 * Constructor.
 	 *
 	 * @param ParticleName Name of particle type that the source should produce
 	 * @param ActiveTime Duration for which the source shall be active
-	 * @param PhaseSpaceWeighting If this is set true, the source will weight the particle density by available phase space
+	 * @param PhaseSpaceWeighting If this is set to 1 or 2, the source will weight the particle density by available phase space
+	 * @param geometry Experiment geometry, used for potential map if PhaseSpaceWeighting is 2
+	 * @param field Optional fields (can be NULL), used for potential map if PhaseSpaceWeighting is 2
 	 * @param sourcefile File from which the STL solid shall be read
 	 */
-	TSTLVolumeSource(const string ParticleName, double ActiveTime, bool PhaseSpaceWeighting, string sourcefile);
+	TSTLVolumeSource(const string ParticleName, double ActiveTime, int PhaseSpaceWeighting, TGeometry &geometry, TFieldManager *field, string sourcefile);
 
 
 	/**
@@ -278,6 +470,21 @@ public:
 	 * @param z Returns z coordinate
 	 */
 	virtual void RandomPointInSourceVolume(TMCGenerator &mc, double &x, double &y, double &z);
+
+	/**
+	 * Return cuboid containing the complete source volume
+	 *
+	 * @param min Returns lower corner of cuboid
+	 * @param max Returns upper corner of cuboid
+	 */
+	virtual void SourceBoundingBox(double min[3], double max[3]);
+
+	/**
+	 * Return volume of source
+	 *
+	 * @return Returns volume [m^3]
+	 */
+	virtual double SourceVolume();
 };
 
 
@@ -315,6 +522,7 @@ struct TSource{
 public:
 	string sourcemode; ///< volume/surface/customvol/customsurf
 	TParticleSource *source; ///< TParticleSource contructed according to user chosen sourcemode
+	int PhaseSpaceWeighting; ///< PhaseSpaceWeighting parameter of volume sources (0 for surface sources), particle densities then depend on field scales
 
 	/**
 	 * Constructor, loads [SOURCE] section of configuration file, calculates TSource::Hmin_lfs and TSource::Hmin_hfs
@@ -326,6 +534,20 @@ public:
 	TSource(TConfig &geometryconf, TGeometry &geom, TFieldManager &field);
 
 
+	/**
+	 * Check a source definition before it is loaded.
+	 *
+	 * Checks source mode, particle name and number of parameters and whether STL files can be opened,
+	 * so e.g. a simulation server can reject an invalid definition instead of exiting in the constructor.
+	 *
+	 * @param sourcemode Source mode as given in [SOURCE] section of configuration file
+	 * @param params Parameters of source as given in [SOURCE] section of configuration file
+	 *
+	 * @return Returns false and prints an error if the definition is invalid
+	 */
+	static bool Check(const string &sourcemode, const string &params);
+
+
 	/**
 	 * Destructor. Delete TSource::source.
 	 */
@@ -348,6 +570,17 @@ public:
 	 */
 	TParticle* CreateParticle(TMCGenerator &mc, TGeometry &geometry, TFieldManager *field);
 
+	/**
+	 * Create new particle from given initial conditions
+	 *
+	 * @param mc random number generator
+	 * @param ic Initial conditions, e.g. from TInitialConditionProducer
+	 * @param geometry Experiment geometry
+	 * @param field Optional fields (can be NULL)
+	 *
+	 * @return Returns newly created particle, memory has to be freed by user
+	 */
+	TParticle* CreateParticle(TMCGenerator &mc, const TInitialCondition &ic, TGeometry &geometry, TFieldManager *field);
 };
 
 
@@ -0,0 +1,139 @@
+/**
+ * \file
+ * Binary file containing complete states of particles, which can be continued in later runs.
+ */
+
+#include <cstring>
+#include <iostream>
+#include <stdint.h>
+
+#include "statefile.h"
+#include "neutron.h"
+#include "proton.h"
+#include "electron.h"
+#include "globals.h"
+
+using namespace std;
+
+static const char STATE_FILE_MAGIC[8] = {'P','E','N','T','R','K','S','T'}; ///< identifies particle state files
+static const int STATE_FILE_VERSION = 1; ///< version of particle state file format
+
+
+TParticleStateFile::TParticleStateFile(const string &filename, bool write): fFilename(filename), fFile(NULL), fWrite(write), count(0){
+	fFile = fopen(filename.c_str(), write ? "wb" : "rb");
+	if (write){
+		if (!fFile){
+			cout << "Could not create " << filename << "!\n";
+			exit(-1);
+		}
+		fwrite(STATE_FILE_MAGIC, sizeof(STATE_FILE_MAGIC), 1, fFile);
+		fwrite(&STATE_FILE_VERSION, sizeof(STATE_FILE_VERSION), 1, fFile);
+	}
+	else{
+		char magic[8];
+		int version;
+		if (!fFile || fread(magic, sizeof(magic), 1, fFile) != 1 || fread(&version, sizeof(version), 1, fFile) != 1 ||
+				memcmp(magic, STATE_FILE_MAGIC, sizeof(magic)) != 0 || version != STATE_FILE_VERSION){
+			cout << "Could not read particle states from " << filename << "!\n";
+			exit(-1);
+		}
+		cout << "Continuing particles from " << filename << '\n';
+	}
+}
+
+
+TParticleStateFile::~TParticleStateFile(){
+	if (!fWrite){
+		fclose(fFile);
+		return;
+	}
+	bool failed = ferror(fFile) != 0;
+	if (fclose(fFile) != 0 || failed){
+		cout << "Could not write particle states to " << fFilename << "!\n";
+		exit(-1);
+	}
+	cout << count << " particle states written to " << fFilename << '\n';
+}
+
+
+void TParticleStateFile::Write(TParticle &p, TMCGenerator &mc){
+	string name = p.name;
+	string rng = mc.GetState();
+	uint32_t len = name.size();
+	fwrite(&len, sizeof(len), 1, fFile);
+	fwrite(name.c_str(), 1, len, fFile);
+	len = rng.size();
+	fwrite(&len, sizeof(len), 1, fFile);
+	fwrite(rng.c_str(), 1, len, fFile);
+	p.SaveState(fFile);
+	count++;
+}
+
+
+TParticle* TParticleStateFile::Read(TMCGenerator &mc, TGeometry &geometry, TFieldManager *field, bool restorerng){
+	uint32_t len;
+	if (fread(&len, sizeof(len), 1, fFile) != 1)
+		return NULL;
+	string name(len, ' '), rng;
+	if (len > 0 && fread(&name[0], 1, len, fFile) != len){
+		cout << "Could not read particle state from " << fFilename << "!\n";
+		exit(-1);
+	}
+	if (fread(&len, sizeof(len), 1, fFile) != 1){
+		cout << "Could not read particle state from " << fFilename << "!\n";
+		exit(-1);
+	}
+	rng.resize(len);
+	if (len > 0 && fread(&rng[0], 1, len, fFile) != len){
+		cout << "Could not read particle state from " << fFilename << "!\n";
+		exit(-1);
+	}
+
+	TParticle *p;
+	if (name == NAME_NEUTRON)
+		p = new TNeutron(0, 0, 0, 0, 0, 0, 0, 0, mc, geometry, field);
+	else if (name == NAME_PROTON)
+		p = new TProton(0, 0, 0, 0, 0, 0, 0, 0, mc, geometry, field);
+	else if (name == NAME_ELECTRON)
+		p = new TElectron(0, 0, 0, 0, 0, 0, 0, 0, mc, geometry, field);
+	else{
+		cout << "Unknown particle " << name << " in " << fFilename << "!\n";
+		exit(-1);
+	}
+	p->RestoreState(fFile, fFilename);
+	if (restorerng)
+		mc.SetState(rng);
+	count++;
+	return p;
+}
+
+
+void TParticleStateFile::Merge(const vector<string> &files, const string &filename){
+	FILE *merged = fopen(filename.c_str(), "wb");
+	if (!merged){
+		cout << "Could not create " << filename << "!\n";
+		exit(-1);
+	}
+	fwrite(STATE_FILE_MAGIC, sizeof(STATE_FILE_MAGIC), 1, merged);
+	fwrite(&STATE_FILE_VERSION, sizeof(STATE_FILE_VERSION), 1, merged);
+	vector<char> buffer(1 << 20);
+	for (vector<string>::const_iterator f = files.begin(); f != files.end(); f++){
+		FILE *in = fopen(f->c_str(), "rb");
+		char magic[8];
+		int version;
+		if (!in || fread(magic, sizeof(magic), 1, in) != 1 || fread(&version, sizeof(version), 1, in) != 1 ||
+				memcmp(magic, STATE_FILE_MAGIC, sizeof(magic)) != 0 || version != STATE_FILE_VERSION){
+			cout << "Could not read particle states from " << *f << "!\n";
+			exit(-1);
+		}
+		size_t n;
+		while ((n = fread(&buffer[0], 1, buffer.size(), in)) > 0) // copy particle states following the header
+			fwrite(&buffer[0], 1, n, merged);
+		fclose(in);
+	}
+	bool failed = ferror(merged) != 0;
+	if (fclose(merged) != 0 || failed){
+		cout << "Could not write particle states to " << filename << "!\n";
+		exit(-1);
+	}
+}
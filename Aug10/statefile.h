@@ -0,0 +1,82 @@
+/**
+ * \file
+ * Binary file containing complete states of particles, which can be continued in later runs.
+ *
+ * Layout: "PENTRKST", int version, for each particle: uint32 length + particle name,
+ * uint32 length + state of random number generator, particle state written by TParticle::SaveState
+ */
+
+#ifndef STATEFILE_H_
+#define STATEFILE_H_
+
+#include <string>
+#include <vector>
+#include <cstdio>
+
+#include "particle.h"
+#include "geometry.h"
+#include "fields.h"
+#include "mc.h"
+
+/**
+ * File containing states of particles which were still being simulated at the end of a run (see savefile and restorefile in config.in).
+ *
+ * Together with each particle the state of the random number generator at the time the particle was saved is stored.
+ * If it is restored before a particle is continued, the continuation uses the same random numbers as the particle would have used without being interrupted,
+ * so continuation runs with different configurations are correlated and differences between them have smaller statistical uncertainties.
+ */
+class TParticleStateFile{
+private:
+	std::string fFilename; ///< file name
+	FILE *fFile; ///< binary file
+	bool fWrite; ///< file is written instead of read
+public:
+	unsigned int count; ///< number of particles written or read
+
+	/**
+	 * Constructor, creates file and writes header or opens file and checks header.
+	 *
+	 * Exits program if file cannot be created or is not a particle state file.
+	 *
+	 * @param filename File name
+	 * @param write Create file if true, read existing file otherwise
+	 */
+	TParticleStateFile(const std::string &filename, bool write);
+
+	/**
+	 * Destructor, closes file
+	 */
+	~TParticleStateFile();
+
+	/**
+	 * Write particle state to file
+	 *
+	 * @param p Particle
+	 * @param mc Random number generator, whose state is saved with the particle
+	 */
+	void Write(TParticle &p, TMCGenerator &mc);
+
+	/**
+	 * Read next particle from file
+	 *
+	 * @param mc Random number generator
+	 * @param geometry Experiment geometry
+	 * @param field Optional fields (can be NULL)
+	 * @param restorerng Set state of random number generator to the state saved with the particle
+	 *
+	 * @return Returns newly created particle or NULL if end of file was reached, memory has to be freed by user
+	 */
+	TParticle* Read(TMCGenerator &mc, TGeometry &geometry, TFieldManager *field, bool restorerng);
+
+	/**
+	 * Merge particle state files, e.g. written by several processes, into one file
+	 *
+	 * Exits program if a file cannot be read or written.
+	 *
+	 * @param files Names of files to merge
+	 * @param filename Name of merged file
+	 */
+	static void Merge(const std::vector<std::string> &files, const std::string &filename);
+};
+
+#endif /* STATEFILE_H_ */
@@ -0,0 +1,8 @@
+#!/bin/bash
+
+cd ../..
+make field_3d.o conductor.o globals.o libtricubic/libtricubic.o libtricubic/tricubic_utils.o
+g++ -O3 -Wall -I. -Ilibtricubic -Ialglib-3.9.0/cpp/src -o test/SymmetryTest/SymmetryTest test/SymmetryTest/SymmetryTest.cpp \
+	field_3d.o conductor.o globals.o libtricubic/libtricubic.o libtricubic/tricubic_utils.o alglib-3.9.0/cpp/src/*.o -lpthread
+cd test/SymmetryTest
+./SymmetryTest
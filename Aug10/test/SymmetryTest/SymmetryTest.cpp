@@ -0,0 +1,184 @@
+/**
+ * \file
+ * Compare symmetry-reduced 3D field tables with the conductors they were calculated from.
+ *
+ * For each mirror plane a finite wire is combined with its mirror image, carrying either the same current (magnetic field is axial under the mirror)
+ * or the opposite current (magnetic field is polar under the mirror). Full racetrack coils can only be mirrored at the xy-plane:
+ * a racetrack from z1 to z2 combined with one from -z2 to -z1 and the same current has the opposite sense of circulation (polar), with opposite current it is axial.
+ * Rotation is checked with four vertical finite wires, each rotated by 90 degrees around the z axis from the previous one, and symmetry r4.
+ * The field of each configuration is tabulated only on the part of space left after applying the symmetry,
+ * the table is loaded with the corresponding Symmetry string and compared to the conductors at random points in the whole space,
+ * except in the BoundaryWidth at the outer faces of the table.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+#include <string>
+
+#include "field_3d.h"
+#include "conductor.h"
+#include "globals.h"
+
+using namespace std;
+
+static const double Range = 1; ///< tables and test points extend from -Range to Range in each direction [m]
+static const double Spacing = 0.05; ///< grid spacing of tables [m]
+static const double Margin = 2.5*Spacing; ///< tables extend this far beyond the symmetry planes, grid points are offset by half a spacing from the coordinate planes containing the racetrack coils [m]
+static const double BoundaryWidth = 2*Margin; ///< larger than Margin, so tables would be smoothed at the symmetry planes if TabField3 did not skip them [m]
+static const double Tolerance = 1e-2; ///< maximum deviation of field and derivatives, relative to their largest absolute value in the test points
+
+/**
+ * Calculate field of conductors and its derivatives by central differences (TFullRacetrack does not return consistent derivatives)
+ *
+ * @param conductors Conductors producing the field
+ * @param p Point
+ * @param B Returns field components and derivatives
+ */
+void ConductorField(vector<TConductorField*> &conductors, const double p[3], double B[4][4]){
+	const double h = 1e-5;
+	for (int j = 0; j < 4; j++){
+		double pl[3] = {p[0], p[1], p[2]}, ph[3] = {p[0], p[1], p[2]};
+		if (j > 0){
+			pl[j - 1] -= h;
+			ph[j - 1] += h;
+		}
+		double Bl[4][4] = {{0,0,0,0},{0,0,0,0},{0,0,0,0},{0,0,0,0}}, Bh[4][4] = {{0,0,0,0},{0,0,0,0},{0,0,0,0},{0,0,0,0}};
+		for (vector<TConductorField*>::iterator c = conductors.begin(); c != conductors.end(); c++){
+			(*c)->BField(pl[0], pl[1], pl[2], 0, Bl, BFIELD_VALUE);
+			(*c)->BField(ph[0], ph[1], ph[2], 0, Bh, BFIELD_VALUE);
+		}
+		for (int i = 0; i < 3; i++)
+			B[i][j] = j > 0 ? (Bh[i][0] - Bl[i][0])/2/h : Bl[i][0];
+	}
+}
+
+/**
+ * Write field of conductors into an Opera table, covering only positive coordinates in mirrored directions and the first sector of rotations
+ *
+ * @param filename Path of table file
+ * @param conductors Conductors producing the field
+ * @param positive Only tabulate positive x, y or z (and Margin beyond the plane)
+ */
+void WriteTable(const char *filename, vector<TConductorField*> &conductors, const bool positive[3]){
+	double lo[3], n[3];
+	for (int i = 0; i < 3; i++){
+		lo[i] = positive[i] ? -Margin : -Range - Spacing/2;
+		n[i] = floor((Range - lo[i])/Spacing + 0.5) + 1;
+	}
+	FILE *f = fopen(filename, "w");
+	if (!f){
+		printf("Could not open %s!\n", filename);
+		exit(-1);
+	}
+	fprintf(f, " %10i %10i %10i %10i\n", (int)n[0], (int)n[1], (int)n[2], 2);
+	fprintf(f, " 1 X [LENGU]\n 2 Y [LENGU]\n 3 Z [LENGU]\n 4 BX [FLUXU]\n 5 BY [FLUXU]\n 6 BZ [FLUXU]\n 0\n");
+	for (int xi = 0; xi < n[0]; xi++){
+		for (int yi = 0; yi < n[1]; yi++){
+			for (int zi = 0; zi < n[2]; zi++){
+				double x = lo[0] + xi*Spacing, y = lo[1] + yi*Spacing, z = lo[2] + zi*Spacing;
+				double B[4][4] = {{0,0,0,0},{0,0,0,0},{0,0,0,0},{0,0,0,0}};
+				for (vector<TConductorField*>::iterator c = conductors.begin(); c != conductors.end(); c++)
+					(*c)->BField(x, y, z, 0, B, BFIELD_VALUE);
+				fprintf(f, "%.9Lg %.9Lg %.9Lg %.12Lg %.12Lg %.12Lg\n", x/lengthconv, y/lengthconv, z/lengthconv, B[0][0]/Bconv, B[1][0]/Bconv, B[2][0]/Bconv);
+			}
+		}
+	}
+	fclose(f);
+}
+
+/**
+ * Tabulate field of conductors, load it with a symmetry and compare it to the conductors.
+ *
+ * @param name Description of configuration
+ * @param conductors Conductors producing the field
+ * @param symmetry Symmetry string passed to TabField3
+ * @param mindist Only compare points farther than this from the xz- and yz-planes (to keep away from racetrack coils inside the table, whose field has kinks on these planes)
+ *
+ * @return Returns true if table and conductors agree within Tolerance
+ */
+bool Compare(const char *name, vector<TConductorField*> conductors, const char *symmetry, double mindist = 0){
+	bool positive[3] = {false, false, false};
+	for (const char *c = symmetry; *c; c++){
+		if (*c >= 'x' && *c <= 'z')
+			positive[*c - 'x'] = true;
+		else if (*c >= 'X' && *c <= 'Z')
+			positive[*c - 'X'] = true;
+		else if (*c == 'r'){ // first sector of a rotation lies at positive y, and positive x for sectors up to 90 degrees
+			int fold = atoi(c + 1);
+			positive[0] |= fold >= 4;
+			positive[1] |= fold > 1;
+		}
+	}
+	const char *tabfile = "SymmetryTest.tab";
+	WriteTable(tabfile, conductors, positive);
+	TabField3 table(tabfile, 1, 1, 0, 0, 1, 0, BoundaryWidth, 0, symmetry);
+	remove(tabfile);
+
+	double maxB = 0, maxdB = 0, devB = 0, devdB = 0;
+	srand(42);
+	for (int n = 0; n < 10000; ){
+		double p[3];
+		for (int i = 0; i < 3; i++)
+			p[i] = (2.0*rand()/RAND_MAX - 1)*(Range - BoundaryWidth - Spacing);
+		if (fabs(p[0]) < mindist || fabs(p[1]) < mindist)
+			continue;
+		double Bc[4][4], Bt[4][4] = {{0,0,0,0},{0,0,0,0},{0,0,0,0},{0,0,0,0}};
+		ConductorField(conductors, p, Bc);
+		table.BField(p[0], p[1], p[2], 0.5, Bt, BFIELD_ALL);
+		for (int i = 0; i < 3; i++){
+			maxB = max(maxB, fabs(Bc[i][0]));
+			devB = max(devB, fabs(Bt[i][0] - Bc[i][0]));
+			for (int j = 1; j < 4; j++){
+				maxdB = max(maxdB, fabs(Bc[i][j]));
+				devdB = max(devdB, fabs(Bt[i][j] - Bc[i][j]));
+			}
+		}
+		n++;
+	}
+	for (vector<TConductorField*>::iterator c = conductors.begin(); c != conductors.end(); c++)
+		delete *c;
+
+	bool passed = devB <= Tolerance*maxB && devdB <= Tolerance*maxdB;
+	printf("%-55s %-2s max. deviation: B %.2g%%, dB/dx %.2g%% %s\n", name, symmetry, devB/maxB*100, devdB/maxdB*100, passed ? "passed" : "FAILED");
+	return passed;
+}
+
+int main(){
+	const double w1[3] = {0.3, 1.3, -0.4}, w2[3] = {0.6, 1.2, 0.5}; // wire outside of tables, its mirror images are outside as well
+	const double I = 1000;
+	bool passed = true;
+	for (int i = 0; i < 3; i++){
+		double m1[3] = {w1[0], w1[1], w1[2]}, m2[3] = {w2[0], w2[1], w2[2]}; // mirror wire at plane i
+		m1[i] = -m1[i];
+		m2[i] = -m2[i];
+		for (int sign = 1; sign >= -1; sign -= 2){
+			vector<TConductorField*> conductors;
+			conductors.push_back(new TFiniteWire(w1[0], w1[1], w1[2], w2[0], w2[1], w2[2], I));
+			conductors.push_back(new TFiniteWire(m1[0], m1[1], m1[2], m2[0], m2[1], m2[2], sign*I));
+			string symmetry(1, (sign > 0 ? 'X' : 'x') + i);
+			string name = string("FiniteWire and mirror image in ") + (char)('x' + i) + (sign > 0 ? "" : " with opposite current");
+			passed &= Compare(name.c_str(), conductors, symmetry.c_str());
+		}
+	}
+
+	vector<TConductorField*> racetrack(1, new TFullRacetrack(-0.5, 0.5, 0.2, I));
+	passed &= Compare("FullRacetrack symmetric to xy-plane", racetrack, "z", 0.4);
+	for (int sign = 1; sign >= -1; sign -= 2){
+		vector<TConductorField*> racetracks;
+		racetracks.push_back(new TFullRacetrack(0.1, 0.6, 0.2, I));
+		racetracks.push_back(new TFullRacetrack(-0.6, -0.1, 0.2, sign*I));
+		passed &= Compare(sign > 0 ? "FullRacetrack and mirror image in z" : "FullRacetrack and mirror image with opposite current", racetracks, sign > 0 ? "z" : "Z", 0.4);
+	}
+
+	vector<TConductorField*> wires;
+	for (int k = 0; k < 4; k++){
+		double c = cos(k*pi/2), s = sin(k*pi/2); // rotate wire at (1.3, 0.3) by k*90 degrees, all lie outside of the table
+		wires.push_back(new TFiniteWireZ(c*1.3 - s*0.3, s*1.3 + c*0.3, -0.4, 0.5, I));
+	}
+	passed &= Compare("Four FiniteWireZ rotated by 90 degrees", wires, "r4");
+
+	printf(passed ? "All tests passed\n" : "Some tests FAILED\n");
+	return passed ? 0 : 1;
+}